@@ -0,0 +1,136 @@
+/*
+ * ProFTPD - mod_conf_url fetch backends
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "backend.h"
+
+static const char *trace_channel = "conf_url";
+
+static array_header *backends = NULL;
+static const struct urlconf_backend *backend_selected = NULL;
+
+static const struct urlconf_backend *backend_find(const char *name) {
+  register unsigned int i;
+  const struct urlconf_backend **elts;
+
+  elts = backends->elts;
+  for (i = 0; i < backends->nelts; i++) {
+    if (strcmp(elts[i]->name, name) == 0) {
+      return elts[i];
+    }
+  }
+
+  return NULL;
+}
+
+int urlconf_backend_register(const struct urlconf_backend *backend) {
+  if (backend == NULL ||
+      backend->name == NULL ||
+      backend->capabilities == NULL ||
+      backend->alloc == NULL ||
+      backend->get == NULL ||
+      backend->destroy == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (backends == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (backend_find(backend->name) != NULL) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  *((const struct urlconf_backend **) push_array(backends)) = backend;
+  if (backend_selected == NULL) {
+    backend_selected = backend;
+  }
+
+  pr_trace_msg(trace_channel, 17, "registered '%s' fetch backend",
+    backend->name);
+  return 0;
+}
+
+int urlconf_backend_use(const char *name) {
+  const struct urlconf_backend *backend;
+
+  if (backends == NULL ||
+      backends->nelts == 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (name == NULL) {
+    backend_selected = ((const struct urlconf_backend **) backends->elts)[0];
+    return 0;
+  }
+
+  backend = backend_find(name);
+  if (backend == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "using '%s' fetch backend", name);
+  backend_selected = backend;
+  return 0;
+}
+
+const struct urlconf_backend *urlconf_backend_get(void) {
+  if (backend_selected == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return backend_selected;
+}
+
+int urlconf_backend_can(unsigned long caps) {
+  if (backend_selected == NULL) {
+    return FALSE;
+  }
+
+  return (backend_selected->capabilities() & caps) == caps ? TRUE : FALSE;
+}
+
+int urlconf_backend_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  backends = make_array(p, 0, sizeof(struct urlconf_backend *));
+  backend_selected = NULL;
+  return 0;
+}
+
+int urlconf_backend_free(void) {
+  backends = NULL;
+  backend_selected = NULL;
+  return 0;
+}
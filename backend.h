@@ -0,0 +1,82 @@
+/*
+ * ProFTPD - mod_conf_url fetch backends
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_BACKEND_H
+#define MOD_CONF_URL_BACKEND_H
+
+/* What a backend can do, beyond fetching a single URL: fetch many URLs
+ * concurrently (and resolve their hosts in advance), resume transfers, list
+ * FTP directories, use TLS settings, and report transfer timing.
+ */
+#define URLCONF_BACKEND_CAP_MANY		0x0001
+#define URLCONF_BACKEND_CAP_RESUME		0x0002
+#define URLCONF_BACKEND_CAP_LIST		0x0004
+#define URLCONF_BACKEND_CAP_TLS			0x0008
+#define URLCONF_BACKEND_CAP_TIMING		0x0010
+
+/* A means of fetching URLs.  The handles returned by alloc are opaque, and
+ * are only given back to the same backend.  The get callback provides the
+ * response code and, if resp_headers is not NULL, the response headers (with
+ * lowercased names); it returns -1, with errno set, only if the request
+ * could not be made.
+ */
+struct urlconf_backend {
+  const char *name;
+
+  unsigned long (*capabilities)(void);
+
+  void *(*alloc)(pool *p, unsigned long max_connect_secs,
+    unsigned long max_request_secs, unsigned long flags);
+
+  int (*get)(pool *p, void *handle, const char *url, pr_table_t *headers,
+    size_t (*resp_body)(char *, size_t, size_t, void *), void *user_data,
+    long *resp_code, pr_table_t *resp_headers);
+
+  int (*destroy)(pool *p, void *handle);
+};
+
+/* Registers the given backend; the first backend registered is the default.
+ */
+int urlconf_backend_register(const struct urlconf_backend *backend);
+
+/* Selects the named backend for subsequent fetches; NULL selects the
+ * default.  Handles are not portable between backends, so this is only to
+ * be done between configuration parses.
+ */
+int urlconf_backend_use(const char *name);
+
+/* Returns the selected backend. */
+const struct urlconf_backend *urlconf_backend_get(void);
+
+/* Returns TRUE if the selected backend has the given capabilities. */
+int urlconf_backend_can(unsigned long caps);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_backend_init(pool *p);
+int urlconf_backend_free(void);
+
+#endif /* MOD_CONF_URL_BACKEND_H */
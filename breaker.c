@@ -0,0 +1,243 @@
+/*
+ * ProFTPD - mod_conf_url negative caching/circuit breaking implementation
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_conf_url.h"
+#include "breaker.h"
+
+struct breaker_entry {
+  int xerrno;
+  time_t expires;
+
+  /* Consecutive connection failures, for host entries. */
+  unsigned int nfailures;
+};
+
+static pool *breaker_parent_pool = NULL;
+static pool *breaker_pool = NULL;
+static pr_table_t *breaker_hosts = NULL;
+static pr_table_t *breaker_urls = NULL;
+static struct urlconf_breaker_config breaker_config = {
+  URLCONF_BREAKER_DEFAULT_NOT_FOUND_TTL,
+  URLCONF_BREAKER_DEFAULT_DNS_FAILURE_TTL,
+  URLCONF_BREAKER_DEFAULT_THRESHOLD,
+  URLCONF_BREAKER_DEFAULT_TTL
+};
+
+static const char *trace_channel = "conf_url";
+
+/* Looks up the entry for the given key in the hosts (or URLs) table,
+ * creating it if requested.
+ */
+static struct breaker_entry *breaker_get(int hosts, const char *key,
+    int create) {
+  struct breaker_entry *entry;
+  pr_table_t *tab;
+
+  if (breaker_pool == NULL) {
+    if (create == FALSE) {
+      return NULL;
+    }
+
+    breaker_pool = make_sub_pool(breaker_parent_pool);
+    pr_pool_tag(breaker_pool, MOD_CONF_URL_VERSION ": Breaker Pool");
+
+    breaker_hosts = pr_table_alloc(breaker_pool, 0);
+    breaker_urls = pr_table_alloc(breaker_pool, 0);
+  }
+
+  tab = hosts ? breaker_hosts : breaker_urls;
+  entry = (struct breaker_entry *) pr_table_get(tab, key, NULL);
+  if (entry == NULL &&
+      create == TRUE) {
+    entry = pcalloc(breaker_pool, sizeof(struct breaker_entry));
+    if (pr_table_add(tab, pstrdup(breaker_pool, key), entry,
+        sizeof(struct breaker_entry)) < 0) {
+      return NULL;
+    }
+  }
+
+  return entry;
+}
+
+static int breaker_is_host_failure(int xerrno) {
+  switch (xerrno) {
+    case ECONNREFUSED:
+    case EHOSTUNREACH:
+    case ENETUNREACH:
+    case ETIMEDOUT:
+      return TRUE;
+
+    default:
+      break;
+  }
+
+  return FALSE;
+}
+
+int urlconf_breaker_check(const char *host, const char *url) {
+  struct breaker_entry *entry;
+  time_t now;
+
+  if (host == NULL ||
+      url == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  time(&now);
+
+  entry = breaker_get(TRUE, host, FALSE);
+  if (entry != NULL &&
+      entry->expires > now) {
+    pr_trace_msg(trace_channel, 8,
+      "failing '%s' request: host '%s' recently failed (%s), retry in %lu secs",
+      url, host, strerror(entry->xerrno), (unsigned long) (entry->expires - now));
+    errno = entry->xerrno;
+    return -1;
+  }
+
+  entry = breaker_get(FALSE, url, FALSE);
+  if (entry != NULL &&
+      entry->expires > now) {
+    pr_trace_msg(trace_channel, 8,
+      "failing '%s' request: URL recently failed (%s), retry in %lu secs", url,
+      strerror(entry->xerrno), (unsigned long) (entry->expires - now));
+    errno = entry->xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int urlconf_breaker_record(const char *host, const char *url, int xerrno) {
+  struct breaker_entry *entry;
+  time_t now;
+
+  if (host == NULL ||
+      url == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (breaker_parent_pool == NULL) {
+    return 0;
+  }
+
+  /* An interrupted fetch says nothing about the health of the server. */
+  if (xerrno == EINTR) {
+    return 0;
+  }
+
+  time(&now);
+
+  if (xerrno == 0) {
+    entry = breaker_get(TRUE, host, FALSE);
+    if (entry != NULL) {
+      entry->nfailures = 0;
+      entry->expires = 0;
+    }
+
+    return 0;
+  }
+
+  switch (xerrno) {
+    case ENOENT:
+      if (breaker_config.not_found_ttl > 0) {
+        entry = breaker_get(FALSE, url, TRUE);
+        if (entry != NULL) {
+          entry->xerrno = xerrno;
+          entry->expires = now + breaker_config.not_found_ttl;
+        }
+      }
+      break;
+
+    case ESRCH:
+      /* A DNS failure applies to all URLs for that host. */
+      if (breaker_config.dns_failure_ttl > 0) {
+        entry = breaker_get(TRUE, host, TRUE);
+        if (entry != NULL) {
+          entry->xerrno = xerrno;
+          entry->expires = now + breaker_config.dns_failure_ttl;
+        }
+      }
+      break;
+
+    default:
+      if (breaker_is_host_failure(xerrno) == TRUE &&
+          breaker_config.threshold > 0) {
+        entry = breaker_get(TRUE, host, TRUE);
+        if (entry != NULL) {
+          entry->nfailures++;
+
+          if (entry->nfailures >= breaker_config.threshold) {
+            pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+              ": %u consecutive failures for host '%s', failing requests "
+              "to that host for the next %lu secs", entry->nfailures, host,
+              breaker_config.ttl);
+            entry->xerrno = xerrno;
+            entry->expires = now + breaker_config.ttl;
+          }
+        }
+      }
+      break;
+  }
+
+  return 0;
+}
+
+struct urlconf_breaker_config *urlconf_breaker_get_config(void) {
+  return &breaker_config;
+}
+
+int urlconf_breaker_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  breaker_parent_pool = p;
+  return 0;
+}
+
+int urlconf_breaker_clear(void) {
+  if (breaker_pool != NULL) {
+    destroy_pool(breaker_pool);
+    breaker_pool = NULL;
+    breaker_hosts = breaker_urls = NULL;
+  }
+
+  breaker_config.not_found_ttl = URLCONF_BREAKER_DEFAULT_NOT_FOUND_TTL;
+  breaker_config.dns_failure_ttl = URLCONF_BREAKER_DEFAULT_DNS_FAILURE_TTL;
+  breaker_config.threshold = URLCONF_BREAKER_DEFAULT_THRESHOLD;
+  breaker_config.ttl = URLCONF_BREAKER_DEFAULT_TTL;
+
+  return 0;
+}
+
+int urlconf_breaker_free(void) {
+  (void) urlconf_breaker_clear();
+  breaker_parent_pool = NULL;
+
+  return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * ProFTPD - mod_conf_url negative caching/circuit breaking
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_BREAKER_H
+#define MOD_CONF_URL_BREAKER_H
+
+/* Defaults: TTLs in secs, threshold in number of consecutive failures. */
+#define URLCONF_BREAKER_DEFAULT_NOT_FOUND_TTL		60UL
+#define URLCONF_BREAKER_DEFAULT_DNS_FAILURE_TTL		60UL
+#define URLCONF_BREAKER_DEFAULT_THRESHOLD		3U
+#define URLCONF_BREAKER_DEFAULT_TTL			60UL
+
+struct urlconf_breaker_config {
+  unsigned long not_found_ttl;
+  unsigned long dns_failure_ttl;
+
+  /* Number of consecutive connection failures to a host which opens the
+   * breaker for that host; zero disables the breaker.
+   */
+  unsigned int threshold;
+
+  /* How long the breaker stays open. */
+  unsigned long ttl;
+};
+
+/* Checks whether the given URL, or its host, have recently failed in a way
+ * that we remember.  Returns 0 if the URL should be fetched, or -1, with
+ * errno set to the remembered error, if not.
+ */
+int urlconf_breaker_check(const char *host, const char *url);
+
+/* Records the outcome of fetching the given URL: an errno value, or zero
+ * for success.
+ */
+int urlconf_breaker_record(const char *host, const char *url, int xerrno);
+
+/* Returns the current configuration, for modification by callers. */
+struct urlconf_breaker_config *urlconf_breaker_get_config(void);
+
+/* Forgets all remembered failures, and restores the default configuration;
+ * for use at the end of a configuration parse.
+ */
+int urlconf_breaker_clear(void);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_breaker_init(pool *p);
+int urlconf_breaker_free(void);
+
+#endif /* MOD_CONF_URL_BREAKER_H */
@@ -0,0 +1,474 @@
+/*
+ * ProFTPD - mod_conf_url shared cache implementation
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_conf_url.h"
+#include "cache.h"
+#include "utils.h"
+
+static const char *trace_channel = "conf_url";
+
+/* The cache directory holds, per URL, a lock file ("<key>.lck") and the
+ * most recently published response ("<key>.dat"), where the key is a hash
+ * of the URL.  Responses are first written to a process-specific temporary
+ * file, then renamed into place, so that readers never see partial data.
+ *
+ * The cache directory is also a content-addressed store of responses whose
+ * integrity metadata are known ("<key>.blob", where the key is a hash of
+ * that metadata).  These never expire.
+ *
+ * Alongside a cached response, its ETag, if any, is kept ("<key>.etag"), for
+ * requesting deltas against that response.
+ *
+ * Each file starts with the full URL (or integrity metadata) it is for,
+ * followed by a newline; the hashed key alone is not trusted to identify
+ * the entry.  Since these files are read back into the configuration, the
+ * cache directory must be owned by us, and not writable by group or others.
+ */
+
+static const char *cache_path(pool *p, const char *cache_dir, const char *url,
+    const char *ext) {
+  const char *key;
+
+  key = urlconf_utils_hash_key(p, url);
+  return pstrcat(p, cache_dir, "/", key, ext, NULL);
+}
+
+static int cache_check_dir(const char *cache_dir) {
+  struct stat st;
+
+  if (lstat(cache_dir, &st) < 0) {
+    return -1;
+  }
+
+  if (!S_ISDIR(st.st_mode)) {
+    pr_trace_msg(trace_channel, 3, "cache directory '%s' is not a directory",
+      cache_dir);
+    errno = ENOTDIR;
+    return -1;
+  }
+
+  if (st.st_uid != geteuid()) {
+    pr_trace_msg(trace_channel, 3, "cache directory '%s' is owned by UID %lu, "
+      "not UID %lu", cache_dir, (unsigned long) st.st_uid,
+      (unsigned long) geteuid());
+    errno = EPERM;
+    return -1;
+  }
+
+  if (st.st_mode & (S_IWGRP|S_IWOTH)) {
+    pr_trace_msg(trace_channel, 3,
+      "cache directory '%s' is writable by group or others", cache_dir);
+    errno = EPERM;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int cache_make_dir(const char *cache_dir) {
+  if (mkdir(cache_dir, 0700) < 0 &&
+      errno != EEXIST) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error creating cache directory '%s': %s",
+      cache_dir, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return cache_check_dir(cache_dir);
+}
+
+int urlconf_cache_lock(pool *p, const char *cache_dir, const char *url) {
+  int fd, res, xerrno;
+  const char *path;
+  struct flock lock;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      url == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (cache_make_dir(cache_dir) < 0) {
+    return -1;
+  }
+
+  path = cache_path(p, cache_dir, url, ".lck");
+  fd = open(path, O_RDWR|O_CREAT|O_NOFOLLOW, 0600);
+  if (fd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error opening cache lock '%s': %s", path,
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = 0;
+  lock.l_len = 0;
+
+  pr_trace_msg(trace_channel, 19, "obtaining cache lock '%s' for '%s'", path,
+    url);
+
+  res = fcntl(fd, F_SETLKW, &lock);
+  while (res < 0) {
+    xerrno = errno;
+
+    if (xerrno == EINTR) {
+      pr_signals_handle();
+      res = fcntl(fd, F_SETLKW, &lock);
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 3, "error obtaining cache lock '%s': %s", path,
+      strerror(xerrno));
+    (void) close(fd);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 19, "obtained cache lock '%s' for '%s'", path,
+    url);
+  return fd;
+}
+
+int urlconf_cache_unlock(int lockfd) {
+  if (lockfd < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Closing the fd releases the lock. */
+  return close(lockfd);
+}
+
+static int cache_read(pool *p, const char *cache_dir, const char *path,
+    const char *url, int check_ttl, unsigned long ttl, char **data,
+    size_t *datalen) {
+  int fd, xerrno;
+  struct stat st;
+  time_t now;
+  char *buf;
+  size_t buflen = 0, urllen;
+
+  if (cache_check_dir(cache_dir) < 0) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  fd = open(path, O_RDONLY|O_NOFOLLOW);
+  if (fd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 17, "no cached response '%s' for '%s': %s",
+      path, url, strerror(xerrno));
+
+    errno = ENOENT;
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  time(&now);
+  if (check_ttl == TRUE &&
+      (unsigned long) (now - st.st_mtime) > ttl) {
+    pr_trace_msg(trace_channel, 17,
+      "cached response '%s' for '%s' is stale (%lu secs old, TTL %lu secs)",
+      path, url, (unsigned long) (now - st.st_mtime), ttl);
+    (void) close(fd);
+
+    errno = ENOENT;
+    return -1;
+  }
+
+  buf = palloc(p, st.st_size + 1);
+  while (buflen < (size_t) st.st_size) {
+    ssize_t res;
+
+    res = read(fd, buf + buflen, st.st_size - buflen);
+    if (res < 0) {
+      xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      (void) close(fd);
+
+      errno = xerrno;
+      return -1;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    buflen += res;
+  }
+
+  (void) close(fd);
+  buf[buflen] = '\0';
+
+  urllen = strlen(url);
+  if (buflen <= urllen ||
+      memcmp(buf, url, urllen) != 0 ||
+      buf[urllen] != '\n') {
+    pr_trace_msg(trace_channel, 3,
+      "cached response '%s' is not for '%s', ignoring", path, url);
+
+    errno = ENOENT;
+    return -1;
+  }
+
+  buf += (urllen + 1);
+  buflen -= (urllen + 1);
+
+  pr_trace_msg(trace_channel, 15, "using cached response '%s' (%lu bytes) "
+    "for '%s'", path, (unsigned long) buflen, url);
+
+  *data = buf;
+  *datalen = buflen;
+  return 0;
+}
+
+int urlconf_cache_get(pool *p, const char *cache_dir, const char *url,
+    unsigned long ttl, char **data, size_t *datalen) {
+  const char *path;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      url == NULL ||
+      data == NULL ||
+      datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  path = cache_path(p, cache_dir, url, ".dat");
+  return cache_read(p, cache_dir, path, url, TRUE, ttl, data, datalen);
+}
+
+int urlconf_cache_get_blob(pool *p, const char *cache_dir,
+    const char *integrity, char **data, size_t *datalen) {
+  const char *path;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      integrity == NULL ||
+      data == NULL ||
+      datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  path = cache_path(p, cache_dir, integrity, ".blob");
+  return cache_read(p, cache_dir, path, integrity, FALSE, 0, data,
+    datalen);
+}
+
+static int cache_write(pool *p, const char *cache_dir, const char *path,
+    const char *url, const char *data, size_t datalen) {
+  int fd, xerrno;
+  char *tmp_path, *entry;
+  size_t urllen, entrylen, written = 0;
+
+  if (cache_check_dir(cache_dir) < 0) {
+    return -1;
+  }
+
+  /* The entry starts with the URL it is for; see above. */
+  urllen = strlen(url);
+  entrylen = urllen + 1 + datalen;
+  entry = palloc(p, entrylen);
+  memcpy(entry, url, urllen);
+  entry[urllen] = '\n';
+  memcpy(entry + urllen + 1, data, datalen);
+
+  /* mkstemp(3) creates the file exclusively, with 0600 permissions, using
+   * a name which cannot be predicted, and thus planted, by others.
+   */
+  tmp_path = pstrcat(p, path, ".XXXXXX", NULL);
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error opening cache file '%s': %s",
+      tmp_path, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  while (written < entrylen) {
+    ssize_t res;
+
+    res = write(fd, entry + written, entrylen - written);
+    if (res < 0) {
+      xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      pr_trace_msg(trace_channel, 3, "error writing cache file '%s': %s",
+        tmp_path, strerror(xerrno));
+      (void) close(fd);
+      (void) unlink(tmp_path);
+
+      errno = xerrno;
+      return -1;
+    }
+
+    written += res;
+  }
+
+  if (close(fd) < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error writing cache file '%s': %s",
+      tmp_path, strerror(xerrno));
+    (void) unlink(tmp_path);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (rename(tmp_path, path) < 0) {
+    xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error renaming '%s' to '%s': %s",
+      tmp_path, path, strerror(xerrno));
+    (void) unlink(tmp_path);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "published cached response '%s' "
+    "(%lu bytes) for '%s'", path, (unsigned long) datalen, url);
+  return 0;
+}
+
+int urlconf_cache_put(pool *p, const char *cache_dir, const char *url,
+    const char *data, size_t datalen) {
+  const char *path;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      url == NULL ||
+      data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  path = cache_path(p, cache_dir, url, ".dat");
+  return cache_write(p, cache_dir, path, url, data, datalen);
+}
+
+int urlconf_cache_put_blob(pool *p, const char *cache_dir,
+    const char *integrity, const char *data, size_t datalen) {
+  const char *path;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      integrity == NULL ||
+      data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (cache_make_dir(cache_dir) < 0) {
+    return -1;
+  }
+
+  path = cache_path(p, cache_dir, integrity, ".blob");
+  return cache_write(p, cache_dir, path, integrity, data, datalen);
+}
+
+const char *urlconf_cache_get_etag(pool *p, const char *cache_dir,
+    const char *url) {
+  const char *path;
+  char *etag = NULL;
+  size_t etaglen = 0;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      url == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  path = cache_path(p, cache_dir, url, ".etag");
+  if (cache_read(p, cache_dir, path, url, FALSE, 0, &etag, &etaglen) < 0) {
+    return NULL;
+  }
+
+  if (etaglen == 0) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  return etag;
+}
+
+int urlconf_cache_put_etag(pool *p, const char *cache_dir, const char *url,
+    const char *etag) {
+  const char *path;
+
+  if (p == NULL ||
+      cache_dir == NULL ||
+      url == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  path = cache_path(p, cache_dir, url, ".etag");
+
+  /* A response without an ETag supersedes any previous ETag. */
+  if (etag == NULL) {
+    if (unlink(path) < 0 &&
+        errno != ENOENT) {
+      return -1;
+    }
+
+    return 0;
+  }
+
+  return cache_write(p, cache_dir, path, url, etag, strlen(etag));
+}
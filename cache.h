@@ -0,0 +1,81 @@
+/*
+ * ProFTPD - mod_conf_url shared cache
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_CACHE_H
+#define MOD_CONF_URL_CACHE_H
+
+/* Default number of seconds for which a cached response is considered
+ * fresh.
+ */
+#define URLCONF_CACHE_DEFAULT_TTL	30UL
+
+/* Obtains the lock for the given URL in the given cache directory, waiting
+ * for any other process which currently holds that lock.  Returns the fd
+ * of the lock file on success, or -1 (with errno set) on error.
+ */
+int urlconf_cache_lock(pool *p, const char *cache_dir, const char *url);
+int urlconf_cache_unlock(int lockfd);
+
+/* Reads the cached response for the URL, if present and not older than the
+ * given TTL.  Returns -1 with errno set to ENOENT if there is no such fresh
+ * cached response.  The caller should hold the lock for the URL.
+ */
+int urlconf_cache_get(pool *p, const char *cache_dir, const char *url,
+  unsigned long ttl, char **data, size_t *datalen);
+
+/* Publishes the given response data for the URL, atomically replacing any
+ * existing cached response.  The caller should hold the lock for the URL.
+ */
+int urlconf_cache_put(pool *p, const char *cache_dir, const char *url,
+  const char *data, size_t datalen);
+
+/* Reads the stored response with the given integrity metadata (e.g.
+ * "sha256-<digest>"), if present.  Stored responses do not expire; the
+ * caller is expected to check them against the metadata.  Returns -1 with
+ * errno set to ENOENT if there is no such stored response.
+ */
+int urlconf_cache_get_blob(pool *p, const char *cache_dir,
+  const char *integrity, char **data, size_t *datalen);
+
+/* Stores the given response, having been checked against the given
+ * integrity metadata.
+ */
+int urlconf_cache_put_blob(pool *p, const char *cache_dir,
+  const char *integrity, const char *data, size_t datalen);
+
+/* Reads the ETag of the cached response for the given URL, if known.
+ * Returns NULL with errno set to ENOENT if it is not.
+ */
+const char *urlconf_cache_get_etag(pool *p, const char *cache_dir,
+  const char *url);
+
+/* Records the ETag of the cached response for the given URL, e.g. for
+ * requesting deltas against that response.
+ */
+int urlconf_cache_put_etag(pool *p, const char *cache_dir, const char *url,
+  const char *etag);
+
+#endif /* MOD_CONF_URL_CACHE_H */
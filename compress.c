@@ -0,0 +1,225 @@
+/*
+ * ProFTPD - mod_conf_url body compression implementation
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "compress.h"
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+# include <zlib.h>
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+
+static const char *trace_channel = "conf_url";
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+/* zlib allocates its inflate state, and window, from the pool of the read
+ * which uses it; these are released with that pool, even if the read is
+ * not finished.
+ */
+static voidpf compress_zalloc(voidpf opaque, uInt items, uInt size) {
+  return palloc((pool *) opaque, (size_t) items * size);
+}
+
+static void compress_zfree(voidpf opaque, voidpf ptr) {
+  (void) opaque;
+  (void) ptr;
+}
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+
+int urlconf_compress_available(void) {
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  return TRUE;
+#else
+  return FALSE;
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+}
+
+int urlconf_compress_data(pool *p, const char *data, size_t datalen,
+    char **zdata, size_t *zdatalen) {
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  pool *tmp_pool;
+  Bytef *buf;
+  uLongf buflen;
+  int res;
+
+  if (p == NULL ||
+      data == NULL ||
+      zdata == NULL ||
+      zdatalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Compress into a scratch buffer of the worst-case size, then keep only
+   * as much as is needed.
+   */
+  tmp_pool = make_sub_pool(p);
+  buflen = compressBound((uLong) datalen);
+  buf = palloc(tmp_pool, buflen);
+
+  res = compress2(buf, &buflen, (const Bytef *) data, (uLong) datalen,
+    Z_BEST_SPEED);
+  if (res != Z_OK) {
+    pr_trace_msg(trace_channel, 3, "error compressing %lu bytes: %s",
+      (unsigned long) datalen, zError(res));
+    destroy_pool(tmp_pool);
+
+    errno = res == Z_MEM_ERROR ? ENOMEM : EINVAL;
+    return -1;
+  }
+
+  if ((size_t) buflen >= datalen) {
+    destroy_pool(tmp_pool);
+
+    errno = EFBIG;
+    return -1;
+  }
+
+  *zdata = palloc(p, buflen);
+  memcpy(*zdata, buf, buflen);
+  *zdatalen = buflen;
+  destroy_pool(tmp_pool);
+
+  pr_trace_msg(trace_channel, 17, "compressed %lu bytes to %lu bytes",
+    (unsigned long) datalen, (unsigned long) *zdatalen);
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+}
+
+void *urlconf_compress_inflate_open(pool *p, const char *zdata,
+    size_t zdatalen) {
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  z_stream *strm;
+  int res;
+
+  if (p == NULL ||
+      zdata == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  strm = pcalloc(p, sizeof(z_stream));
+  strm->zalloc = compress_zalloc;
+  strm->zfree = compress_zfree;
+  strm->opaque = p;
+  strm->next_in = (Bytef *) zdata;
+  strm->avail_in = (uInt) zdatalen;
+
+  res = inflateInit(strm);
+  if (res != Z_OK) {
+    pr_trace_msg(trace_channel, 3, "error initializing inflate stream: %s",
+      strm->msg ? strm->msg : zError(res));
+
+    errno = res == Z_MEM_ERROR ? ENOMEM : EINVAL;
+    return NULL;
+  }
+
+  return strm;
+#else
+  errno = ENOSYS;
+  return NULL;
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+}
+
+int urlconf_compress_inflate_read(void *zh, char *buf, size_t buflen) {
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  z_stream *strm;
+  int res;
+
+  if (zh == NULL ||
+      buf == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  strm = zh;
+  strm->next_out = (Bytef *) buf;
+  strm->avail_out = (uInt) buflen;
+
+  res = inflate(strm, Z_NO_FLUSH);
+  switch (res) {
+    case Z_OK:
+    case Z_STREAM_END:
+      break;
+
+    case Z_BUF_ERROR:
+      /* No progress possible, i.e. all of the data have been inflated. */
+      if (strm->avail_in == 0) {
+        break;
+      }
+
+      /* Fall through */
+
+    default:
+      pr_trace_msg(trace_channel, 3, "error inflating data: %s",
+        strm->msg ? strm->msg : zError(res));
+      errno = EIO;
+      return -1;
+  }
+
+  return (int) (buflen - strm->avail_out);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+}
+
+int urlconf_compress_inflate_data(pool *p, const char *zdata,
+    size_t zdatalen, char **data, size_t datalen) {
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+  char *buf;
+  uLongf buflen;
+  int res;
+
+  if (p == NULL ||
+      zdata == NULL ||
+      data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  buf = palloc(p, datalen + 1);
+  buflen = (uLongf) datalen;
+
+  res = uncompress((Bytef *) buf, &buflen, (const Bytef *) zdata,
+    (uLong) zdatalen);
+  if (res != Z_OK ||
+      (size_t) buflen != datalen) {
+    pr_trace_msg(trace_channel, 3, "error inflating %lu bytes: %s",
+      (unsigned long) zdatalen, res != Z_OK ? zError(res) : "wrong length");
+    errno = EIO;
+    return -1;
+  }
+
+  buf[datalen] = '\0';
+  *data = buf;
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* HAVE_ZLIB_H and HAVE_LIBZ */
+}
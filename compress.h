@@ -0,0 +1,59 @@
+/*
+ * ProFTPD - mod_conf_url body compression
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_COMPRESS_H
+#define MOD_CONF_URL_COMPRESS_H
+
+/* Returns TRUE if bodies can be compressed, i.e. if built with zlib. */
+int urlconf_compress_available(void);
+
+/* Compresses the given data, using a fast zlib level, into an exactly-sized
+ * buffer allocated from the given pool.  Returns -1 with errno set to
+ * EFBIG if the data do not compress, or ENOSYS if built without zlib.
+ */
+int urlconf_compress_data(pool *p, const char *data, size_t datalen,
+  char **zdata, size_t *zdatalen);
+
+/* Returns a handle for incrementally inflating the given compressed data,
+ * with all of its state allocated from the given pool.
+ */
+void *urlconf_compress_inflate_open(pool *p, const char *zdata,
+  size_t zdatalen);
+
+/* Inflates the next data, up to the given buffer length, returning the
+ * number of bytes inflated; zero once all of the data have been inflated.
+ * Returns -1 with errno set to EIO if the compressed data are corrupt.
+ */
+int urlconf_compress_inflate_read(void *zh, char *buf, size_t buflen);
+
+/* Inflates all of the given compressed data, whose inflated length is
+ * known, into a NUL-terminated buffer allocated from the given pool.
+ */
+int urlconf_compress_inflate_data(pool *p, const char *zdata,
+  size_t zdatalen, char **data, size_t datalen);
+
+#endif /* MOD_CONF_URL_COMPRESS_H */
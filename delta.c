@@ -0,0 +1,299 @@
+/*
+ * ProFTPD - mod_conf_url delta encoding
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "delta.h"
+#include "integrity.h"
+
+/* A line of content, including its terminating newline, if any. */
+struct delta_line {
+  const char *ptr;
+  size_t len;
+};
+
+static const char *trace_channel = "conf_url";
+
+/* Splits the text into lines. */
+static array_header *delta_get_lines(pool *p, const char *text,
+    size_t textlen) {
+  array_header *lines;
+  const char *ptr, *end;
+
+  lines = make_array(p, 0, sizeof(struct delta_line));
+
+  ptr = text;
+  end = text + textlen;
+  while (ptr < end) {
+    struct delta_line *line;
+    const char *eol;
+
+    eol = memchr(ptr, '\n', end - ptr);
+    eol = eol != NULL ? eol + 1 : end;
+
+    line = push_array(lines);
+    line->ptr = ptr;
+    line->len = eol - ptr;
+
+    ptr = eol;
+  }
+
+  return lines;
+}
+
+/* Replaces count lines, starting at the given (zero-based) index, with the
+ * given lines.
+ */
+static void delta_splice(array_header *lines, unsigned int idx,
+    unsigned int count, array_header *insert) {
+  struct delta_line *elts;
+  unsigned int nelts, ninsert;
+
+  nelts = lines->nelts;
+  ninsert = insert != NULL ? insert->nelts : 0;
+
+  /* Grow the array, if need be, for the lines to be inserted. */
+  while (lines->nelts < nelts - count + ninsert) {
+    (void) push_array(lines);
+  }
+
+  elts = lines->elts;
+  memmove(&elts[idx + ninsert], &elts[idx + count],
+    (nelts - idx - count) * sizeof(struct delta_line));
+
+  if (ninsert > 0) {
+    memcpy(&elts[idx], insert->elts, ninsert * sizeof(struct delta_line));
+  }
+
+  lines->nelts = nelts - count + ninsert;
+}
+
+/* Applies an ed script, as produced by "diff -e", whose commands address the
+ * lines of the base in descending order, so that each command can be applied
+ * in turn.  Only the "a", "c", and "d" commands are used by such scripts.
+ */
+static int delta_apply_diffe(pool *p, const char *base, size_t baselen,
+    const char *delta, size_t deltalen, char **data, size_t *datalen) {
+  register unsigned int i;
+  array_header *lines, *script;
+  struct delta_line *cmds;
+  unsigned int idx = 0;
+  size_t len = 0;
+  char *buf, *ptr;
+
+  lines = delta_get_lines(p, base, baselen);
+  script = delta_get_lines(p, delta, deltalen);
+  cmds = script->elts;
+
+  while (idx < script->nelts) {
+    char cmd, *endp = NULL;
+    const char *text;
+    unsigned long start, end;
+    array_header *insert = NULL;
+
+    text = cmds[idx].ptr;
+    start = end = strtoul(text, &endp, 10);
+    if (endp == text) {
+      pr_trace_msg(trace_channel, 3, "malformed delta command '%.*s'",
+        (int) cmds[idx].len, text);
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (*endp == ',') {
+      text = endp + 1;
+      end = strtoul(text, &endp, 10);
+      if (endp == text) {
+        errno = EINVAL;
+        return -1;
+      }
+    }
+
+    cmd = *endp++;
+    if (*endp != '\n' ||
+        end < start) {
+      pr_trace_msg(trace_channel, 3, "malformed delta command '%.*s'",
+        (int) cmds[idx].len, cmds[idx].ptr);
+      errno = EINVAL;
+      return -1;
+    }
+
+    idx++;
+
+    if (cmd == 'a' ||
+        cmd == 'c') {
+      /* The text to add follows, terminated by a line of only ".". */
+      insert = make_array(p, 0, sizeof(struct delta_line));
+
+      while (idx < script->nelts &&
+             !(cmds[idx].len == 2 && strncmp(cmds[idx].ptr, ".\n", 2) == 0)) {
+        *((struct delta_line *) push_array(insert)) = cmds[idx];
+        idx++;
+      }
+
+      if (idx == script->nelts) {
+        pr_trace_msg(trace_channel, 3, "delta text not terminated");
+        errno = EINVAL;
+        return -1;
+      }
+
+      idx++;
+    }
+
+    switch (cmd) {
+      case 'a':
+        if (start != end ||
+            start > lines->nelts) {
+          errno = EINVAL;
+          return -1;
+        }
+
+        delta_splice(lines, start, 0, insert);
+        break;
+
+      case 'c':
+      case 'd':
+        if (start == 0 ||
+            end > lines->nelts) {
+          errno = EINVAL;
+          return -1;
+        }
+
+        delta_splice(lines, start - 1, end - start + 1, insert);
+        break;
+
+      default:
+        pr_trace_msg(trace_channel, 3, "unsupported delta command '%c'", cmd);
+        errno = EINVAL;
+        return -1;
+    }
+  }
+
+  for (i = 0; i < lines->nelts; i++) {
+    len += ((struct delta_line *) lines->elts)[i].len;
+  }
+
+  buf = ptr = palloc(p, len + 1);
+  for (i = 0; i < lines->nelts; i++) {
+    struct delta_line *line;
+
+    line = &((struct delta_line *) lines->elts)[i];
+    memcpy(ptr, line->ptr, line->len);
+    ptr += line->len;
+  }
+  *ptr = '\0';
+
+  *data = buf;
+  *datalen = len;
+  return 0;
+}
+
+int urlconf_delta_apply(pool *p, const char *im, const char *base,
+    size_t baselen, const char *delta, size_t deltalen, char **data,
+    size_t *datalen) {
+  int res;
+
+  if (p == NULL ||
+      im == NULL ||
+      base == NULL ||
+      delta == NULL ||
+      data == NULL ||
+      datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (strcasecmp(im, URLCONF_DELTA_IM_DIFFE) != 0) {
+    pr_trace_msg(trace_channel, 3, "unsupported instance manipulation '%s'",
+      im);
+    errno = ENOSYS;
+    return -1;
+  }
+
+  res = delta_apply_diffe(p, base, baselen, delta, deltalen, data, datalen);
+  if (res == 0) {
+    pr_trace_msg(trace_channel, 12, "applied %lu byte delta to %lu bytes, "
+      "yielding %lu bytes", (unsigned long) deltalen, (unsigned long) baselen,
+      (unsigned long) *datalen);
+  }
+
+  return res;
+}
+
+int urlconf_delta_check_digest(pool *p, const char *digest, const char *data,
+    size_t datalen) {
+  char *digests, *ptr, *integrity = NULL;
+
+  if (p == NULL ||
+      digest == NULL ||
+      data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Rewrite the instance digests as integrity metadata, i.e. from e.g.
+   * "SHA-256=<digest>, SHA-512=<digest>" to
+   * "sha256-<digest> sha512-<digest>".
+   */
+  digests = pstrdup(p, digest);
+  ptr = strtok(digests, ",");
+  while (ptr != NULL) {
+    const char *algo = NULL;
+    char *value;
+
+    while (PR_ISSPACE(*ptr)) {
+      ptr++;
+    }
+
+    value = strchr(ptr, '=');
+    if (value != NULL) {
+      *value++ = '\0';
+
+      if (strcasecmp(ptr, "SHA-256") == 0) {
+        algo = "sha256";
+
+      } else if (strcasecmp(ptr, "SHA-384") == 0) {
+        algo = "sha384";
+
+      } else if (strcasecmp(ptr, "SHA-512") == 0) {
+        algo = "sha512";
+      }
+    }
+
+    if (algo != NULL) {
+      integrity = pstrcat(p, integrity != NULL ? integrity : "",
+        integrity != NULL ? " " : "", algo, "-", value, NULL);
+    }
+
+    ptr = strtok(NULL, ",");
+  }
+
+  if (integrity == NULL) {
+    pr_trace_msg(trace_channel, 3, "no supported digest in '%s'", digest);
+    errno = EINVAL;
+    return -1;
+  }
+
+  return urlconf_integrity_check(p, integrity, data, datalen);
+}
@@ -0,0 +1,53 @@
+/*
+ * ProFTPD - mod_conf_url delta encoding
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_DELTA_H
+#define MOD_CONF_URL_DELTA_H
+
+/* The instance manipulations (see RFC 3229) which we can apply, for the
+ * A-IM request header.
+ */
+#define URLCONF_DELTA_IM_DIFFE		"diffe"
+
+/* Applies the given delta, using the given instance manipulation (as named
+ * by the IM response header), to the base content, yielding the new content.
+ * Returns -1 with errno set to ENOSYS for unsupported manipulations, or
+ * EINVAL for malformed deltas, or deltas which do not fit the base.
+ */
+int urlconf_delta_apply(pool *p, const char *im, const char *base,
+  size_t baselen, const char *delta, size_t deltalen, char **data,
+  size_t *datalen);
+
+/* Checks the given content against the instance digests of a Digest response
+ * header (see RFC 3230), e.g. "SHA-256=<base64 digest>".  Returns -1 with
+ * errno set to EACCES if they do not match, or EINVAL if no supported
+ * digest is given.
+ */
+int urlconf_delta_check_digest(pool *p, const char *digest, const char *data,
+  size_t datalen);
+
+#endif /* MOD_CONF_URL_DELTA_H */
@@ -0,0 +1,636 @@
+/*
+ * ProFTPD - mod_conf_url fleet cache implementation
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "fleet.h"
+#include "utils.h"
+
+/* How long to wait, in millisecs, for the fleet cache server to accept a
+ * connection, or to answer a request.  The fleet cache is meant to be
+ * nearby; a slow cache is worse than none.
+ */
+#define FLEET_TIMEOUT_MSECS		250
+
+/* The largest value we will read from the fleet cache; memcached's default
+ * item size limit is 1 MB.
+ */
+#define FLEET_MAX_VALUE_SIZE		(16 * 1024 * 1024)
+
+static const char *trace_channel = "conf_url";
+
+static pool *fleet_parent_pool = NULL;
+static pool *fleet_pool = NULL;
+static const char *fleet_server = NULL;
+static int fleet_fd = -1;
+
+/* Set once the fleet cache has failed, so that we do not wait on it again
+ * for each remaining URL.
+ */
+static int fleet_down = FALSE;
+
+/* Buffered responses from the fleet cache server. */
+static char fleet_rbuf[4096];
+static size_t fleet_rpos = 0, fleet_rlen = 0;
+
+/* Entries use the memcached text protocol.  Keys are hashes of the given
+ * key (e.g. a URL), as memcached keys are limited in length and may not
+ * contain spaces.  Values are the given key, a newline, then the data; the
+ * key is checked when reading, lest a hash collision yield the wrong data.
+ * While a node fills the cache for a key, it holds a "fill" entry for that
+ * key, so that other nodes wait for it, rather than also asking the origin.
+ */
+static const char *fleet_key(pool *p, const char *type, const char *key) {
+  return pstrcat(p, "urlconf-", type, ":", urlconf_utils_hash_key(p, key),
+    NULL);
+}
+
+static void fleet_close(void) {
+  if (fleet_fd >= 0) {
+    (void) close(fleet_fd);
+    fleet_fd = -1;
+  }
+
+  fleet_rpos = fleet_rlen = 0;
+}
+
+static int fleet_fail(const char *what, int xerrno) {
+  pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+    ": fleet cache '%s' %s: %s; not using it for the rest of the parse",
+    fleet_server, what, strerror(xerrno));
+
+  fleet_close();
+  fleet_down = TRUE;
+
+  errno = xerrno;
+  return -1;
+}
+
+static int fleet_wait(int fd, int for_write) {
+  fd_set fds;
+  struct timeval tv;
+  int res;
+
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+
+  tv.tv_sec = 0;
+  tv.tv_usec = FLEET_TIMEOUT_MSECS * 1000;
+
+  res = select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+    NULL, &tv);
+  while (res < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+
+    pr_signals_handle();
+    res = select(fd + 1, for_write ? NULL : &fds, for_write ? &fds : NULL,
+      NULL, &tv);
+  }
+
+  if (res == 0) {
+    errno = ETIMEDOUT;
+    return -1;
+  }
+
+  return 0;
+}
+
+static int fleet_connect(pool *p) {
+  struct addrinfo hints, *addrs = NULL, *addr;
+  char *host, *port, *ptr;
+  int res, xerrno = ECONNREFUSED;
+
+  if (fleet_fd >= 0) {
+    return 0;
+  }
+
+  host = pstrdup(p, fleet_server);
+  ptr = strrchr(host, ':');
+  if (ptr == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *ptr = '\0';
+  port = ptr + 1;
+
+  /* Handle IPv6 addresses, e.g. "[::1]:11211". */
+  if (*host == '[' &&
+      host[strlen(host)-1] == ']') {
+    host[strlen(host)-1] = '\0';
+    host++;
+  }
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV;
+
+  res = getaddrinfo(host, port, &hints, &addrs);
+  if (res != 0) {
+    pr_trace_msg(trace_channel, 3, "error resolving fleet cache '%s': %s",
+      fleet_server, gai_strerror(res));
+    errno = ESRCH;
+    return -1;
+  }
+
+  for (addr = addrs; addr != NULL; addr = addr->ai_next) {
+    int fd, flags, sock_errno = 0;
+    socklen_t errlen = sizeof(sock_errno);
+
+    fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (fd < 0) {
+      xerrno = errno;
+      continue;
+    }
+
+    flags = fcntl(fd, F_GETFL);
+    (void) fcntl(fd, F_SETFL, flags|O_NONBLOCK);
+
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) < 0) {
+      if (errno != EINPROGRESS) {
+        xerrno = errno;
+        (void) close(fd);
+        continue;
+      }
+
+      if (fleet_wait(fd, TRUE) < 0 ||
+          getsockopt(fd, SOL_SOCKET, SO_ERROR, &sock_errno, &errlen) < 0 ||
+          sock_errno != 0) {
+        xerrno = sock_errno != 0 ? sock_errno : errno;
+        (void) close(fd);
+        continue;
+      }
+    }
+
+    fleet_fd = fd;
+    break;
+  }
+
+  freeaddrinfo(addrs);
+
+  if (fleet_fd < 0) {
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "connected to fleet cache '%s'",
+    fleet_server);
+  fleet_rpos = fleet_rlen = 0;
+  return 0;
+}
+
+static int fleet_send(const char *buf, size_t buflen) {
+  size_t sent = 0;
+
+  while (sent < buflen) {
+    ssize_t res;
+
+    res = write(fleet_fd, buf + sent, buflen - sent);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (errno == EAGAIN) {
+        if (fleet_wait(fleet_fd, TRUE) < 0) {
+          return -1;
+        }
+
+        continue;
+      }
+
+      return -1;
+    }
+
+    sent += res;
+  }
+
+  return 0;
+}
+
+static int fleet_fill(void) {
+  ssize_t res;
+
+  if (fleet_rpos > 0) {
+    memmove(fleet_rbuf, fleet_rbuf + fleet_rpos, fleet_rlen - fleet_rpos);
+    fleet_rlen -= fleet_rpos;
+    fleet_rpos = 0;
+  }
+
+  if (fleet_rlen == sizeof(fleet_rbuf)) {
+    errno = EPROTO;
+    return -1;
+  }
+
+  while (TRUE) {
+    if (fleet_wait(fleet_fd, FALSE) < 0) {
+      return -1;
+    }
+
+    res = read(fleet_fd, fleet_rbuf + fleet_rlen,
+      sizeof(fleet_rbuf) - fleet_rlen);
+    if (res < 0) {
+      if (errno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      if (errno == EAGAIN) {
+        continue;
+      }
+
+      return -1;
+    }
+
+    break;
+  }
+
+  if (res == 0) {
+    errno = ECONNRESET;
+    return -1;
+  }
+
+  fleet_rlen += res;
+  return 0;
+}
+
+/* Reads a response line, without its CRLF. */
+static char *fleet_read_line(pool *p) {
+  while (TRUE) {
+    char *crlf;
+
+    crlf = memchr(fleet_rbuf + fleet_rpos, '\n', fleet_rlen - fleet_rpos);
+    if (crlf != NULL) {
+      char *line;
+      size_t linelen;
+
+      linelen = crlf - (fleet_rbuf + fleet_rpos);
+      line = pstrndup(p, fleet_rbuf + fleet_rpos, linelen);
+      if (linelen > 0 &&
+          line[linelen-1] == '\r') {
+        line[linelen-1] = '\0';
+      }
+
+      fleet_rpos += linelen + 1;
+      return line;
+    }
+
+    if (fleet_fill() < 0) {
+      return NULL;
+    }
+  }
+}
+
+static int fleet_read_data(char *buf, size_t buflen) {
+  size_t nread = 0;
+
+  while (nread < buflen) {
+    size_t len;
+
+    if (fleet_rpos == fleet_rlen &&
+        fleet_fill() < 0) {
+      return -1;
+    }
+
+    len = fleet_rlen - fleet_rpos;
+    if (len > buflen - nread) {
+      len = buflen - nread;
+    }
+
+    memcpy(buf + nread, fleet_rbuf + fleet_rpos, len);
+    fleet_rpos += len;
+    nread += len;
+  }
+
+  return 0;
+}
+
+/* Sends the given request, returning the first line of the response. */
+static char *fleet_request(pool *p, const char *req, const char *data,
+    size_t datalen, const char *what) {
+  char *resp;
+
+  if (fleet_server == NULL ||
+      fleet_down == TRUE) {
+    errno = ENOSYS;
+    return NULL;
+  }
+
+  if (fleet_connect(p) < 0) {
+    fleet_fail("unavailable", errno);
+    return NULL;
+  }
+
+  if (fleet_send(req, strlen(req)) < 0 ||
+      (data != NULL &&
+       (fleet_send(data, datalen) < 0 ||
+        fleet_send("\r\n", 2) < 0))) {
+    fleet_fail(what, errno);
+    return NULL;
+  }
+
+  resp = fleet_read_line(p);
+  if (resp == NULL) {
+    fleet_fail(what, errno);
+    return NULL;
+  }
+
+  if (strcmp(resp, "ERROR") == 0 ||
+      strncmp(resp, "CLIENT_ERROR", 12) == 0) {
+    pr_trace_msg(trace_channel, 3, "fleet cache '%s' %s error: %s",
+      fleet_server, what, resp);
+    fleet_fail(what, EPROTO);
+    return NULL;
+  }
+
+  return resp;
+}
+
+int urlconf_fleet_get(pool *p, const char *key, char **data,
+    size_t *datalen) {
+  const char *req;
+  char *resp, *ptr, *value, *trailer;
+  unsigned long valuelen = 0;
+  size_t keylen;
+
+  if (p == NULL ||
+      key == NULL ||
+      data == NULL ||
+      datalen == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  req = pstrcat(p, "get ", fleet_key(p, "data", key), "\r\n", NULL);
+  resp = fleet_request(p, req, NULL, 0, "get");
+  if (resp == NULL) {
+    return -1;
+  }
+
+  if (strcmp(resp, "END") == 0) {
+    pr_trace_msg(trace_channel, 17, "no fleet cache entry for '%s'", key);
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* Expect "VALUE <key> <flags> <bytes>". */
+  ptr = strrchr(resp, ' ');
+  if (ptr != NULL) {
+    char *endp = NULL;
+
+    valuelen = strtoul(ptr + 1, &endp, 10);
+    if (endp == NULL ||
+        *endp != '\0' ||
+        endp == ptr + 1) {
+      ptr = NULL;
+    }
+  }
+
+  if (strncmp(resp, "VALUE ", 6) != 0 ||
+      ptr == NULL ||
+      valuelen > FLEET_MAX_VALUE_SIZE) {
+    pr_trace_msg(trace_channel, 3, "unexpected fleet cache response: %s",
+      resp);
+    return fleet_fail("get", EPROTO);
+  }
+
+  value = palloc(p, valuelen + 1);
+  trailer = palloc(p, 2);
+  if (fleet_read_data(value, valuelen) < 0 ||
+      fleet_read_data(trailer, 2) < 0) {
+    return fleet_fail("get", errno);
+  }
+  value[valuelen] = '\0';
+
+  resp = fleet_read_line(p);
+  if (resp == NULL ||
+      strcmp(resp, "END") != 0) {
+    return fleet_fail("get", resp == NULL ? errno : EPROTO);
+  }
+
+  keylen = strlen(key);
+  if (valuelen < keylen + 1 ||
+      strncmp(value, key, keylen) != 0 ||
+      value[keylen] != '\n') {
+    pr_trace_msg(trace_channel, 3,
+      "fleet cache entry for '%s' is for a different key, ignoring", key);
+    errno = ENOENT;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "using fleet cache entry (%lu bytes) "
+    "for '%s'", valuelen - (keylen + 1), key);
+
+  *data = value + keylen + 1;
+  *datalen = valuelen - (keylen + 1);
+  return 0;
+}
+
+int urlconf_fleet_put(pool *p, const char *key, const char *data,
+    size_t datalen, unsigned long ttl) {
+  char *req, text[64];
+  const char *value_key;
+  char *resp;
+  size_t keylen;
+
+  if (p == NULL ||
+      key == NULL ||
+      data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  keylen = strlen(key);
+
+  memset(text, '\0', sizeof(text));
+  snprintf(text, sizeof(text)-1, " 0 %lu %lu\r\n", ttl,
+    (unsigned long) (keylen + 1 + datalen));
+
+  /* The value starts with the key, then a newline; send these as part of
+   * the request line, rather than copying the data.
+   */
+  value_key = pstrcat(p, key, "\n", NULL);
+  req = pstrcat(p, "set ", fleet_key(p, "data", key), text, value_key, NULL);
+
+  resp = fleet_request(p, req, data, datalen, "set");
+  if (resp == NULL) {
+    return -1;
+  }
+
+  if (strcmp(resp, "STORED") != 0) {
+    /* E.g. the response is larger than the server's item size limit. */
+    pr_trace_msg(trace_channel, 3, "fleet cache did not store '%s': %s",
+      key, resp);
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "published fleet cache entry (%lu bytes) "
+    "for '%s'", (unsigned long) datalen, key);
+  return 0;
+}
+
+int urlconf_fleet_delete(pool *p, const char *key) {
+  char *req, *resp;
+
+  if (p == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  req = pstrcat(p, "delete ", fleet_key(p, "data", key), "\r\n", NULL);
+  resp = fleet_request(p, req, NULL, 0, "delete");
+  if (resp == NULL) {
+    return -1;
+  }
+
+  if (strcmp(resp, "DELETED") != 0 &&
+      strcmp(resp, "NOT_FOUND") != 0) {
+    pr_trace_msg(trace_channel, 3, "fleet cache did not delete '%s': %s",
+      key, resp);
+    errno = EPERM;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 15, "deleted fleet cache entry for '%s'", key);
+  return 0;
+}
+
+int urlconf_fleet_claim(pool *p, const char *key, unsigned long ttl) {
+  char *req, text[64];
+  char *resp;
+
+  if (p == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(text, '\0', sizeof(text));
+  snprintf(text, sizeof(text)-1, " 0 %lu 1\r\n", ttl);
+
+  req = pstrcat(p, "add ", fleet_key(p, "fill", key), text, NULL);
+  resp = fleet_request(p, req, "1", 1, "claim");
+  if (resp == NULL) {
+    return -1;
+  }
+
+  if (strcmp(resp, "NOT_STORED") == 0) {
+    pr_trace_msg(trace_channel, 17,
+      "another node is filling fleet cache entry for '%s'", key);
+    errno = EEXIST;
+    return -1;
+  }
+
+  if (strcmp(resp, "STORED") != 0) {
+    errno = EPERM;
+    return -1;
+  }
+
+  return 0;
+}
+
+int urlconf_fleet_release(pool *p, const char *key) {
+  char *req;
+
+  if (p == NULL ||
+      key == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  req = pstrcat(p, "delete ", fleet_key(p, "fill", key), "\r\n", NULL);
+  if (fleet_request(p, req, NULL, 0, "release") == NULL) {
+    return -1;
+  }
+
+  return 0;
+}
+
+int urlconf_fleet_set_server(const char *server) {
+  if (fleet_parent_pool == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  fleet_down = FALSE;
+
+  /* Keep the connection, should the server be the same. */
+  if (server != NULL &&
+      fleet_server != NULL &&
+      strcmp(server, fleet_server) == 0) {
+    return 0;
+  }
+
+  fleet_close();
+  if (fleet_pool != NULL) {
+    destroy_pool(fleet_pool);
+    fleet_pool = NULL;
+  }
+  fleet_server = NULL;
+
+  if (server == NULL) {
+    return 0;
+  }
+
+  fleet_pool = make_sub_pool(fleet_parent_pool);
+  pr_pool_tag(fleet_pool, "URL Configuration Fleet Cache Pool");
+  fleet_server = pstrdup(fleet_pool, server);
+
+  return 0;
+}
+
+int urlconf_fleet_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fleet_parent_pool = p;
+  fleet_pool = NULL;
+  fleet_server = NULL;
+  fleet_fd = -1;
+  fleet_down = FALSE;
+  fleet_rpos = fleet_rlen = 0;
+  return 0;
+}
+
+int urlconf_fleet_free(void) {
+  fleet_close();
+
+  if (fleet_pool != NULL) {
+    destroy_pool(fleet_pool);
+    fleet_pool = NULL;
+  }
+
+  fleet_parent_pool = NULL;
+  fleet_server = NULL;
+  fleet_down = FALSE;
+  return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * ProFTPD - mod_conf_url fleet cache
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_FLEET_H
+#define MOD_CONF_URL_FLEET_H
+
+/* Sets the memcached-protocol server ("host:port") to use as the fleet
+ * cache, shared by nearby nodes, for the rest of the configuration parse;
+ * NULL to stop using it.
+ */
+int urlconf_fleet_set_server(const char *server);
+
+/* Reads the cached response for the given key (e.g. a URL).  Returns -1
+ * with errno set to ENOENT if there is no such cached response.  After any
+ * other error (e.g. a timeout), the fleet cache is not used again until
+ * the next urlconf_fleet_set_server() call.
+ */
+int urlconf_fleet_get(pool *p, const char *key, char **data,
+  size_t *datalen);
+
+/* Publishes the given response data for the key, for the given number of
+ * seconds; zero for no expiry.
+ */
+int urlconf_fleet_put(pool *p, const char *key, const char *data,
+  size_t datalen, unsigned long ttl);
+
+/* Removes the cached response for the key, e.g. once found to be bad. */
+int urlconf_fleet_delete(pool *p, const char *key);
+
+/* Claims the filling of the cache for the key, for at most the given number
+ * of seconds.  Returns -1 with errno set to EEXIST if another node has
+ * claimed it already.
+ */
+int urlconf_fleet_claim(pool *p, const char *key, unsigned long ttl);
+int urlconf_fleet_release(pool *p, const char *key);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_fleet_init(pool *p);
+int urlconf_fleet_free(void);
+
+#endif /* MOD_CONF_URL_FLEET_H */
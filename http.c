@@ -24,6 +24,7 @@
 
 #include "mod_conf_url.h"
 #include "http.h"
+#include "tls.h"
 #include "utils.h"
 
 #ifdef HAVE_CURL_CURL_H
@@ -36,8 +37,37 @@ static CURLSH *curl_share = NULL;
 static char *http_resp_msg = NULL;
 static pool *http_resp_pool = NULL;
 
+/* DNS settings */
+static struct curl_slist *http_resolve_list = NULL;
+static long http_ip_resolve = CURL_IPRESOLVE_WHATEVER;
+static long http_dns_cache_ttl = -1;
+
+/* Feature flags, as determined at init time. */
+static unsigned long http_feature_flags = 0UL;
+
+/* The timing of the most recent transfer done by http_perform(). */
+static struct urlconf_http_timing http_last_timing;
+
+/* The trace level at which libcurl's debug data are logged, and how often
+ * to log the chunks of response data received.
+ */
+#define HTTP_TRACE_DEBUG_LEVEL		15
+#define HTTP_TRACE_DATA_IN_SAMPLE	64
+static unsigned long http_data_in_chunks = 0;
+
 static const char *trace_channel = "conf_url";
 
+/* Collects response headers, for requests which want them. */
+struct http_headers_data {
+  pool *pool;
+  pr_table_t *headers;
+};
+
+static int http_curl_errno(CURLcode curl_code);
+static struct curl_slist *http_headers_slist(pool *p, pr_table_t *headers);
+static int http_interrupted(void);
+static void http_set_trace_opts(CURL *curl);
+
 pr_table_t *urlconf_http_default_headers(pool *p) {
   pr_table_t *http_headers;
 
@@ -56,6 +86,100 @@ pr_table_t *urlconf_http_default_headers(pool *p) {
   return http_headers;
 }
 
+/* Adds the timing of the transfer done by the given handle to the given
+ * timing.
+ */
+static void http_get_timing(CURL *curl, struct urlconf_http_timing *timing) {
+  double secs = 0.0, bytes = 0.0;
+  long num_connects = 0;
+
+  timing->transfers++;
+
+  if (curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &secs) == CURLE_OK) {
+    timing->namelookup_secs += secs;
+  }
+
+  if (curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &secs) == CURLE_OK) {
+    timing->connect_secs += secs;
+  }
+
+  if (curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME, &secs) == CURLE_OK) {
+    timing->appconnect_secs += secs;
+  }
+
+  if (curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &secs) ==
+      CURLE_OK) {
+    timing->starttransfer_secs += secs;
+  }
+
+  if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &secs) == CURLE_OK) {
+    timing->total_secs += secs;
+  }
+
+  if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &bytes) == CURLE_OK) {
+    timing->bytes += bytes;
+  }
+
+  /* A transfer which made no new connections reused a kept one. */
+  if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &num_connects) ==
+      CURLE_OK) {
+    timing->reused = (num_connects == 0);
+  }
+
+#if LIBCURL_VERSION_NUM >= 0x073200
+  /* CURLINFO_HTTP_VERSION was added in curl 7.50.0. */
+  if (curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION,
+      &(timing->http_version)) != CURLE_OK) {
+    timing->http_version = 0L;
+  }
+#endif /* curl-7.50.0 and later */
+}
+
+int urlconf_http_add_timing(struct urlconf_http_timing *timing) {
+  if (timing == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  timing->transfers += http_last_timing.transfers;
+  timing->namelookup_secs += http_last_timing.namelookup_secs;
+  timing->connect_secs += http_last_timing.connect_secs;
+  timing->appconnect_secs += http_last_timing.appconnect_secs;
+  timing->starttransfer_secs += http_last_timing.starttransfer_secs;
+  timing->total_secs += http_last_timing.total_secs;
+  timing->bytes += http_last_timing.bytes;
+  timing->reused = http_last_timing.reused;
+  timing->http_version = http_last_timing.http_version;
+
+  return 0;
+}
+
+const char *urlconf_http_version_text(long http_version) {
+  switch (http_version) {
+    case CURL_HTTP_VERSION_1_0:
+      return "1.0";
+
+    case CURL_HTTP_VERSION_1_1:
+      return "1.1";
+
+    case CURL_HTTP_VERSION_2_0:
+      return "2";
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+    /* CURL_HTTP_VERSION_3 is an enum value, first appearing in
+     * libcurl-7.66.0.
+     */
+    case CURL_HTTP_VERSION_3:
+      return "3";
+#endif /* libcurl-7.66.0 and later */
+
+    default:
+      break;
+  }
+
+  return NULL;
+}
+
 static void clear_http_response(void) {
   if (http_resp_pool != NULL) {
     destroy_pool(http_resp_pool);
@@ -64,6 +188,76 @@ static void clear_http_response(void) {
   http_resp_msg = NULL;
 }
 
+/* Returns the CURLOPT_HTTP_VERSION to use for the given flags.  HTTP/1.1
+ * remains the default; HTTP/2 and HTTP/3 are only used if requested, and if
+ * libcurl supports them.
+ */
+static long http_get_version(unsigned long flags) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+  /* CURL_HTTP_VERSION_3 first appeared in libcurl-7.66.0. */
+  if ((flags & URLCONF_FL_CURL_USE_HTTP3) &&
+      !(http_feature_flags & URLCONF_FL_CURL_NO_HTTP3)) {
+    /* Note that libcurl only uses HTTP/3 for HTTPS URLs, and falls back to
+     * HTTP/2 or HTTP/1.1 if the QUIC connection cannot be established.
+     */
+    return CURL_HTTP_VERSION_3;
+  }
+#endif /* libcurl-7.66.0 and later */
+
+#if LIBCURL_VERSION_NUM >= 0x072f00
+  /* CURL_HTTP_VERSION_2TLS first appeared in libcurl-7.47.0. */
+  if ((flags & (URLCONF_FL_CURL_USE_HTTP2|URLCONF_FL_CURL_USE_HTTP3)) &&
+      !(http_feature_flags & URLCONF_FL_CURL_NO_HTTP2)) {
+    return CURL_HTTP_VERSION_2TLS;
+  }
+#endif /* libcurl-7.47.0 and later */
+
+  return CURL_HTTP_VERSION_1_1;
+}
+
+/* Performs the request on the given handle.  Older versions of libcurl do
+ * not fall back from HTTP/3 themselves, so if the QUIC connection fails
+ * before any data are received, we retry the request once over HTTP/2 (or
+ * HTTP/1.1), and keep using that version for the handle.
+ */
+static CURLcode http_easy_perform(CURL *curl, const char *url) {
+  CURLcode curl_code;
+
+  curl_code = curl_easy_perform(curl);
+
+#if LIBCURL_VERSION_NUM >= 0x074200
+  /* CURLE_HTTP3 first appeared in libcurl-7.66.0. */
+  if (curl_code == CURLE_HTTP3
+# if LIBCURL_VERSION_NUM >= 0x074500
+      || curl_code == CURLE_QUIC_CONNECT_ERROR
+# endif /* libcurl-7.69.0 and later */
+      ) {
+    double rcvd_bytes = 0.0;
+    unsigned long flags = URLCONF_FL_CURL_USE_HTTP2;
+
+    if (curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD, &rcvd_bytes) !=
+          CURLE_OK ||
+        rcvd_bytes > 0.0) {
+      return curl_code;
+    }
+
+    pr_trace_msg(trace_channel, 3,
+      "HTTP/3 request for '%s' failed (%s), retrying without HTTP/3", url,
+      curl_easy_strerror(curl_code));
+
+    if (curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+        http_get_version(flags)) != CURLE_OK) {
+      return curl_code;
+    }
+
+    curl_errorbuf[0] = '\0';
+    curl_code = curl_easy_perform(curl);
+  }
+#endif /* libcurl-7.66.0 and later */
+
+  return curl_code;
+}
+
 static int http_perform(pool *p, CURL *curl, const char *url,
     pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
     void *user_data, long *resp_code, const char **content_type) {
@@ -96,16 +290,7 @@ static int http_perform(pool *p, CURL *curl, const char *url,
   }
 
   if (headers != NULL) {
-    register unsigned int i;
-    array_header *http_headers;
-    char **elts;
-
-    http_headers = urlconf_utils_table2array(p, headers);
-
-    elts = http_headers->elts;
-    for (i = 0; i < http_headers->nelts; i++) {
-      slist = curl_slist_append(slist, elts[i]);
-    }
+    slist = http_headers_slist(p, headers);
 
     curl_code = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
     if (curl_code != CURLE_OK) {
@@ -122,9 +307,25 @@ static int http_perform(pool *p, CURL *curl, const char *url,
   clear_http_response();
   http_resp_pool = make_sub_pool(p);
 
-  curl_code = curl_easy_perform(curl);
+  /* Handles may be reused after the trace level has changed. */
+  http_set_trace_opts(curl);
+
+  curl_code = http_easy_perform(curl, url);
+
+  memset(&http_last_timing, 0, sizeof(http_last_timing));
+  http_get_timing(curl, &http_last_timing);
+
+  if (curl_code == CURLE_OK &&
+      urlconf_http_version_text(http_last_timing.http_version) != NULL) {
+    pr_trace_msg(trace_channel, 9, "'%s' transferred using HTTP/%s", url,
+      urlconf_http_version_text(http_last_timing.http_version));
+  }
 
   if (slist != NULL) {
+    /* Handles may be reused, so make sure this one does not keep a pointer
+     * to the freed list.
+     */
+    (void) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL);
     curl_slist_free_all(slist);
   }
 
@@ -133,7 +334,12 @@ static int http_perform(pool *p, CURL *curl, const char *url,
     int xerrno = EPERM;
 
     error_len = strlen(curl_errorbuf);
-    if (error_len > 0) {
+    if (curl_code == CURLE_ABORTED_BY_CALLBACK) {
+      pr_trace_msg(trace_channel, 1,
+        "'%s' request interrupted by pending shutdown/restart", url);
+      xerrno = EINTR;
+
+    } else if (error_len > 0) {
       pr_trace_msg(trace_channel, 1,
         "'%s' request error: %s", url, curl_errorbuf);
 
@@ -153,9 +359,18 @@ static int http_perform(pool *p, CURL *curl, const char *url,
         /* Hit our connect timeout? */
         xerrno = ETIMEDOUT;
 
+      } else if (strstr(curl_errorbuf, "Connection refused") != NULL) {
+        xerrno = ECONNREFUSED;
+
       } else if (strstr(curl_errorbuf, "Couldn't open file") != NULL) {
         xerrno = ENOENT;
 
+      } else if (curl_code == CURLE_COULDNT_CONNECT) {
+        xerrno = ECONNREFUSED;
+
+      } else if (curl_code == CURLE_OPERATION_TIMEDOUT) {
+        xerrno = ETIMEDOUT;
+
       } else {
         /* Generic error */
         xerrno = EPERM;
@@ -169,6 +384,14 @@ static int http_perform(pool *p, CURL *curl, const char *url,
 
     clear_http_response();
 
+    /* Provide the response code, if any, of an interrupted transfer, so
+     * that callers can tell whether the data received thus far are usable.
+     */
+    if (curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, resp_code) !=
+        CURLE_OK) {
+      *resp_code = 0L;
+    }
+
     errno = xerrno;
     return -1;
   }
@@ -286,150 +509,927 @@ int urlconf_http_get(pool *p, void *http, const char *url, pr_table_t *headers,
   return res;
 }
 
-static size_t http_header_cb(char *data, size_t itemsz, size_t item_count,
-    void *user_data) {
-  size_t datasz;
+int urlconf_http_post(pool *p, void *http, const char *url,
+    pr_table_t *headers, const char *data, size_t datalen,
+    size_t (*resp_body)(char *, size_t, size_t, void *), void *user_data,
+    long *resp_code) {
+  int res, xerrno;
+  CURL *curl;
+  CURLcode curl_code;
 
-  datasz = itemsz * item_count;
+  if (p == NULL ||
+      http == NULL ||
+      url == NULL ||
+      data == NULL ||
+      resp_body == NULL ||
+      resp_code == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-  /* Fortunately, only COMPLETE headers are passed to us, so that we do not
-   * need to do any buffering.  Be aware that the header data may NOT be
-   * NUL-terminated.
-   */
+  curl = http;
 
-  if (strncmp(data, "HTTP/1.0 ", 9) == 0 ||
-      strncmp(data, "HTTP/1.1 ", 9) == 0) {
-    char *resp_msg;
-    size_t resp_msglen;
+  curl_code = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long) datalen);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_POSTFIELDSIZE: %s",
+      curl_easy_strerror(curl_code));
+    errno = EINVAL;
+    return -1;
+  }
 
-    /* We're receiving the HTTP response status line. */
+  curl_code = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_POSTFIELDS: %s",
+      curl_easy_strerror(curl_code));
+    errno = EINVAL;
+    return -1;
+  }
 
-    /* Advance the pointer past "HTTP/1.x NNNN "(13). And take back 2,
-     * for whose CRLF this line is.
-     */
-    resp_msg = data + 13;
-    resp_msglen = datasz - 13 - 2;
+  res = http_perform(p, curl, url, headers, resp_body, user_data, resp_code,
+    NULL);
+  xerrno = errno;
 
-    http_resp_msg = pstrndup(http_resp_pool, resp_msg, resp_msglen);
-  }
+  /* Handles may be reused, so make sure this one does not keep a pointer
+   * to the data.
+   */
+  (void) curl_easy_setopt(curl, CURLOPT_POSTFIELDS, NULL);
+  (void) curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
 
-  return datasz;
+  errno = xerrno;
+  return res;
 }
 
-static int http_trace_cb(CURL *curl, curl_infotype data_type, char *data,
-    size_t datasz, void *user_data) {
-
-  /* Tell the compiler we won't be using this argument. */
-  (void) curl;
+int urlconf_http_list(pool *p, void *http, const char *url,
+    pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
+    void *user_data, long *resp_code) {
+  int res, xerrno;
+  CURL *curl;
+  CURLcode curl_code;
 
-  switch (data_type) {
-    case CURLINFO_TEXT:
-      pr_trace_msg(trace_channel, 15, "[debug] INFO: %s", data);
-      break;
+  if (p == NULL ||
+      http == NULL ||
+      url == NULL ||
+      resp_body == NULL ||
+      resp_code == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
 
-    case CURLINFO_HEADER_IN:
-      /* Note: You MAY sometimes see servers send the following response header:
-       *
-       *   nnCoection: close
-       *
-       * This is a deliberate hack, albeit ugly.  See:
-       *   https://forums.aws.amazon.com/message.jspa?messageID=81954
-       */
+  curl = http;
 
-      if (datasz > 2) {
-        pr_trace_msg(trace_channel, 15,
-          "[debug] HEADER IN: %.*s (%ld bytes)", (int) datasz-2, data, datasz);
-      }
-      break;
+  curl_code = curl_easy_setopt(curl, CURLOPT_DIRLISTONLY, 1L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_DIRLISTONLY: %s",
+      curl_easy_strerror(curl_code));
+  }
 
-    case CURLINFO_HEADER_OUT:
-      if (datasz > 2) {
-        pr_trace_msg(trace_channel, 15,
-          "[debug] HEADER OUT: %.*s (%ld bytes)", (int) datasz-2, data, datasz);
-      }
-      break;
+  res = urlconf_http_get(p, http, url, headers, resp_body, user_data,
+    resp_code, NULL);
+  xerrno = errno;
 
-    case CURLINFO_DATA_IN:
-      pr_trace_msg(trace_channel, 19,
-        "[debug] DATA IN: (%ld bytes)", datasz);
-      break;
+  /* The handle may be reused for other requests. */
+  (void) curl_easy_setopt(curl, CURLOPT_DIRLISTONLY, 0L);
 
-    case CURLINFO_DATA_OUT:
-      pr_trace_msg(trace_channel, 19,
-        "[debug] DATA OUT: (%ld bytes)", datasz);
-      break;
+  errno = xerrno;
+  return res;
+}
 
-    case CURLINFO_SSL_DATA_IN:
-    case CURLINFO_SSL_DATA_OUT:
-      break;
+int urlconf_http_get_with_headers(pool *p, void *http, const char *url,
+    pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
+    void *user_data, long *resp_code, pr_table_t *resp_headers) {
+  int res, xerrno;
+  CURL *curl;
+  struct http_headers_data *headers_data;
 
-    default:
-      pr_trace_msg(trace_channel, 3,
-        "[debug] UNKNOWN DEBUG DATA: %d (%ld bytes)", (int) data_type, datasz);
-      break;
+  if (p == NULL ||
+      http == NULL ||
+      resp_headers == NULL) {
+    errno = EINVAL;
+    return -1;
   }
 
-  return 0;
+  curl = http;
+
+  headers_data = pcalloc(p, sizeof(struct http_headers_data));
+  headers_data->pool = p;
+  headers_data->headers = resp_headers;
+  (void) curl_easy_setopt(curl, CURLOPT_HEADERDATA, headers_data);
+
+  res = urlconf_http_get(p, http, url, headers, resp_body, user_data,
+    resp_code, NULL);
+  xerrno = errno;
+
+  /* The handle may be reused for other requests. */
+  (void) curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
+
+  errno = xerrno;
+  return res;
 }
 
-void *urlconf_http_alloc(pool *p, unsigned long max_connect_secs,
-    unsigned long max_request_secs, unsigned long flags) {
+int urlconf_http_resume(pool *p, void *http, const char *url,
+    pr_table_t *headers, off_t offset, const char *if_range,
+    size_t (*resp_body)(char *, size_t, size_t, void *), void *user_data,
+    long *resp_code, pr_table_t *resp_headers) {
+  int res, xerrno;
   CURL *curl;
   CURLcode curl_code;
 
-  (void) p;
-
-  curl = curl_easy_init();
-  if (curl == NULL) {
-    pr_trace_msg(trace_channel, 3, "error initializing curl easy handle");
-    errno = ENOMEM;
-    return NULL;
+  if (p == NULL ||
+      http == NULL ||
+      url == NULL ||
+      offset <= 0) {
+    errno = EINVAL;
+    return -1;
   }
 
-  curl_code = curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_FOLLOWLOCATION: %s",
-      curl_easy_strerror(curl_code));
-  }
+  curl = http;
 
-  curl_code = curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+  curl_code = curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE,
+    (curl_off_t) offset);
   if (curl_code != CURLE_OK) {
     pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_NOPROGRESS: %s",
+      "error setting CURLOPT_RESUME_FROM_LARGE: %s",
       curl_easy_strerror(curl_code));
+    errno = EINVAL;
+    return -1;
   }
 
-  curl_code = curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_NOSIGNAL: %s",
-      curl_easy_strerror(curl_code));
-  }
+  if (if_range != NULL &&
+      strncasecmp(url, "http", 4) == 0) {
+    if (headers == NULL) {
+      headers = pr_table_alloc(p, 0);
+    }
 
-  curl_code = curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_TCP_NODELAY: %s",
-      curl_easy_strerror(curl_code));
+    (void) pr_table_add(headers, URLCONF_HTTP_HEADER_IF_RANGE,
+      pstrdup(p, if_range), 0);
   }
 
-#ifdef HAVE_CURL_CURLOPT_TCP_KEEPALIVE
-  curl_code = curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_TCP_KEEPALIVE: %s",
-      curl_easy_strerror(curl_code));
-  }
-#endif /* HAVE_CURL_CURLOPT_TCP_KEEPALIVE */
+  pr_trace_msg(trace_channel, 12, "resuming '%s' request from offset %llu",
+    url, (unsigned long long) offset);
+
+  if (resp_headers != NULL) {
+    res = urlconf_http_get_with_headers(p, http, url, headers, resp_body,
+      user_data, resp_code, resp_headers);
+
+  } else {
+    res = urlconf_http_get(p, http, url, headers, resp_body, user_data,
+      resp_code, NULL);
+  }
+  xerrno = errno;
+
+  /* The handle may be reused for other requests. */
+  (void) curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) 0);
+
+  errno = xerrno;
+  return res;
+}
+
+static struct curl_slist *http_headers_slist(pool *p, pr_table_t *headers) {
+  register unsigned int i;
+  array_header *http_headers;
+  struct curl_slist *slist = NULL;
+  char **elts;
+
+  http_headers = urlconf_utils_table2array(p, headers);
+
+  elts = http_headers->elts;
+  for (i = 0; i < http_headers->nelts; i++) {
+    slist = curl_slist_append(slist, elts[i]);
+  }
+
+  return slist;
+}
+
+int urlconf_http_get_many(pool *p, array_header *reqs, pr_table_t *headers,
+    unsigned long max_connect_secs, unsigned long max_request_secs,
+    unsigned long flags) {
+  register unsigned int i;
+  CURLM *multi;
+  CURLMcode multi_code;
+  CURLMsg *msg;
+  CURL **handles;
+  struct curl_slist *slist = NULL, **req_slists;
+  struct urlconf_http_req **elts;
+  int interrupted = FALSE, msgs_left, running = 0;
+
+  if (p == NULL ||
+      reqs == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (reqs->nelts == 0) {
+    return 0;
+  }
+
+  multi = curl_multi_init();
+  if (multi == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  multi_code = curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+    URLCONF_HTTP_MAX_HOST_CONNS);
+  if (multi_code != CURLM_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLMOPT_MAX_HOST_CONNECTIONS: %s",
+      curl_multi_strerror(multi_code));
+  }
+
+  if (headers != NULL) {
+    slist = http_headers_slist(p, headers);
+  }
+
+  handles = pcalloc(p, reqs->nelts * sizeof(CURL *));
+  req_slists = pcalloc(p, reqs->nelts * sizeof(struct curl_slist *));
+  elts = reqs->elts;
+
+  for (i = 0; i < reqs->nelts; i++) {
+    CURL *curl;
+    struct urlconf_http_req *req;
+
+    req = elts[i];
+    req->resp_code = 0;
+    req->xerrno = EPERM;
+
+    curl = urlconf_http_alloc(p, max_connect_secs, max_request_secs,
+      flags|req->flags);
+    if (curl == NULL) {
+      req->xerrno = errno;
+      continue;
+    }
+
+    if (((flags|req->flags) & URLCONF_FL_CURL_USE_TLS) &&
+        (req->ssl_ca_file != NULL ||
+         req->ssl_ca_path != NULL ||
+         req->ssl_cert != NULL)) {
+      if (urlconf_http_set_ssl(curl, req->ssl_ca_file, req->ssl_ca_path,
+          req->ssl_cert, req->ssl_key) < 0) {
+        req->xerrno = errno;
+        (void) urlconf_http_destroy(p, curl);
+        continue;
+      }
+    }
+
+    (void) curl_easy_setopt(curl, CURLOPT_URL, req->url);
+    (void) curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    (void) curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, req->resp_body);
+    (void) curl_easy_setopt(curl, CURLOPT_WRITEDATA, req->user_data);
+    (void) curl_easy_setopt(curl, CURLOPT_PRIVATE, req);
+
+    if (req->resp_headers != NULL) {
+      struct http_headers_data *headers_data;
+
+      headers_data = pcalloc(p, sizeof(struct http_headers_data));
+      headers_data->pool = req->resp_headers_pool ? req->resp_headers_pool : p;
+      headers_data->headers = req->resp_headers;
+      (void) curl_easy_setopt(curl, CURLOPT_HEADERDATA, headers_data);
+    }
+
+    /* These handles share one error buffer, which would be clobbered by
+     * concurrent requests.
+     */
+    (void) curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
+
+    if (req->headers != NULL) {
+      register unsigned int j;
+      array_header *req_headers;
+      char **lines;
+
+      /* This request has headers of its own, in addition to the shared
+       * headers.
+       */
+      if (headers != NULL) {
+        req_headers = urlconf_utils_table2array(p, headers);
+        lines = req_headers->elts;
+        for (j = 0; j < req_headers->nelts; j++) {
+          req_slists[i] = curl_slist_append(req_slists[i], lines[j]);
+        }
+      }
+
+      req_headers = urlconf_utils_table2array(p, req->headers);
+      lines = req_headers->elts;
+      for (j = 0; j < req_headers->nelts; j++) {
+        req_slists[i] = curl_slist_append(req_slists[i], lines[j]);
+      }
+
+      (void) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req_slists[i]);
+
+    } else if (slist != NULL) {
+      (void) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slist);
+    }
+
+    multi_code = curl_multi_add_handle(multi, curl);
+    if (multi_code != CURLM_OK) {
+      pr_trace_msg(trace_channel, 3, "error adding handle for '%s': %s",
+        req->url, curl_multi_strerror(multi_code));
+      (void) urlconf_http_destroy(p, curl);
+      continue;
+    }
+
+    handles[i] = curl;
+  }
+
+  pr_trace_msg(trace_channel, 15, "performing %d %s concurrently",
+    reqs->nelts, reqs->nelts != 1 ? "requests" : "request");
+
+  clear_http_response();
+  http_resp_pool = make_sub_pool(p);
+
+  multi_code = curl_multi_perform(multi, &running);
+  while (multi_code == CURLM_OK &&
+         running > 0) {
+    int nfds = 0;
+
+    if (http_interrupted() == TRUE) {
+      pr_trace_msg(trace_channel, 5,
+        "aborting concurrent transfers for pending shutdown/restart");
+      interrupted = TRUE;
+      break;
+    }
+
+    pr_signals_handle();
+
+    multi_code = curl_multi_wait(multi, NULL, 0, 1000, &nfds);
+    if (multi_code == CURLM_OK) {
+      multi_code = curl_multi_perform(multi, &running);
+    }
+  }
+
+  clear_http_response();
+
+  /* Requests which did not finish were interrupted. */
+  if (interrupted == TRUE) {
+    for (i = 0; i < reqs->nelts; i++) {
+      if (handles[i] != NULL) {
+        elts[i]->xerrno = EINTR;
+      }
+    }
+  }
+
+  msg = curl_multi_info_read(multi, &msgs_left);
+  while (msg != NULL) {
+    if (msg->msg == CURLMSG_DONE) {
+      struct urlconf_http_req *req = NULL;
+
+      (void) curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &req);
+      if (req != NULL) {
+        http_get_timing(msg->easy_handle, &(req->timing));
+
+        if (msg->data.result == CURLE_OK) {
+          (void) curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
+            &(req->resp_code));
+          req->xerrno = 0;
+
+          pr_trace_msg(trace_channel, 15,
+            "received response code %ld for '%s' request", req->resp_code,
+            req->url);
+
+        } else {
+          req->xerrno = http_curl_errno(msg->data.result);
+
+          pr_trace_msg(trace_channel, 1, "'%s' request error: %s", req->url,
+            curl_easy_strerror(msg->data.result));
+        }
+      }
+    }
+
+    msg = curl_multi_info_read(multi, &msgs_left);
+  }
+
+  for (i = 0; i < reqs->nelts; i++) {
+    if (handles[i] != NULL) {
+      (void) curl_multi_remove_handle(multi, handles[i]);
+      (void) curl_easy_setopt(handles[i], CURLOPT_HTTPHEADER, NULL);
+      (void) urlconf_http_destroy(p, handles[i]);
+    }
+
+    if (req_slists[i] != NULL) {
+      curl_slist_free_all(req_slists[i]);
+    }
+  }
+
+  curl_multi_cleanup(multi);
+
+  if (slist != NULL) {
+    curl_slist_free_all(slist);
+  }
+
+  return 0;
+}
+
+static size_t http_header_cb(char *data, size_t itemsz, size_t item_count,
+    void *user_data) {
+  size_t datasz;
+
+  datasz = itemsz * item_count;
+
+  /* Fortunately, only COMPLETE headers are passed to us, so that we do not
+   * need to do any buffering.  Be aware that the header data may NOT be
+   * NUL-terminated.
+   */
+
+  if (strncmp(data, "HTTP/1.0 ", 9) == 0 ||
+      strncmp(data, "HTTP/1.1 ", 9) == 0) {
+    char *resp_msg;
+    size_t resp_msglen;
+
+    /* We're receiving the HTTP response status line. */
+
+    /* Advance the pointer past "HTTP/1.x NNNN "(13). And take back 2,
+     * for whose CRLF this line is.
+     */
+    resp_msg = data + 13;
+    resp_msglen = datasz - 13 - 2;
+
+    http_resp_msg = pstrndup(http_resp_pool, resp_msg, resp_msglen);
+
+  } else if (user_data != NULL) {
+    struct http_headers_data *headers_data;
+    const char *ptr, *end;
+
+    headers_data = user_data;
+
+    /* Collect the header, with its name lowercased, and any surrounding
+     * whitespace (and the CRLF) removed from its value.
+     */
+    ptr = memchr(data, ':', datasz);
+    if (ptr != NULL &&
+        ptr > data) {
+      register unsigned int i;
+      char *name, *value;
+
+      name = pstrndup(headers_data->pool, data, ptr - data);
+      for (i = 0; name[i]; i++) {
+        name[i] = tolower((int) name[i]);
+      }
+
+      ptr++;
+      end = data + datasz;
+      while (ptr < end &&
+             PR_ISSPACE(*ptr)) {
+        ptr++;
+      }
+
+      while (end > ptr &&
+             PR_ISSPACE(end[-1])) {
+        end--;
+      }
+
+      value = pstrndup(headers_data->pool, ptr, end - ptr);
+
+      if (pr_table_exists(headers_data->headers, name) > 0) {
+        (void) pr_table_set(headers_data->headers, name, value, 0);
+
+      } else {
+        (void) pr_table_add(headers_data->headers, name, value, 0);
+      }
+    }
+  }
+
+  return datasz;
+}
+
+static int http_trace_cb(CURL *curl, curl_infotype data_type, char *data,
+    size_t datasz, void *user_data) {
+
+  /* Tell the compiler we won't be using this argument. */
+  (void) curl;
+
+  switch (data_type) {
+    case CURLINFO_TEXT:
+      pr_trace_msg(trace_channel, 15, "[debug] INFO: %s", data);
+      break;
+
+    case CURLINFO_HEADER_IN:
+      /* Note: You MAY sometimes see servers send the following response header:
+       *
+       *   nnCoection: close
+       *
+       * This is a deliberate hack, albeit ugly.  See:
+       *   https://forums.aws.amazon.com/message.jspa?messageID=81954
+       */
+
+      if (datasz > 2) {
+        pr_trace_msg(trace_channel, 15,
+          "[debug] HEADER IN: %.*s (%ld bytes)", (int) datasz-2, data, datasz);
+      }
+      break;
+
+    case CURLINFO_HEADER_OUT:
+      if (datasz > 2) {
+        pr_trace_msg(trace_channel, 15,
+          "[debug] HEADER OUT: %.*s (%ld bytes)", (int) datasz-2, data, datasz);
+      }
+      break;
+
+    case CURLINFO_DATA_IN:
+      /* A large response arrives in many chunks; log only a sample. */
+      if (http_data_in_chunks++ % HTTP_TRACE_DATA_IN_SAMPLE == 0) {
+        pr_trace_msg(trace_channel, 19,
+          "[debug] DATA IN: (%ld bytes, chunk %lu)", datasz,
+          http_data_in_chunks);
+      }
+      break;
+
+    case CURLINFO_DATA_OUT:
+      pr_trace_msg(trace_channel, 19,
+        "[debug] DATA OUT: (%ld bytes)", datasz);
+      break;
+
+    case CURLINFO_SSL_DATA_IN:
+    case CURLINFO_SSL_DATA_OUT:
+      break;
+
+    default:
+      pr_trace_msg(trace_channel, 3,
+        "[debug] UNKNOWN DEBUG DATA: %d (%ld bytes)", (int) data_type, datasz);
+      break;
+  }
+
+  return 0;
+}
+
+/* Whether the daemon has been asked to stop or restart. */
+static int http_interrupted(void) {
+  if (recvd_signal_flags & (RECEIVED_SIG_REHASH|RECEIVED_SIG_EXIT|
+      RECEIVED_SIG_SHUTDOWN|RECEIVED_SIG_TERMINATE)) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Called by libcurl at least once a second during a transfer.  Other
+ * signals are handled here; a pending stop or restart aborts the transfer
+ * instead, to be handled once libcurl has returned.
+ */
+static int http_check_signals(void) {
+  if (http_interrupted() == TRUE) {
+    pr_trace_msg(trace_channel, 5,
+      "aborting transfer for pending shutdown/restart");
+    return 1;
+  }
+
+  pr_signals_handle();
+  return 0;
+}
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+static int http_xferinfo_cb(void *user_data, curl_off_t dltotal,
+    curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
+  return http_check_signals();
+}
+#else
+static int http_progress_cb(void *user_data, double dltotal, double dlnow,
+    double ultotal, double ulnow) {
+  return http_check_signals();
+}
+#endif /* libcurl-7.32.0 and later */
+
+/* Has libcurl generate debug data only when there is a trace level at which
+ * we would log it, as it otherwise costs every request for nothing.
+ */
+static void http_set_trace_opts(CURL *curl) {
+  CURLcode curl_code;
+  long verbose = 0L;
+
+  http_data_in_chunks = 0;
+
+  if (pr_trace_get_level(trace_channel) >= HTTP_TRACE_DEBUG_LEVEL) {
+    verbose = 1L;
+
+    curl_code = curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, http_trace_cb);
+    if (curl_code != CURLE_OK) {
+      pr_trace_msg(trace_channel, 1,
+        "error setting CURLOPT_DEBUGFUNCTION: %s",
+        curl_easy_strerror(curl_code));
+    }
+
+    curl_code = curl_easy_setopt(curl, CURLOPT_DEBUGDATA, NULL);
+    if (curl_code != CURLE_OK) {
+      pr_trace_msg(trace_channel, 1,
+        "error setting CURLOPT_DEBUGDATA: %s",
+        curl_easy_strerror(curl_code));
+    }
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_VERBOSE, verbose);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_VERBOSE: %s",
+      curl_easy_strerror(curl_code));
+  }
+}
+
+static void http_set_dns_opts(CURL *curl) {
+  CURLcode curl_code;
 
   curl_code = curl_easy_setopt(curl, CURLOPT_SHARE, curl_share);
   if (curl_code != CURLE_OK) {
     pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_SHARE: %s", curl_easy_strerror(curl_code));
+      "error setting CURLOPT_SHARE: %s", curl_easy_strerror(curl_code));
+  }
+
+  if (http_resolve_list != NULL) {
+    curl_code = curl_easy_setopt(curl, CURLOPT_RESOLVE, http_resolve_list);
+    if (curl_code != CURLE_OK) {
+      pr_trace_msg(trace_channel, 1,
+        "error setting CURLOPT_RESOLVE: %s", curl_easy_strerror(curl_code));
+    }
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_IPRESOLVE, http_ip_resolve);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_IPRESOLVE: %s", curl_easy_strerror(curl_code));
+  }
+
+  if (http_dns_cache_ttl >= 0) {
+    curl_code = curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT,
+      http_dns_cache_ttl);
+    if (curl_code != CURLE_OK) {
+      pr_trace_msg(trace_channel, 1,
+        "error setting CURLOPT_DNS_CACHE_TIMEOUT: %s",
+        curl_easy_strerror(curl_code));
+    }
+  }
+}
+
+static CURLcode http_ssl_ctx_cb(CURL *curl, void *ssl_ctx, void *user_data) {
+  (void) curl;
+
+  /* Rather than handshake without the client certificate, or with a
+   * certificate but not its key, fail the transfer.
+   */
+  if (urlconf_tls_setup_ssl_ctx(ssl_ctx, user_data) < 0) {
+    pr_trace_msg(trace_channel, 3, "error using shared TLS material: %s",
+      strerror(errno));
+    return CURLE_SSL_CERTPROBLEM;
+  }
+
+  return CURLE_OK;
+}
+
+static void http_set_ssl_client_cert(CURL *curl, struct urlconf_tls_ctx *ctx,
+    const char *cert_file, const char *key_file) {
+  CURLcode curl_code;
+
+#if LIBCURL_VERSION_NUM >= 0x074700
+  /* CURLOPT_SSLCERT_BLOB first appeared in libcurl-7.71.0. */
+  if (ctx != NULL &&
+      ctx->cert_data != NULL &&
+      ctx->key_data != NULL) {
+    struct curl_blob blob;
+
+    blob.data = (void *) ctx->cert_data;
+    blob.len = ctx->cert_datalen;
+    blob.flags = CURL_BLOB_NOCOPY;
+
+    curl_code = curl_easy_setopt(curl, CURLOPT_SSLCERT_BLOB, &blob);
+    if (curl_code == CURLE_OK) {
+      blob.data = (void *) ctx->key_data;
+      blob.len = ctx->key_datalen;
+
+      curl_code = curl_easy_setopt(curl, CURLOPT_SSLKEY_BLOB, &blob);
+      if (curl_code == CURLE_OK) {
+        return;
+      }
+    }
+
+    pr_trace_msg(trace_channel, 9,
+      "error setting CURLOPT_SSLCERT_BLOB/CURLOPT_SSLKEY_BLOB: %s",
+      curl_easy_strerror(curl_code));
+  }
+#endif /* libcurl-7.71.0 and later */
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_SSLCERT, cert_file);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_SSLCERT: %s", curl_easy_strerror(curl_code));
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_SSLKEY,
+    key_file ? key_file : cert_file);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_SSLKEY: %s", curl_easy_strerror(curl_code));
+  }
+}
+
+int urlconf_http_set_credentials(void *http, const char *username,
+    const char *password) {
+  CURL *curl;
+  CURLcode curl_code;
+
+  curl = http;
+  if (curl == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_USERNAME, username);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_USERNAME: %s", curl_easy_strerror(curl_code));
+    errno = EINVAL;
+    return -1;
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_PASSWORD, password);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_PASSWORD: %s", curl_easy_strerror(curl_code));
+    errno = EINVAL;
+    return -1;
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_HTTPAUTH,
+    username != NULL ? (long) CURLAUTH_BASIC : (long) CURLAUTH_NONE);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_HTTPAUTH: %s", curl_easy_strerror(curl_code));
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int urlconf_http_set_ssl(void *http, const char *ca_file, const char *ca_path,
+    const char *cert_file, const char *key_file) {
+  CURL *curl;
+  CURLcode curl_code;
+  struct urlconf_tls_ctx *ctx;
+
+  curl = http;
+  if (curl == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (http_feature_flags & URLCONF_FL_CURL_NO_SSL) {
+    return 0;
+  }
+
+  /* Rather than have libcurl read and parse the CA certificates for every
+   * handle, use the CA store which we loaded once.  If libcurl uses OpenSSL,
+   * we give it our parsed store; otherwise, we give it the CA file contents
+   * which we read once.
+   */
+  ctx = urlconf_tls_get_ctx(ca_file, ca_path, cert_file, key_file);
+  if (ctx == NULL &&
+      cert_file != NULL) {
+    return -1;
+  }
+
+  if (ctx != NULL &&
+      ctx->ca_store != NULL &&
+      (cert_file == NULL || (ctx->cert != NULL && ctx->key != NULL)) &&
+      !(http_feature_flags & URLCONF_FL_CURL_NO_SSL_CTX)) {
+    (void) curl_easy_setopt(curl, CURLOPT_CAINFO, NULL);
+    (void) curl_easy_setopt(curl, CURLOPT_CAPATH, NULL);
+
+    curl_code = curl_easy_setopt(curl, CURLOPT_SSL_CTX_FUNCTION,
+      http_ssl_ctx_cb);
+    if (curl_code == CURLE_OK) {
+      (void) curl_easy_setopt(curl, CURLOPT_SSL_CTX_DATA, ctx);
+      return 0;
+    }
+
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_SSL_CTX_FUNCTION: %s",
+      curl_easy_strerror(curl_code));
+  }
+
+  if (cert_file != NULL) {
+    http_set_ssl_client_cert(curl, ctx, cert_file, key_file);
+  }
+
+#if LIBCURL_VERSION_NUM >= 0x074d00
+  /* CURLOPT_CAINFO_BLOB first appeared in libcurl-7.77.0. */
+  if (ctx != NULL &&
+      ctx->ca_data != NULL &&
+      ca_path == NULL) {
+    struct curl_blob blob;
+
+    blob.data = (void *) ctx->ca_data;
+    blob.len = ctx->ca_datalen;
+    blob.flags = CURL_BLOB_NOCOPY;
+
+    curl_code = curl_easy_setopt(curl, CURLOPT_CAINFO_BLOB, &blob);
+    if (curl_code == CURLE_OK) {
+      (void) curl_easy_setopt(curl, CURLOPT_CAINFO, NULL);
+      (void) curl_easy_setopt(curl, CURLOPT_CAPATH, NULL);
+      return 0;
+    }
+
+    pr_trace_msg(trace_channel, 9,
+      "error setting CURLOPT_CAINFO_BLOB: %s", curl_easy_strerror(curl_code));
+  }
+#endif /* libcurl-7.77.0 and later */
+
+  if (ca_file != NULL) {
+    curl_code = curl_easy_setopt(curl, CURLOPT_CAINFO, ca_file);
+    if (curl_code != CURLE_OK) {
+      pr_trace_msg(trace_channel, 1,
+        "error setting CURLOPT_CAINFO: %s", curl_easy_strerror(curl_code));
+    }
+  }
+
+  if (ca_path != NULL) {
+    curl_code = curl_easy_setopt(curl, CURLOPT_CAPATH, ca_path);
+    if (curl_code != CURLE_OK) {
+      pr_trace_msg(trace_channel, 1,
+        "error setting CURLOPT_CAPATH: %s", curl_easy_strerror(curl_code));
+    }
+  }
+
+  return 0;
+}
+
+void *urlconf_http_alloc(pool *p, unsigned long max_connect_secs,
+    unsigned long max_request_secs, unsigned long flags) {
+  CURL *curl;
+  CURLcode curl_code;
+
+  (void) p;
+
+  curl = curl_easy_init();
+  if (curl == NULL) {
+    pr_trace_msg(trace_channel, 3, "error initializing curl easy handle");
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_FOLLOWLOCATION: %s",
+      curl_easy_strerror(curl_code));
+  }
+
+  /* The progress callback lets a pending stop or restart abort a slow
+   * transfer, as the signals themselves do not interrupt libcurl.
+   */
+  curl_code = curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_NOPROGRESS: %s",
+      curl_easy_strerror(curl_code));
+  }
+
+#if LIBCURL_VERSION_NUM >= 0x072000
+  curl_code = curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION,
+    http_xferinfo_cb);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_XFERINFOFUNCTION: %s",
+      curl_easy_strerror(curl_code));
+  }
+#else
+  curl_code = curl_easy_setopt(curl, CURLOPT_PROGRESSFUNCTION,
+    http_progress_cb);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_PROGRESSFUNCTION: %s",
+      curl_easy_strerror(curl_code));
+  }
+#endif /* libcurl-7.32.0 and later */
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_NOSIGNAL: %s",
+      curl_easy_strerror(curl_code));
+  }
+
+  curl_code = curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_TCP_NODELAY: %s",
+      curl_easy_strerror(curl_code));
+  }
+
+#ifdef HAVE_CURL_CURLOPT_TCP_KEEPALIVE
+  curl_code = curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_TCP_KEEPALIVE: %s",
+      curl_easy_strerror(curl_code));
   }
+#endif /* HAVE_CURL_CURLOPT_TCP_KEEPALIVE */
+
+  http_set_dns_opts(curl);
 
   /* SSL-isms. */
+  if (flags & URLCONF_FL_CURL_USE_TLS) {
+    (void) urlconf_http_set_ssl(curl, NULL, NULL, NULL, NULL);
+  }
+
   if (flags & URLCONF_FL_CURL_NO_VERIFY) {
     curl_code = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
     if (curl_code != CURLE_OK) {
@@ -448,8 +1448,31 @@ void *urlconf_http_alloc(pool *p, unsigned long max_connect_secs,
       curl_easy_strerror(curl_code));
   }
 
+  curl_code = curl_easy_setopt(curl, CURLOPT_FTP_USE_EPSV, 1L);
+  if (curl_code != CURLE_OK) {
+    pr_trace_msg(trace_channel, 1,
+      "error setting CURLOPT_FTP_USE_EPSV: %s",
+      curl_easy_strerror(curl_code));
+  }
+
   if (flags & URLCONF_FL_CURL_USE_SSL) {
-    curl_code = curl_easy_setopt(curl, CURLOPT_USE_SSL, CURLUSESSL_CONTROL);
+    long use_ssl = CURLUSESSL_CONTROL;
+
+    /* If the data channel is protected as well, its TLS session resumes the
+     * control channel's session, via the session ID cache.
+     */
+    if (flags & URLCONF_FL_CURL_USE_SSL_DATA) {
+      use_ssl = CURLUSESSL_ALL;
+
+      curl_code = curl_easy_setopt(curl, CURLOPT_SSL_SESSIONID_CACHE, 1L);
+      if (curl_code != CURLE_OK) {
+        pr_trace_msg(trace_channel, 1,
+          "error setting CURLOPT_SSL_SESSIONID_CACHE: %s",
+          curl_easy_strerror(curl_code));
+      }
+    }
+
+    curl_code = curl_easy_setopt(curl, CURLOPT_USE_SSL, use_ssl);
     if (curl_code != CURLE_OK) {
       pr_trace_msg(trace_channel, 1,
         "error setting CURLOPT_USE_SSL: %s", curl_easy_strerror(curl_code));
@@ -464,16 +1487,18 @@ void *urlconf_http_alloc(pool *p, unsigned long max_connect_secs,
 
   /* HTTP-isms. */
   curl_code = curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
-    CURL_HTTP_VERSION_1_1);
+    http_get_version(flags));
   if (curl_code != CURLE_OK) {
     pr_trace_msg(trace_channel, 1,
       "error setting CURLOPT_HTTP_VERSION: %s",
       curl_easy_strerror(curl_code));
   }
 
+  /* Accept any of the content encodings supported by libcurl (e.g. gzip,
+   * deflate, br, zstd), e.g. for large, compressed bundles.
+   */
   if (!(flags & URLCONF_FL_CURL_NO_ZLIB)) {
-    curl_code = curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING,
-      "gzip, deflate");
+    curl_code = curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
     if (curl_code != CURLE_OK) {
       pr_trace_msg(trace_channel, 1,
         "error setting CURLOPT_ACCEPT_ENCODING: %s",
@@ -495,33 +1520,14 @@ void *urlconf_http_alloc(pool *p, unsigned long max_connect_secs,
       curl_easy_strerror(curl_code));
   }
 
-  curl_code = curl_easy_setopt(curl, CURLOPT_HEADERDATA, curl);
+  curl_code = curl_easy_setopt(curl, CURLOPT_HEADERDATA, NULL);
   if (curl_code != CURLE_OK) {
     pr_trace_msg(trace_channel, 1,
       "error setting CURLOPT_HEADERDATA: %s",
       curl_easy_strerror(curl_code));
   }
 
-  curl_code = curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, http_trace_cb);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_DEBUGFUNCTION: %s",
-      curl_easy_strerror(curl_code));
-  }
-
-  curl_code = curl_easy_setopt(curl, CURLOPT_DEBUGDATA, NULL);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_DEBUGDATA: %s",
-      curl_easy_strerror(curl_code));
-  }
-
-  curl_code = curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-  if (curl_code != CURLE_OK) {
-    pr_trace_msg(trace_channel, 1,
-      "error setting CURLOPT_VERBOSE: %s",
-      curl_easy_strerror(curl_code));
-  }
+  http_set_trace_opts(curl);
 
   curl_code = curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, curl_errorbuf);
   if (curl_code != CURLE_OK) {
@@ -572,13 +1578,252 @@ int urlconf_http_destroy(pool *p, void *http) {
   return -1;
 }
 
+int urlconf_http_set_dns(array_header *resolve, int ip_version,
+    long dns_cache_ttl) {
+
+  if (http_resolve_list != NULL) {
+    curl_slist_free_all(http_resolve_list);
+    http_resolve_list = NULL;
+  }
+
+  if (resolve != NULL) {
+    register unsigned int i;
+    char **elts;
+
+    elts = resolve->elts;
+    for (i = 0; i < resolve->nelts; i++) {
+      http_resolve_list = curl_slist_append(http_resolve_list, elts[i]);
+    }
+  }
+
+  switch (ip_version) {
+    case 4:
+      http_ip_resolve = CURL_IPRESOLVE_V4;
+      break;
+
+    case 6:
+      http_ip_resolve = CURL_IPRESOLVE_V6;
+      break;
+
+    default:
+      http_ip_resolve = CURL_IPRESOLVE_WHATEVER;
+      break;
+  }
+
+  http_dns_cache_ttl = dns_cache_ttl;
+  return 0;
+}
+
+static int http_curl_errno(CURLcode curl_code) {
+  switch (curl_code) {
+    case CURLE_OK:
+      return 0;
+
+    case CURLE_COULDNT_RESOLVE_HOST:
+      return ESRCH;
+
+    case CURLE_COULDNT_CONNECT:
+      return ECONNREFUSED;
+
+    case CURLE_OPERATION_TIMEDOUT:
+      return ETIMEDOUT;
+
+    case CURLE_ABORTED_BY_CALLBACK:
+      return EINTR;
+
+    default:
+      break;
+  }
+
+  return EPERM;
+}
+
+/* Called by libcurl once the host has been resolved (and thus added to the
+ * shared DNS cache), when it would open the socket for connecting.  We only
+ * want the lookup, so we note it, and refuse the socket.
+ */
+static curl_socket_t http_resolve_opensocket_cb(void *user_data,
+    curlsocktype purpose, struct curl_sockaddr *addr) {
+  int *resolved;
+
+  resolved = user_data;
+  *resolved = TRUE;
+
+  return CURL_SOCKET_BAD;
+}
+
+int urlconf_http_resolve(pool *p, array_header *urls,
+    unsigned long max_connect_secs, int *errnos) {
+  register unsigned int i;
+  CURLM *multi;
+  CURLMcode multi_code;
+  CURL **handles;
+  CURLMsg *msg;
+  char **elts;
+  int interrupted = FALSE, msgs_left, running = 0, *resolved;
+
+  if (p == NULL ||
+      urls == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (urls->nelts == 0) {
+    return 0;
+  }
+
+  multi = curl_multi_init();
+  if (multi == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  handles = pcalloc(p, urls->nelts * sizeof(CURL *));
+  resolved = pcalloc(p, urls->nelts * sizeof(int));
+  elts = urls->elts;
+
+  for (i = 0; i < urls->nelts; i++) {
+    CURL *curl;
+
+    if (errnos != NULL) {
+      errnos[i] = EPERM;
+    }
+
+    curl = curl_easy_init();
+    if (curl == NULL) {
+      continue;
+    }
+
+    (void) curl_easy_setopt(curl, CURLOPT_URL, elts[i]);
+    (void) curl_easy_setopt(curl, CURLOPT_OPENSOCKETFUNCTION,
+      http_resolve_opensocket_cb);
+    (void) curl_easy_setopt(curl, CURLOPT_OPENSOCKETDATA, &(resolved[i]));
+    (void) curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    (void) curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT,
+      (long) max_connect_secs);
+    (void) curl_easy_setopt(curl, CURLOPT_PRIVATE, &(handles[i]));
+    http_set_dns_opts(curl);
+
+    multi_code = curl_multi_add_handle(multi, curl);
+    if (multi_code != CURLM_OK) {
+      pr_trace_msg(trace_channel, 3, "error adding handle for '%s': %s",
+        elts[i], curl_multi_strerror(multi_code));
+      curl_easy_cleanup(curl);
+      continue;
+    }
+
+    handles[i] = curl;
+  }
+
+  pr_trace_msg(trace_channel, 15, "resolving %d %s concurrently", urls->nelts,
+    urls->nelts != 1 ? "hosts" : "host");
+
+  multi_code = curl_multi_perform(multi, &running);
+  while (multi_code == CURLM_OK &&
+         running > 0) {
+    int nfds = 0;
+
+    if (http_interrupted() == TRUE) {
+      pr_trace_msg(trace_channel, 5,
+        "aborting concurrent transfers for pending shutdown/restart");
+      interrupted = TRUE;
+      break;
+    }
+
+    pr_signals_handle();
+
+    multi_code = curl_multi_wait(multi, NULL, 0, 1000, &nfds);
+    if (multi_code == CURLM_OK) {
+      multi_code = curl_multi_perform(multi, &running);
+    }
+  }
+
+  if (interrupted == TRUE &&
+      errnos != NULL) {
+    for (i = 0; i < urls->nelts; i++) {
+      if (handles[i] != NULL) {
+        errnos[i] = EINTR;
+      }
+    }
+  }
+
+  msg = curl_multi_info_read(multi, &msgs_left);
+  while (msg != NULL) {
+    if (msg->msg == CURLMSG_DONE) {
+      CURL **handle = NULL;
+
+      (void) curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &handle);
+      if (handle != NULL) {
+        i = handle - handles;
+
+        /* Having refused the socket, the transfer always fails; it is the
+         * lookup which matters.
+         */
+        if (resolved[i] == TRUE) {
+          pr_trace_msg(trace_channel, 15, "resolved '%s'", elts[i]);
+
+          if (errnos != NULL) {
+            errnos[i] = 0;
+          }
+
+        } else {
+          pr_trace_msg(trace_channel, 15, "resolving '%s': %s", elts[i],
+            curl_easy_strerror(msg->data.result));
+
+          if (errnos != NULL) {
+            errnos[i] = http_curl_errno(msg->data.result);
+          }
+        }
+      }
+    }
+
+    msg = curl_multi_info_read(multi, &msgs_left);
+  }
+
+  for (i = 0; i < urls->nelts; i++) {
+    if (handles[i] != NULL) {
+      (void) curl_multi_remove_handle(multi, handles[i]);
+      (void) curl_easy_setopt(handles[i], CURLOPT_SHARE, NULL);
+      curl_easy_cleanup(handles[i]);
+    }
+  }
+
+  curl_multi_cleanup(multi);
+  return 0;
+}
+
+static unsigned long http_backend_capabilities(void) {
+  return URLCONF_BACKEND_CAP_MANY|URLCONF_BACKEND_CAP_RESUME|
+    URLCONF_BACKEND_CAP_LIST|URLCONF_BACKEND_CAP_TLS|
+    URLCONF_BACKEND_CAP_TIMING;
+}
+
+static int http_backend_get(pool *p, void *http, const char *url,
+    pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
+    void *user_data, long *resp_code, pr_table_t *resp_headers) {
+  if (resp_headers != NULL) {
+    return urlconf_http_get_with_headers(p, http, url, headers, resp_body,
+      user_data, resp_code, resp_headers);
+  }
+
+  return urlconf_http_get(p, http, url, headers, resp_body, user_data,
+    resp_code, NULL);
+}
+
+const struct urlconf_backend urlconf_http_backend = {
+  "libcurl",
+  http_backend_capabilities,
+  urlconf_http_alloc,
+  http_backend_get,
+  urlconf_http_destroy
+};
+
 int urlconf_http_init(pool *p, unsigned long *feature_flags) {
   CURLcode curl_code;
   CURLSHcode share_code;
   curl_version_info_data *curl_info;
   long curl_flags = CURL_GLOBAL_ALL;
-
-  (void) p;
+  const char *default_ca_file = NULL;
 
 #ifdef CURL_GLOBAL_ACK_EINTR
   curl_flags |= CURL_GLOBAL_ACK_EINTR;
@@ -641,13 +1886,76 @@ int urlconf_http_init(pool *p, unsigned long *feature_flags) {
     } else {
       pr_log_debug(DEBUG5, MOD_CONF_URL_VERSION
         ": libcurl compiled using SSL version: %s", curl_info->ssl_version);
+
+      /* We can only share our OpenSSL objects with libcurl if it uses the
+       * same library, with the same structures, as we do.
+       */
+      if (urlconf_tls_is_compatible(curl_info->ssl_version) == FALSE) {
+        pr_log_debug(DEBUG5, MOD_CONF_URL_VERSION
+          ": libcurl SSL library differs from ProFTPD's, not sharing "
+          "CA certificates");
+        *feature_flags |= URLCONF_FL_CURL_NO_SSL_CTX;
+      }
+
+#if LIBCURL_VERSION_NUM >= 0x075400
+      /* CURLINFO_CAINFO first appeared in libcurl-7.84.0. */
+      {
+        CURL *curl;
+
+        curl = curl_easy_init();
+        if (curl != NULL) {
+          char *ca_file = NULL;
+
+          if (curl_easy_getinfo(curl, CURLINFO_CAINFO, &ca_file) == CURLE_OK &&
+              ca_file != NULL) {
+            pr_log_debug(DEBUG5, MOD_CONF_URL_VERSION
+              ": libcurl default CA file: %s", ca_file);
+            default_ca_file = pstrdup(p, ca_file);
+          }
+
+          curl_easy_cleanup(curl);
+        }
+      }
+#endif /* libcurl-7.84.0 and later */
+    }
+
+#if defined(CURL_VERSION_HTTP2)
+    if (!(curl_info->features & CURL_VERSION_HTTP2)) {
+      pr_log_debug(DEBUG5, MOD_CONF_URL_VERSION
+        ": libcurl compiled without HTTP/2 support");
+      *feature_flags |= URLCONF_FL_CURL_NO_HTTP2;
     }
+#else
+    *feature_flags |= URLCONF_FL_CURL_NO_HTTP2;
+#endif /* CURL_VERSION_HTTP2 */
+
+#if defined(CURL_VERSION_HTTP3)
+    /* HTTP/3 support first appeared in libcurl-7.66.0. */
+    if (!(curl_info->features & CURL_VERSION_HTTP3)) {
+      pr_log_debug(DEBUG5, MOD_CONF_URL_VERSION
+        ": libcurl compiled without HTTP/3 support");
+      *feature_flags |= URLCONF_FL_CURL_NO_HTTP3;
+
+    } else {
+      pr_log_debug(DEBUG5, MOD_CONF_URL_VERSION
+        ": libcurl compiled using QUIC version: %s",
+        curl_info->quic_version ? curl_info->quic_version : "(unknown)");
+    }
+#else
+    *feature_flags |= URLCONF_FL_CURL_NO_HTTP3;
+#endif /* CURL_VERSION_HTTP3 */
   }
 
+  urlconf_tls_init(p, default_ca_file);
+
+  http_feature_flags = *feature_flags;
   return 0;
 }
 
 int urlconf_http_free(void) {
+  (void) urlconf_http_set_dns(NULL, 0, -1);
+  (void) urlconf_tls_free();
+
   if (curl_share != NULL) {
     curl_share_cleanup(curl_share);
     curl_share = NULL;
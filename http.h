@@ -23,21 +23,33 @@
  */
 
 #include "mod_conf_url.h"
+#include "backend.h"
 
 #ifndef MOD_CONF_URL_HTTP_H
 #define MOD_CONF_URL_HTTP_H
 
 /* HTTP headers */
+#define URLCONF_HTTP_HEADER_A_IM			"A-IM"
 #define URLCONF_HTTP_HEADER_ACCEPT			"Accept"
+#define URLCONF_HTTP_HEADER_AUTHORIZATION		"Authorization"
 #define URLCONF_HTTP_HEADER_CACHE_CONTROL		"Cache-Control"
 #define URLCONF_HTTP_HEADER_CONTENT_LEN			"Content-Length"
+#define URLCONF_HTTP_HEADER_CONTENT_RANGE		"Content-Range"
 #define URLCONF_HTTP_HEADER_CONTENT_TYPE		"Content-Type"
 #define URLCONF_HTTP_HEADER_DATE			"Date"
+#define URLCONF_HTTP_HEADER_DELTA_BASE			"Delta-Base"
+#define URLCONF_HTTP_HEADER_DIGEST			"Digest"
+#define URLCONF_HTTP_HEADER_ETAG			"ETag"
 #define URLCONF_HTTP_HEADER_EXPECT			"Expect"
 #define URLCONF_HTTP_HEADER_EXPIRES			"Expires"
 #define URLCONF_HTTP_HEADER_HOST			"Host"
+#define URLCONF_HTTP_HEADER_IF_MODIFIED_SINCE		"If-Modified-Since"
+#define URLCONF_HTTP_HEADER_IF_NONE_MATCH		"If-None-Match"
+#define URLCONF_HTTP_HEADER_IF_RANGE			"If-Range"
+#define URLCONF_HTTP_HEADER_IM				"IM"
 #define URLCONF_HTTP_HEADER_LAST_MODIFIED		"Last-Modified"
 #define URLCONF_HTTP_HEADER_USER_AGENT			"User-Agent"
+#define URLCONF_HTTP_HEADER_WANT_DIGEST			"Want-Digest"
 
 /* file response codes */
 #define URLCONF_FILE_RESPONSE_CODE_OK			0L
@@ -51,6 +63,8 @@
 #define URLCONF_HTTP_RESPONSE_CODE_OK			200L
 #define URLCONF_HTTP_RESPONSE_CODE_NO_CONTENT		204L
 #define URLCONF_HTTP_RESPONSE_CODE_PARTIAL_CONTENT	206L
+#define URLCONF_HTTP_RESPONSE_CODE_IM_USED		226L
+#define URLCONF_HTTP_RESPONSE_CODE_NOT_MODIFIED		304L
 
 #define URLCONF_HTTP_RESPONSE_CODE_BAD_REQUEST		400L
 #define URLCONF_HTTP_RESPONSE_CODE_UNAUTHORIZED		401L
@@ -58,6 +72,7 @@
 #define URLCONF_HTTP_RESPONSE_CODE_NOT_FOUND		404L
 #define URLCONF_HTTP_RESPONSE_CODE_METHOD_NOT_ALLOWED	405L
 #define URLCONF_HTTP_RESPONSE_CODE_PRECONDITION_FAILED	412L
+#define URLCONF_HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE	416L
 #define URLCONF_HTTP_RESPONSE_CODE_TOO_MANY_REQUESTS	429L
 
 #define URLCONF_HTTP_RESPONSE_CODE_INTERNAL_SERVER_ERROR	500L
@@ -67,11 +82,21 @@
 
 /* HTTP content types */
 #define URLCONF_HTTP_CONTENT_TYPE_TEXT_PLAIN		"text/plain"
+#define URLCONF_HTTP_CONTENT_TYPE_FORM	"application/x-www-form-urlencoded"
 
 void *urlconf_http_alloc(pool *p, unsigned long max_connect_secs,
   unsigned long max_request_secs, unsigned long flags);
 int urlconf_http_destroy(pool *p, void *http);
 
+/* Configures the CA certificates used to verify peers for the given handle
+ * (either may be NULL, for the defaults), and the client certificate/key
+ * to present (NULL for none).  These are loaded once, and shared by all
+ * handles using the same files.  Fails if the client certificate or key
+ * cannot be loaded.
+ */
+int urlconf_http_set_ssl(void *http, const char *ca_file, const char *ca_path,
+  const char *cert_file, const char *key_file);
+
 /* Return a table populated with the default request headers: Accept,
  * User-Agent, etc.
  */
@@ -81,6 +106,130 @@ int urlconf_http_get(pool *p, void *http, const char *url, pr_table_t *headers,
   size_t (*resp_body)(char *, size_t, size_t, void *), void *user_data,
   long *resp_code, const char **content_type);
 
+/* DNS settings, applied to all subsequently allocated handles.  The resolve
+ * list contains libcurl CURLOPT_RESOLVE entries ("host:port:address"); the
+ * IP version is 0 (any), 4, or 6; and a negative DNS cache TTL means use
+ * the libcurl default.
+ */
+int urlconf_http_set_dns(array_header *resolve, int ip_version,
+  long dns_cache_ttl);
+
+/* Concurrently resolves the hosts of the given URLs, populating the shared
+ * DNS cache.  No connections are made to the hosts.  The errnos array, if
+ * provided, is filled with the errno for each URL, or zero on success.
+ */
+int urlconf_http_resolve(pool *p, array_header *urls,
+  unsigned long max_connect_secs, int *errnos);
+
+/* As urlconf_http_get(), also collecting the response headers into the
+ * given table, keyed by lowercased header name.
+ */
+int urlconf_http_get_with_headers(pool *p, void *http, const char *url,
+  pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
+  void *user_data, long *resp_code, pr_table_t *resp_headers);
+
+/* POSTs the given data (e.g. a form) to the given URL. */
+int urlconf_http_post(pool *p, void *http, const char *url,
+  pr_table_t *headers, const char *data, size_t datalen,
+  size_t (*resp_body)(char *, size_t, size_t, void *), void *user_data,
+  long *resp_code);
+
+/* Configures the credentials for HTTP Basic authentication for the given
+ * handle; NULL for none.
+ */
+int urlconf_http_set_credentials(void *http, const char *username,
+  const char *password);
+
+/* Resumes an interrupted GET of the given URL, requesting only the content
+ * from the given offset onward (using a Range request for HTTP, or REST for
+ * FTP).  For HTTP, the If-Range validator, if any, is sent so that the
+ * server sends the entire content, rather than a mismatched remainder, if
+ * the content has changed since.  Any response headers are collected into
+ * the given table, if any.
+ */
+int urlconf_http_resume(pool *p, void *http, const char *url,
+  pr_table_t *headers, off_t offset, const char *if_range,
+  size_t (*resp_body)(char *, size_t, size_t, void *), void *user_data,
+  long *resp_code, pr_table_t *resp_headers);
+
+/* Requests a listing of the names (only) in the directory at the given
+ * URL; for FTP URLs, this uses NLST.
+ */
+int urlconf_http_list(pool *p, void *http, const char *url,
+  pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
+  void *user_data, long *resp_code);
+
+/* The timing of a transfer, or of several transfers for the same URL, as
+ * reported by libcurl, and other details useful for finding out why a
+ * fetch was slow.
+ */
+struct urlconf_http_timing {
+  unsigned int transfers;
+  double namelookup_secs;
+  double connect_secs;
+  double appconnect_secs;
+  double starttransfer_secs;
+  double total_secs;
+  double bytes;
+
+  /* Whether the (last) transfer reused a kept connection, and its HTTP
+   * version, e.g. CURL_HTTP_VERSION_1_1, if any.
+   */
+  int reused;
+  long http_version;
+};
+
+/* Adds the timing of the most recent transfer done by urlconf_http_get(),
+ * and the functions using it, to the given timing.
+ */
+int urlconf_http_add_timing(struct urlconf_http_timing *timing);
+
+/* Returns the text of the given HTTP version, as in the timing, e.g. "1.1",
+ * or NULL if unknown.
+ */
+const char *urlconf_http_version_text(long http_version);
+
+/* A request to be performed concurrently with others, via
+ * urlconf_http_get_many().  The flags, if any, are added to those given to
+ * urlconf_http_get_many(), as are the request headers, if any; if
+ * resp_headers is not NULL, the response headers are collected there, with
+ * their names and values allocated from resp_headers_pool (or, if that is
+ * NULL, the pool given to urlconf_http_get_many()).  The TLS settings, if any, are as for urlconf_http_set_ssl().  On return,
+ * resp_code is the response code, or xerrno the errno if the request
+ * failed.
+ */
+struct urlconf_http_req {
+  const char *url;
+  size_t (*resp_body)(char *, size_t, size_t, void *);
+  void *user_data;
+  unsigned long flags;
+  pr_table_t *headers;
+  pr_table_t *resp_headers;
+  pool *resp_headers_pool;
+
+  const char *ssl_ca_file;
+  const char *ssl_ca_path;
+  const char *ssl_cert;
+  const char *ssl_key;
+
+  long resp_code;
+  int xerrno;
+  struct urlconf_http_timing timing;
+};
+
+/* Maximum number of concurrent connections to a single host. */
+#define URLCONF_HTTP_MAX_HOST_CONNS	8L
+
+/* Performs the given requests (an array of struct urlconf_http_req
+ * pointers) concurrently, using handles allocated with the given settings.
+ */
+int urlconf_http_get_many(pool *p, array_header *reqs, pr_table_t *headers,
+  unsigned long max_connect_secs, unsigned long max_request_secs,
+  unsigned long flags);
+
+/* The libcurl fetch backend, the default. */
+extern const struct urlconf_backend urlconf_http_backend;
+
 /* API lifetime functions, for mod_conf_url use only. */
 int urlconf_http_init(pool *p, unsigned long *feature_flags);
 int urlconf_http_free(void);
@@ -0,0 +1,193 @@
+/*
+ * ProFTPD - mod_conf_url integrity checking
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "integrity.h"
+
+#if defined(PR_USE_OPENSSL)
+# include <openssl/evp.h>
+#endif /* PR_USE_OPENSSL */
+
+static const char *trace_channel = "conf_url";
+
+#if defined(PR_USE_OPENSSL)
+static const EVP_MD *integrity_get_md(const char *algo) {
+  if (strcmp(algo, "sha256") == 0) {
+    return EVP_sha256();
+  }
+
+  if (strcmp(algo, "sha384") == 0) {
+    return EVP_sha384();
+  }
+
+  if (strcmp(algo, "sha512") == 0) {
+    return EVP_sha512();
+  }
+
+  return NULL;
+}
+
+/* Returns the base64-encoded digest of the data, as used in the metadata. */
+static const char *integrity_digest(pool *p, const EVP_MD *md,
+    const char *data, size_t datalen) {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digestlen = 0;
+  char *encoded;
+
+  if (EVP_Digest(data, datalen, digest, &digestlen, md, NULL) != 1) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  /* Every 3 bytes become 4 characters, plus a terminating NUL. */
+  encoded = pcalloc(p, (((digestlen + 2) / 3) * 4) + 1);
+  EVP_EncodeBlock((unsigned char *) encoded, digest, (int) digestlen);
+
+  return encoded;
+}
+
+/* Compares the digests, allowing for the URL-safe base64 alphabet, and for
+ * omitted padding, in the expected digest.
+ */
+static int integrity_digest_eq(const char *actual, const char *expected) {
+  while (*actual != '\0' &&
+         *actual != '=') {
+    char c;
+
+    c = *expected;
+    if (c == '-') {
+      c = '+';
+
+    } else if (c == '_') {
+      c = '/';
+    }
+
+    if (c != *actual) {
+      return FALSE;
+    }
+
+    actual++;
+    expected++;
+  }
+
+  while (*expected == '=') {
+    expected++;
+  }
+
+  return *expected == '\0' ? TRUE : FALSE;
+}
+#endif /* PR_USE_OPENSSL */
+
+int urlconf_integrity_check(pool *p, const char *integrity, const char *data,
+    size_t datalen) {
+#if defined(PR_USE_OPENSSL)
+  char *metadata, *ptr;
+  int supported = 0;
+
+  if (p == NULL ||
+      integrity == NULL ||
+      data == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  metadata = pstrdup(p, integrity);
+  ptr = metadata;
+
+  while (*ptr != '\0') {
+    char *algo, *expected, *opts;
+    const EVP_MD *md;
+    const char *actual;
+
+    pr_signals_handle();
+
+    algo = pr_str_get_word(&ptr, 0);
+    if (algo == NULL) {
+      break;
+    }
+
+    expected = strchr(algo, '-');
+    if (expected == NULL ||
+        expected[1] == '\0') {
+      pr_trace_msg(trace_channel, 3, "malformed integrity metadata '%s'",
+        algo);
+      errno = EINVAL;
+      return -1;
+    }
+
+    *expected++ = '\0';
+
+    /* Ignore any options, per the Subresource Integrity spec. */
+    opts = strchr(expected, '?');
+    if (opts != NULL) {
+      *opts = '\0';
+    }
+
+    md = integrity_get_md(algo);
+    if (md == NULL) {
+      pr_trace_msg(trace_channel, 9,
+        "ignoring unsupported integrity algorithm '%s'", algo);
+      continue;
+    }
+
+    supported++;
+
+    actual = integrity_digest(p, md, data, datalen);
+    if (actual == NULL) {
+      continue;
+    }
+
+    if (integrity_digest_eq(actual, expected) == TRUE) {
+      pr_trace_msg(trace_channel, 15, "data (%lu bytes) match %s digest",
+        (unsigned long) datalen, algo);
+      return 0;
+    }
+
+    pr_trace_msg(trace_channel, 3,
+      "data (%lu bytes) do not match expected %s digest (expected %s, "
+      "got %s)", (unsigned long) datalen, algo, expected, actual);
+  }
+
+  if (supported == 0) {
+    pr_trace_msg(trace_channel, 3,
+      "no supported algorithms in integrity metadata '%s'", integrity);
+    errno = EINVAL;
+    return -1;
+  }
+
+  errno = EACCES;
+  return -1;
+#else
+  (void) p;
+  (void) integrity;
+  (void) data;
+  (void) datalen;
+
+  pr_trace_msg(trace_channel, 3,
+    "unable to check integrity metadata: OpenSSL support required");
+  errno = ENOSYS;
+  return -1;
+#endif /* PR_USE_OPENSSL */
+}
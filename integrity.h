@@ -0,0 +1,41 @@
+/*
+ * ProFTPD - mod_conf_url integrity checking
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_INTEGRITY_H
+#define MOD_CONF_URL_INTEGRITY_H
+
+/* Checks the given data against the expected digests, using the format of
+ * Subresource Integrity metadata, e.g. "sha256-<base64 digest>", with
+ * multiple digests separated by spaces.  Returns 0 if the data match any of
+ * the supported digests, or -1 with errno set to EACCES if they do not;
+ * EINVAL for malformed metadata; or ENOSYS if no digest algorithms are
+ * available.
+ */
+int urlconf_integrity_check(pool *p, const char *integrity, const char *data,
+  size_t datalen);
+
+#endif /* MOD_CONF_URL_INTEGRITY_H */
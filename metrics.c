@@ -0,0 +1,250 @@
+/*
+ * ProFTPD - mod_conf_url fetch metrics
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "metrics.h"
+
+#ifdef HAVE_CURL_CURL_H
+# include <curl/curl.h>
+#endif
+
+static int metrics_fd = -1;
+static const char *metrics_path = NULL;
+static pool *metrics_parent_pool = NULL;
+static pool *metrics_pool = NULL;
+
+static const char *trace_channel = "conf_url";
+
+int urlconf_metrics_open(const char *path) {
+  int fd = -1, res, xerrno;
+
+  if (path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (metrics_fd >= 0 &&
+      strcmp(metrics_path, path) == 0) {
+    return 0;
+  }
+
+  (void) urlconf_metrics_close();
+
+  PRIVS_ROOT
+  res = pr_log_openfile(path, &fd, 0600);
+  xerrno = errno;
+  PRIVS_RELINQUISH
+
+  if (res < 0) {
+    if (res == -1) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": unable to open metrics log '%s': %s", path, strerror(xerrno));
+
+    } else if (res == PR_LOG_WRITABLE_DIR) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": unable to open metrics log '%s': parent directory is "
+        "world-writable", path);
+      xerrno = EPERM;
+
+    } else if (res == PR_LOG_SYMLINK) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": unable to open metrics log '%s': cannot log to a symlink", path);
+      xerrno = EPERM;
+    }
+
+    errno = xerrno;
+    return -1;
+  }
+
+  metrics_pool = make_sub_pool(metrics_parent_pool);
+  pr_pool_tag(metrics_pool, MOD_CONF_URL_VERSION ": Metrics Pool");
+
+  metrics_fd = fd;
+  metrics_path = pstrdup(metrics_pool, path);
+
+  pr_trace_msg(trace_channel, 9, "opened metrics log '%s'", path);
+  return 0;
+}
+
+/* Returns the text as a JSON string, quoted and escaped. */
+static const char *metrics_json_str(pool *p, const char *text) {
+  char *buf, *ptr;
+
+  if (text == NULL) {
+    return "null";
+  }
+
+  /* In the worst case, each character becomes a \u00XX escape. */
+  buf = ptr = palloc(p, (strlen(text) * 6) + 3);
+  *ptr++ = '"';
+
+  for (; *text != '\0'; text++) {
+    unsigned char c;
+
+    c = (unsigned char) *text;
+    if (c == '"' ||
+        c == '\\') {
+      *ptr++ = '\\';
+      *ptr++ = c;
+
+    } else if (c < 0x20) {
+      snprintf(ptr, 7, "\\u%04x", c);
+      ptr += 6;
+
+    } else {
+      *ptr++ = c;
+    }
+  }
+
+  *ptr++ = '"';
+  *ptr = '\0';
+
+  return buf;
+}
+
+/* Returns the URL without any credentials. */
+static const char *metrics_url(pool *p, const char *url) {
+  const char *host, *at, *slash;
+
+  host = strstr(url, "://");
+  if (host == NULL) {
+    return url;
+  }
+
+  host += 3;
+  at = strchr(host, '@');
+  slash = strchr(host, '/');
+  if (at == NULL ||
+      (slash != NULL && slash < at)) {
+    return url;
+  }
+
+  return pstrcat(p, pstrndup(p, url, host - url), at + 1, NULL);
+}
+
+static const char *metrics_http_version(pool *p, long http_version) {
+  const char *version_text;
+
+  version_text = urlconf_http_version_text(http_version);
+  if (version_text == NULL) {
+    return "null";
+  }
+
+  return pstrcat(p, "\"", version_text, "\"", NULL);
+}
+
+int urlconf_metrics_log(pool *p, const struct urlconf_metrics *metrics) {
+  struct timeval tv;
+  struct urlconf_http_timing timing;
+  const char *line;
+  char text[1024];
+  size_t len;
+
+  if (p == NULL ||
+      metrics == NULL ||
+      metrics->url == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (metrics_fd < 0) {
+    return 0;
+  }
+
+  memset(&timing, 0, sizeof(timing));
+  if (metrics->timing != NULL) {
+    memcpy(&timing, metrics->timing, sizeof(timing));
+  }
+
+  gettimeofday(&tv, NULL);
+
+  memset(text, '\0', sizeof(text));
+  snprintf(text, sizeof(text)-1, "\"time\":%lu.%03lu,\"pid\":%lu,"
+    "\"cache\":%s,\"prefetched\":%s,\"error\":%s,\"size\":%lu,"
+    "\"transfers\":%u,\"namelookup\":%0.6f,\"connect\":%0.6f,"
+    "\"appconnect\":%0.6f,\"starttransfer\":%0.6f,\"total\":%0.6f,"
+    "\"bytes\":%0.0f,\"reused\":%s,\"http_version\":%s,"
+    "\"alloc_bytes\":%lu,\"maxrss_growth\":%ld}\n",
+    (unsigned long) tv.tv_sec, (unsigned long) (tv.tv_usec / 1000),
+    (unsigned long) getpid(), metrics_json_str(p, metrics->cache),
+    metrics->prefetched ? "true" : "false",
+    metrics->xerrno != 0 ? metrics_json_str(p, strerror(metrics->xerrno)) :
+      "null",
+    (unsigned long) metrics->size, timing.transfers, timing.namelookup_secs,
+    timing.connect_secs, timing.appconnect_secs, timing.starttransfer_secs,
+    timing.total_secs, timing.bytes,
+    timing.transfers > 0 ? (timing.reused ? "true" : "false") : "null",
+    metrics_http_version(p, timing.http_version),
+    (unsigned long) metrics->alloc_bytes, metrics->maxrss_growth);
+
+  line = pstrcat(p, "{\"url\":",
+    metrics_json_str(p, metrics_url(p, metrics->url)), ",", text, NULL);
+  len = strlen(line);
+
+  /* The log is opened for appending, so that each line is written whole. */
+  if (write(metrics_fd, line, len) != (ssize_t) len) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error writing to metrics log '%s': %s",
+      metrics_path, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return 0;
+}
+
+int urlconf_metrics_close(void) {
+  if (metrics_fd >= 0) {
+    (void) close(metrics_fd);
+    metrics_fd = -1;
+  }
+
+  if (metrics_pool != NULL) {
+    destroy_pool(metrics_pool);
+    metrics_pool = NULL;
+  }
+
+  metrics_path = NULL;
+  return 0;
+}
+
+int urlconf_metrics_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  metrics_parent_pool = p;
+  return 0;
+}
+
+int urlconf_metrics_free(void) {
+  (void) urlconf_metrics_close();
+
+  metrics_parent_pool = NULL;
+  return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * ProFTPD - mod_conf_url fetch metrics
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "http.h"
+
+#ifndef MOD_CONF_URL_METRICS_H
+#define MOD_CONF_URL_METRICS_H
+
+/* The details of fetching a URL for the configuration parser. */
+struct urlconf_metrics {
+  const char *url;
+
+  /* How the cache was used, e.g. "hit", "miss", "revalidated", or "none";
+   * and whether the content was fetched in advance.
+   */
+  const char *cache;
+  int prefetched;
+
+  /* The errno of a failed fetch, else zero. */
+  int xerrno;
+
+  /* The size of the content, and the timing of the transfers (if any) done
+   * to fetch it.
+   */
+  size_t size;
+  const struct urlconf_http_timing *timing;
+
+  /* The bytes allocated for buffering the content, including buffers
+   * outgrown while receiving it, and the growth, in KB, of the peak resident
+   * set size of the process while fetching it.
+   */
+  size_t alloc_bytes;
+  long maxrss_growth;
+};
+
+/* Opens the given metrics log, to which a JSON object per fetch is written,
+ * one per line.
+ */
+int urlconf_metrics_open(const char *path);
+
+/* Writes the given metrics to the metrics log, if open. */
+int urlconf_metrics_log(pool *p, const struct urlconf_metrics *metrics);
+
+/* Closes the metrics log, if open. */
+int urlconf_metrics_close(void);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_metrics_init(pool *p);
+int urlconf_metrics_free(void);
+
+#endif /* MOD_CONF_URL_METRICS_H */
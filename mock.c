@@ -0,0 +1,400 @@
+/*
+ * ProFTPD - mod_conf_url mock fetch backend
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "http.h"
+#include "mock.h"
+
+static const char *trace_channel = "conf_url";
+
+struct mock_resp {
+  long resp_code;
+  char *data;
+  size_t datalen;
+};
+
+static pool *mock_parent_pool = NULL;
+static pool *mock_pool = NULL;
+static pr_table_t *mock_resps = NULL;
+
+static unsigned long mock_latency_ms = 0;
+static size_t mock_chunksz = 0;
+static unsigned long mock_requests = 0;
+
+int urlconf_mock_add(const char *url, long resp_code, const char *data,
+    size_t datalen) {
+  struct mock_resp *resp;
+
+  if (url == NULL ||
+      (data == NULL && datalen > 0)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (mock_pool == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  resp = pcalloc(mock_pool, sizeof(struct mock_resp));
+  resp->resp_code = resp_code;
+  resp->data = palloc(mock_pool, datalen + 1);
+  if (datalen > 0) {
+    memcpy(resp->data, data, datalen);
+  }
+  resp->data[datalen] = '\0';
+  resp->datalen = datalen;
+
+  (void) pr_table_remove(mock_resps, url, NULL);
+  if (pr_table_add(mock_resps, pstrdup(mock_pool, url), resp,
+      sizeof(struct mock_resp *)) < 0) {
+    return -1;
+  }
+
+  return 0;
+}
+
+/* Parses a decimal number, the whole of the given text. */
+static int mock_parse_number(const char *text, size_t textlen,
+    unsigned long *num) {
+  char buf[32], *endp = NULL;
+
+  if (textlen == 0 ||
+      textlen >= sizeof(buf) ||
+      *text == '-') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memcpy(buf, text, textlen);
+  buf[textlen] = '\0';
+
+  *num = strtoul(buf, &endp, 10);
+  if (endp == NULL ||
+      *endp != '\0') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+int urlconf_mock_load(pool *p, const char *path) {
+  int fd, xerrno;
+  struct stat st;
+  char *buf;
+  const char *ptr, *end;
+  size_t buflen = 0, magiclen;
+  unsigned int count = 0;
+
+  if (p == NULL ||
+      path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  buf = palloc(p, st.st_size + 1);
+  while (buflen < (size_t) st.st_size) {
+    ssize_t res;
+
+    res = read(fd, buf + buflen, st.st_size - buflen);
+    if (res < 0) {
+      xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      (void) close(fd);
+
+      errno = xerrno;
+      return -1;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    buflen += res;
+  }
+
+  (void) close(fd);
+  buf[buflen] = '\0';
+
+  magiclen = strlen(URLCONF_MOCK_MAGIC);
+  if (buflen < magiclen ||
+      strncmp(buf, URLCONF_MOCK_MAGIC, magiclen) != 0) {
+    pr_trace_msg(trace_channel, 3, "'%s' is not a mock responses file", path);
+    errno = EINVAL;
+    return -1;
+  }
+
+  ptr = buf + magiclen;
+  end = buf + buflen;
+
+  while (ptr < end) {
+    const char *eol, *sp1, *sp2, *body;
+    unsigned long resp_code, len;
+
+    pr_signals_handle();
+
+    eol = memchr(ptr, '\n', end - ptr);
+    if (eol == NULL) {
+      break;
+    }
+
+    /* Each response has a header line of "<url> <code> <length>". */
+    sp2 = eol;
+    while (sp2 > ptr &&
+           *sp2 != ' ') {
+      sp2--;
+    }
+
+    sp1 = sp2;
+    if (sp1 > ptr) {
+      sp1--;
+      while (sp1 > ptr &&
+             *sp1 != ' ') {
+        sp1--;
+      }
+    }
+
+    if (sp1 == ptr ||
+        mock_parse_number(sp1 + 1, sp2 - sp1 - 1, &resp_code) < 0 ||
+        mock_parse_number(sp2 + 1, eol - sp2 - 1, &len) < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "invalid response header '%.*s' in '%s'", (int) (eol - ptr), ptr,
+        path);
+      errno = EINVAL;
+      return -1;
+    }
+
+    body = eol + 1;
+    if ((size_t) (end - body) < len) {
+      pr_trace_msg(trace_channel, 3, "truncated response for '%.*s' in '%s'",
+        (int) (sp1 - ptr), ptr, path);
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (urlconf_mock_add(pstrndup(p, ptr, sp1 - ptr), (long) resp_code, body,
+        len) < 0) {
+      return -1;
+    }
+
+    count++;
+
+    ptr = body + len;
+    if (ptr < end &&
+        *ptr == '\n') {
+      ptr++;
+    }
+  }
+
+  pr_trace_msg(trace_channel, 9, "loaded %u mock %s from '%s'", count,
+    count != 1 ? "responses" : "response", path);
+  return 0;
+}
+
+int urlconf_mock_set_latency(unsigned long latency_ms) {
+  mock_latency_ms = latency_ms;
+  return 0;
+}
+
+int urlconf_mock_set_chunk_size(size_t chunksz) {
+  mock_chunksz = chunksz;
+  return 0;
+}
+
+unsigned long urlconf_mock_get_requests(void) {
+  return mock_requests;
+}
+
+static unsigned long mock_capabilities(void) {
+  return 0UL;
+}
+
+static void *mock_alloc(pool *p, unsigned long max_connect_secs,
+    unsigned long max_request_secs, unsigned long flags) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* There is no per-handle state; any non-NULL pointer will do. */
+  return pcalloc(p, sizeof(int));
+}
+
+static int mock_get(pool *p, void *handle, const char *url,
+    pr_table_t *headers, size_t (*resp_body)(char *, size_t, size_t, void *),
+    void *user_data, long *resp_code, pr_table_t *resp_headers) {
+  const struct mock_resp *resp;
+  size_t offset = 0;
+
+  if (p == NULL ||
+      handle == NULL ||
+      url == NULL ||
+      resp_body == NULL ||
+      resp_code == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (mock_resps == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  mock_requests++;
+
+  if (mock_latency_ms > 0) {
+    (void) pr_timer_usleep(mock_latency_ms * 1000);
+  }
+
+  resp = pr_table_get(mock_resps, url, NULL);
+  if (resp == NULL) {
+    pr_trace_msg(trace_channel, 15, "no mock response for '%s'", url);
+
+    /* As libcurl fails to open a missing local file. */
+    if (strncmp(url, "file://", 7) == 0) {
+      errno = ENOENT;
+      return -1;
+    }
+
+    *resp_code = strncmp(url, "ftp", 3) == 0 ?
+      URLCONF_FTP_RESPONSE_CODE_NOT_FOUND :
+      URLCONF_HTTP_RESPONSE_CODE_NOT_FOUND;
+    return 0;
+  }
+
+  if (resp_headers != NULL) {
+    char len_text[32];
+
+    memset(len_text, '\0', sizeof(len_text));
+    snprintf(len_text, sizeof(len_text)-1, "%lu",
+      (unsigned long) resp->datalen);
+    (void) pr_table_add_dup(resp_headers, "content-length", len_text, 0);
+  }
+
+  while (offset < resp->datalen) {
+    size_t len;
+
+    len = resp->datalen - offset;
+    if (mock_chunksz > 0 &&
+        len > mock_chunksz) {
+      len = mock_chunksz;
+    }
+
+    /* As libcurl does, treat a short write as an error. */
+    if (resp_body(resp->data + offset, 1, len, user_data) != len) {
+      pr_trace_msg(trace_channel, 3, "mock response for '%s' not consumed",
+        url);
+      errno = EPERM;
+      return -1;
+    }
+
+    offset += len;
+  }
+
+  pr_trace_msg(trace_channel, 15,
+    "served %lu byte mock response (code %ld) for '%s'",
+    (unsigned long) resp->datalen, resp->resp_code, url);
+
+  *resp_code = resp->resp_code;
+  return 0;
+}
+
+static int mock_destroy(pool *p, void *handle) {
+  if (handle == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  return 0;
+}
+
+const struct urlconf_backend urlconf_mock_backend = {
+  "mock",
+  mock_capabilities,
+  mock_alloc,
+  mock_get,
+  mock_destroy
+};
+
+int urlconf_mock_clear(void) {
+  if (mock_parent_pool == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (mock_pool != NULL) {
+    destroy_pool(mock_pool);
+  }
+
+  mock_pool = make_sub_pool(mock_parent_pool);
+  pr_pool_tag(mock_pool, "URL Configuration Mock Pool");
+  mock_resps = pr_table_alloc(mock_pool, 0);
+
+  mock_latency_ms = 0;
+  mock_chunksz = 0;
+  mock_requests = 0;
+  return 0;
+}
+
+int urlconf_mock_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  mock_parent_pool = p;
+  mock_pool = NULL;
+  return urlconf_mock_clear();
+}
+
+int urlconf_mock_free(void) {
+  if (mock_pool != NULL) {
+    destroy_pool(mock_pool);
+    mock_pool = NULL;
+  }
+
+  mock_parent_pool = NULL;
+  mock_resps = NULL;
+  return 0;
+}
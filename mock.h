@@ -0,0 +1,71 @@
+/*
+ * ProFTPD - mod_conf_url mock fetch backend
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "backend.h"
+
+#ifndef MOD_CONF_URL_MOCK_H
+#define MOD_CONF_URL_MOCK_H
+
+/* A backend which serves programmed responses from memory, without any
+ * network I/O, for measuring the cost of mod_conf_url itself.
+ */
+extern const struct urlconf_backend urlconf_mock_backend;
+
+/* Programs the response for the given URL; any previous response for that
+ * URL is replaced.
+ */
+int urlconf_mock_add(const char *url, long resp_code, const char *data,
+  size_t datalen);
+
+/* Programs the responses read from the given file, which looks like:
+ *
+ *  URLCONF-MOCK 1
+ *  <url> <response code> <length>
+ *  <data>
+ *  ...
+ */
+#define URLCONF_MOCK_MAGIC	"URLCONF-MOCK 1\n"
+
+int urlconf_mock_load(pool *p, const char *path);
+
+/* Sets the delay, in milliseconds, before each response, and the size of
+ * the chunks in which response bodies are delivered (zero for the entire
+ * body at once).
+ */
+int urlconf_mock_set_latency(unsigned long latency_ms);
+int urlconf_mock_set_chunk_size(size_t chunksz);
+
+/* Returns the number of requests made of the mock backend. */
+unsigned long urlconf_mock_get_requests(void);
+
+/* Discards all programmed responses, and resets the settings. */
+int urlconf_mock_clear(void);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_mock_init(pool *p);
+int urlconf_mock_free(void);
+
+#endif /* MOD_CONF_URL_MOCK_H */
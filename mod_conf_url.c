@@ -30,8 +30,27 @@
  */
 
 #include "mod_conf_url.h"
+#include "backend.h"
 #include "http.h"
 #include "uri.h"
+#include "cache.h"
+#include "breaker.h"
+#include "tls.h"
+#include "integrity.h"
+#include "delta.h"
+#include "watch.h"
+#include "state.h"
+#include "metrics.h"
+#include "mock.h"
+#include "stats.h"
+#include "token.h"
+#include "fleet.h"
+#include "compress.h"
+#include "utils.h"
+
+#if defined(PR_USE_CTRLS)
+# include <mod_ctrls.h>
+#endif /* PR_USE_CTRLS */
 
 /* Fake fd number for FSIO needs. */
 #define URLCONF_FILENO		7642
@@ -40,54 +59,299 @@
 #define URLCONF_CONNECT_TIMEOUT	3UL
 #define URLCONF_REQUEST_TIMEOUT	10UL
 
+/* How often, in millisecs, to check whether another node has filled the
+ * fleet cache for a URL, while waiting for it.
+ */
+#define URLCONF_FLEET_POLL_MSECS	100UL
+
+/* Maximum number of times to retry a failed transfer. */
+#define URLCONF_MAX_RETRIES	10UL
+
+/* The first line of a bundle, identifying the format and its version. */
+#define URLCONF_BUNDLE_MAGIC	"URLCONF-BUNDLE 1\n"
+
 module conf_url_module;
 pool *urlconf_pool = NULL;
 
+#if defined(PR_USE_CTRLS)
+static ctrls_acttab_t urlconf_acttab[];
+#endif /* PR_USE_CTRLS */
+
+/* Pool for state which lasts only for the duration of a configuration
+ * parse; destroyed in the core.postparse event listener.
+ */
+static pool *urlconf_parse_pool = NULL;
+
 static unsigned long urlconf_flags = 0UL;
 
-/* List of URL schemes that we will support/honor. */
-static const char *urlconf_schemes[] = {
-  "https://",
-  "http://",
-  "ftps://",
-  "ftp://",
-  "file://",
-  NULL
+/* List of URL schemes that we will support/honor.  Schemes with the same
+ * first byte must be adjacent, for urlconf_scheme_index.
+ */
+struct urlconf_scheme {
+  const char *name;
+  size_t namelen;
+
+  /* Whether the scheme needs libcurl's SSL support. */
+  int use_ssl;
+};
+
+static const struct urlconf_scheme urlconf_schemes[] = {
+  { "https://",	8, TRUE },
+  { "http://",	7, FALSE },
+  { "ftps://",	7, TRUE },
+  { "ftp://",	6, FALSE },
+  { "file://",	7, FALSE },
+  { NULL, 0, FALSE }
 };
 
+/* For each first byte of a path (either case), the index plus one of the
+ * first scheme starting with that byte; zero if none do.  Every stat, open,
+ * and read of a registered scheme comes through us, so this check needs to
+ * be cheap, even for configurations with many thousands of URLs.
+ */
+static unsigned char urlconf_scheme_index[256];
+
 struct urlconf_data {
   pool *pool;
   int ftps;
+  int ftps_data;
   int ssl_verify;
+  const char *ssl_ca_file;
+  const char *ssl_ca_path;
+  const char *ssl_cert;
+  const char *ssl_key;
+
+  /* Whether the response is a bundle of the configuration and its
+   * included files.
+   */
+  int bundle;
+
+  /* The expected digest(s) of the response, as Subresource Integrity
+   * metadata, and whether the response came from the content store.
+   */
+  const char *integrity;
+  int integrity_stored;
+
+  /* How to watch the URL for changes, if at all, and the response headers
+   * needed for doing so.
+   */
+  int watch_type;
+  pr_table_t *resp_headers;
+
+  /* Whether the response came from a bundle. */
+  int bundled;
+
+  /* How many times to retry a failed transfer, resuming it if possible. */
+  unsigned int retries;
+
+  /* Which HTTP version to prefer for HTTPS URLs, e.g. 2 or 3; zero for
+   * HTTP/1.1.
+   */
+  int http_version;
+
+  /* Whether to request only the changes to the cached response. */
+  int delta;
 
+  /* For the metrics log: how the cache was used, whether the response was
+   * fetched in advance, and the timing of the transfers done for it.
+   */
+  const char *cache;
+  int prefetched;
+  struct urlconf_http_timing timing;
+
+  /* The scheme, host, and port of the URL, for remembering failures. */
+  const char *host;
+  const char *username;
+
+  /* The response body; ptr is the read cursor into buf. */
   char *ptr, *buf;
   size_t bufsz, buflen;
+
+  /* A response body kept compressed, and the handle for inflating it as it
+   * is read; buf is then NULL, and buflen is its inflated length.
+   */
+  char *zbuf;
+  size_t zbuflen;
+  void *zh;
+
+  /* The bytes allocated for buffering the response, including buffers
+   * since outgrown or discarded.
+   */
+  size_t alloc_bytes;
+};
+
+/* A directory handle, for expanding wildcard Includes. */
+struct urlconf_dir {
+  pool *pool;
+
+  /* For local paths, e.g. "file://" URLs. */
+  DIR *dirh;
+
+  /* For remote URLs, the names listed by the server. */
+  array_header *names;
+  unsigned int idx;
+
+  struct dirent *dent;
+};
+
+/* The names listed for a directory URL, kept so that the matching entries
+ * can be fetched concurrently, rather than one at a time.
+ */
+struct urlconf_listing {
+  array_header *names;
+  int prefetched;
+};
+
+/* A response body fetched in advance, keyed by URL. */
+struct urlconf_body {
+  char *buf;
+  size_t buflen;
+
+  /* If nonzero, buf holds the compressed body, of this length; buflen is
+   * its inflated length.
+   */
+  size_t zbuflen;
+
+  /* Whether this is a member of a bundle, rather than fetched. */
+  int bundled;
+
+  /* The response headers, if kept. */
+  pr_table_t *resp_headers;
+
+  /* For the metrics log. */
+  const char *cache;
+  struct urlconf_http_timing *timing;
+  size_t alloc_bytes;
 };
 
 static int use_tracing = FALSE;
 
+/* Whether the configuration is being parsed again, on restart. */
+static int urlconf_restarting = FALSE;
+
+/* Shared cache directory, for coalescing fetches of the same URL by multiple
+ * processes.  Once set, via the "cache_dir" parameter, it applies to all
+ * URLs for the rest of the configuration parse.
+ */
+static const char *urlconf_cache_dir = NULL;
+static unsigned long urlconf_cache_ttl = URLCONF_CACHE_DEFAULT_TTL;
+
+/* Fleet cache server ("host:port"), shared by nearby nodes, and checked
+ * before the origin.  Once set, via the "fleet_cache" parameter, it applies
+ * to all URLs for the rest of the configuration parse.
+ */
+static int urlconf_fleet_set = FALSE;
+
+/* Whether only URLs with integrity metadata use the fleet cache, for the
+ * rest of the configuration parse.  Anything which can reach the fleet
+ * cache can write to it; only integrity metadata let us check what it
+ * gives us.
+ */
+static int urlconf_fleet_require_integrity = FALSE;
+
+/* Whether to keep response bodies fetched in advance compressed, until
+ * read, for the rest of the configuration parse.
+ */
+static int urlconf_compress_bodies = FALSE;
+
+/* DNS settings, for the rest of the configuration parse. */
+static array_header *urlconf_resolve = NULL;
+static int urlconf_ip_version = 0;
+static long urlconf_dns_cache_ttl = -1;
+static int urlconf_dns_prefetch = FALSE;
+
+/* Interval, in seconds, at which to poll all of the URLs used by the
+ * configuration for changes; zero to not poll.
+ */
+static unsigned long urlconf_watch_interval = 0;
+
+/* Hosts already resolved in advance, keyed by urlconf_host_key(). */
+static pr_table_t *urlconf_prefetched_hosts = NULL;
+
+/* Handles kept for reuse for the rest of the configuration parse, so that
+ * connections (e.g. logged-in FTP control connections) to the same server
+ * are reused for later URLs.
+ */
+static pr_table_t *urlconf_handles = NULL;
+
+/* Directory listings, and the response bodies fetched in advance for their
+ * entries, for the rest of the configuration parse.
+ */
+static pr_table_t *urlconf_listings = NULL;
+static pr_table_t *urlconf_bodies = NULL;
+
+/* The state file in which to record the include graph, whether it was set
+ * by the current configuration parse, and whether its recorded URLs have
+ * been fetched in advance for this parse.  The path is kept, in its own
+ * pool, across restarts.
+ */
+static pool *urlconf_state_pool = NULL;
+static const char *urlconf_state_path = NULL;
+static int urlconf_state_path_set = FALSE;
+static int urlconf_warmed_up = FALSE;
+
+/* Whether a metrics log is open, for the rest of the configuration parse. */
+static int urlconf_metrics_log_set = FALSE;
+
+/* The origin (scheme, host, and port) of the URL which set the token
+ * endpoint; only requests to that origin carry a bearer token, for the rest
+ * of the configuration parse.  NULL if tokens are not used.
+ */
+static const char *urlconf_token_origin = NULL;
+
+/* The URLs currently open, innermost last, for knowing which URL included
+ * which.
+ */
+static array_header *urlconf_open_urls = NULL;
+
+/* The memory used by the URLs opened by the configuration parse: how many,
+ * their content and buffer bytes, and the peak resident set size, in KB,
+ * before the first was opened.
+ */
+static unsigned int urlconf_mem_urls = 0;
+static unsigned long long urlconf_mem_size = 0;
+static unsigned long long urlconf_mem_alloc_bytes = 0;
+static long urlconf_mem_maxrss = -1;
+
+/* The time spent opening those URLs, in microseconds. */
+static unsigned long long urlconf_mem_open_usecs = 0;
+
 static const char *trace_channel = "conf_url";
 
 /* Prototypes */
 static void urlconf_fs_register(pool *p);
 static void urlconf_fs_unregister(void);
+static void urlconf_free_handles(void);
+
+static pool *urlconf_get_parse_pool(void) {
+  if (urlconf_parse_pool == NULL) {
+    urlconf_parse_pool = make_sub_pool(urlconf_pool);
+    pr_pool_tag(urlconf_parse_pool, MOD_CONF_URL_VERSION ": Parse Pool");
+  }
+
+  return urlconf_parse_pool;
+}
 
 static int urlconf_scheme_supported(const char *path) {
   register unsigned int i;
+  unsigned char first;
 
-  for (i = 0; urlconf_schemes[i]; i++) {
-    const char *scheme;
-    size_t scheme_len;
-
-    scheme = urlconf_schemes[i];
-    scheme_len = strlen(scheme);
+  first = (unsigned char) *path;
+  if (urlconf_scheme_index[first] == 0) {
+    return FALSE;
+  }
 
-    if (strncasecmp(path, scheme, scheme_len) == 0) {
-      if (urlconf_flags & URLCONF_FL_CURL_NO_SSL) {
-        if (strcmp(scheme, "https://") == 0 ||
-            strcmp(scheme, "ftps://") == 0) {
-          continue;
-        }
+  for (i = urlconf_scheme_index[first] - 1;
+       urlconf_schemes[i].name != NULL &&
+       urlconf_schemes[i].name[0] == tolower(first);
+       i++) {
+    const struct urlconf_scheme *scheme;
+
+    scheme = &(urlconf_schemes[i]);
+    if (strncasecmp(path, scheme->name, scheme->namelen) == 0) {
+      if (scheme->use_ssl == TRUE &&
+          (urlconf_flags & URLCONF_FL_CURL_NO_SSL)) {
+        continue;
       }
 
       return TRUE;
@@ -147,8 +411,146 @@ static int urlconf_update_uri(pool *p, char **uri, pr_table_t *params) {
   return 0;
 }
 
-static int urlconf_parse_uri(pool *p, char **uri, int *ftps, int *tracing,
-    int *ssl_verify) {
+static int urlconf_parse_number(const char *text, unsigned long *num) {
+  char *ptr = NULL;
+  unsigned long val;
+
+  if (*text == '\0' ||
+      *text == '-') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  val = strtoul(text, &ptr, 10);
+  if (ptr == NULL ||
+      *ptr != '\0') {
+    errno = EINVAL;
+    return -1;
+  }
+
+  *num = val;
+  return 0;
+}
+
+/* Returns the key identifying the origin of a URL, e.g. for remembering
+ * failures: the scheme, host, and port (if any).
+ */
+static const char *urlconf_host_key(pool *p, const char *scheme,
+    const char *host, unsigned int port) {
+  char port_text[16];
+
+  if (strcmp(scheme, "file://") == 0) {
+    return scheme;
+  }
+
+  if (port == 0) {
+    return pstrcat(p, scheme, host, NULL);
+  }
+
+  memset(port_text, '\0', sizeof(port_text));
+  snprintf(port_text, sizeof(port_text)-1, ":%u", port);
+  return pstrcat(p, scheme, host, port_text, NULL);
+}
+
+static int urlconf_parse_dns_params(pr_table_t *params) {
+  int dns_changed = FALSE;
+  const void *v;
+
+  /* The "resolve" parameter is a comma-separated list of "host:port:address"
+   * entries, pinning those hosts to those addresses.
+   */
+  v = pr_table_get(params, "resolve", NULL);
+  if (v != NULL) {
+    pool *parse_pool;
+    char *resolve, *entry;
+
+    parse_pool = urlconf_get_parse_pool();
+    if (urlconf_resolve == NULL) {
+      urlconf_resolve = make_array(parse_pool, 1, sizeof(char *));
+    }
+
+    resolve = pstrdup(parse_pool, v);
+    entry = strsep(&resolve, ",");
+    while (entry != NULL) {
+      pr_signals_handle();
+
+      if (*entry != '\0') {
+        if (strchr(entry, ':') == NULL) {
+          pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+            ": badly formatted resolve entry '%s', ignoring", entry);
+
+        } else {
+          *((char **) push_array(urlconf_resolve)) = entry;
+        }
+      }
+
+      entry = strsep(&resolve, ",");
+    }
+
+    dns_changed = TRUE;
+    (void) pr_table_remove(params, "resolve", NULL);
+  }
+
+  v = pr_table_get(params, "ip_version", NULL);
+  if (v != NULL) {
+    if (strcmp(v, "4") == 0) {
+      urlconf_ip_version = 4;
+
+    } else if (strcmp(v, "6") == 0) {
+      urlconf_ip_version = 6;
+
+    } else if (strcasecmp(v, "any") == 0) {
+      urlconf_ip_version = 0;
+
+    } else {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid ip_version '%s' (expected 4, 6, or any), ignoring",
+        (const char *) v);
+    }
+
+    dns_changed = TRUE;
+    (void) pr_table_remove(params, "ip_version", NULL);
+  }
+
+  v = pr_table_get(params, "dns_cache_ttl", NULL);
+  if (v != NULL) {
+    unsigned long ttl;
+
+    if (urlconf_parse_number(v, &ttl) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid dns_cache_ttl '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_dns_cache_ttl = (long) ttl;
+    }
+
+    dns_changed = TRUE;
+    (void) pr_table_remove(params, "dns_cache_ttl", NULL);
+  }
+
+  v = pr_table_get(params, "dns_prefetch", NULL);
+  if (v != NULL) {
+    int res;
+
+    res = pr_str_is_boolean(v);
+    if (res == TRUE ||
+        res == FALSE) {
+      urlconf_dns_prefetch = res;
+    }
+
+    (void) pr_table_remove(params, "dns_prefetch", NULL);
+  }
+
+  if (dns_changed == TRUE) {
+    return urlconf_http_set_dns(urlconf_resolve, urlconf_ip_version,
+      urlconf_dns_cache_ttl);
+  }
+
+  return 0;
+}
+
+static int urlconf_parse_uri(pool *p, char **uri, struct urlconf_data *data,
+    int *tracing) {
   int res, xerrno;
   char *scheme = NULL, *host = NULL, *path = NULL, *username, *password;
   unsigned int port = 0;
@@ -174,9 +576,12 @@ static int urlconf_parse_uri(pool *p, char **uri, int *ftps, int *tracing,
    * all the proper libcurl options for forcing an explicit FTPS handshake.
    */
   if (strcmp(scheme, "ftps://") == 0) {
-    *ftps = TRUE;
+    data->ftps = TRUE;
   }
 
+  data->host = urlconf_host_key(p, scheme, host, port);
+  data->username = username;
+
   /* Remove any of our expected parameters from the table, after handling
    * them.  Afterward, rewrite the URL query parameters, having removed
    * ours.
@@ -188,143 +593,2656 @@ static int urlconf_parse_uri(pool *p, char **uri, int *ftps, int *tracing,
     if (res == TRUE) {
       *tracing = TRUE;
       pr_trace_use_stderr(*tracing);
-
-      /* TODO: Make the trace level a param as well. */
       pr_trace_set_levels(trace_channel, 1, 20);
     }
 
     (void) pr_table_remove(params, "tracing", NULL);
   }
 
+  /* The trace levels to use, e.g. "10" or "1-14"; this implies tracing.
+   * libcurl's own debug data are only logged at levels 15 and above.
+   */
+  v = pr_table_get(params, "trace_level", NULL);
+  if (v != NULL) {
+    int min_level = 0, max_level = 0;
+
+    if (pr_trace_parse_levels(pstrdup(p, v), &min_level, &max_level) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid trace_level '%s', ignoring", v);
+
+    } else {
+      *tracing = TRUE;
+      pr_trace_use_stderr(*tracing);
+      pr_trace_set_levels(trace_channel, min_level, max_level);
+    }
+
+    (void) pr_table_remove(params, "trace_level", NULL);
+  }
+
   v = pr_table_get(params, "ssl_verify", NULL);
   if (v != NULL) {
     res = pr_str_is_boolean(v);
     if (res == FALSE) {
-      *ssl_verify = FALSE;
+      data->ssl_verify = FALSE;
     }
 
     (void) pr_table_remove(params, "ssl_verify", NULL);
   }
 
-  urlconf_update_uri(p, uri, params);
-  return 0;
-}
+  v = pr_table_get(params, "ssl_data", NULL);
+  if (v != NULL) {
+    res = pr_str_is_boolean(v);
+    if (res == TRUE) {
+      data->ftps_data = TRUE;
+    }
 
-static size_t urlconf_data_cb(char *buf, size_t itemsz, size_t item_count,
-    void *user_data) {
-  struct urlconf_data *data;
-  size_t bufsz;
-  char *ptr;
+    (void) pr_table_remove(params, "ssl_data", NULL);
+  }
 
-  bufsz = itemsz * item_count;
-  if (bufsz == 0) {
-    return 0;
+  v = pr_table_get(params, "ssl_ca_file", NULL);
+  if (v != NULL) {
+    data->ssl_ca_file = pstrdup(p, v);
+    (void) pr_table_remove(params, "ssl_ca_file", NULL);
+  }
+
+  v = pr_table_get(params, "ssl_ca_path", NULL);
+  if (v != NULL) {
+    data->ssl_ca_path = pstrdup(p, v);
+    (void) pr_table_remove(params, "ssl_ca_path", NULL);
+  }
+
+  v = pr_table_get(params, "ssl_cert", NULL);
+  if (v != NULL) {
+    data->ssl_cert = pstrdup(p, v);
+    (void) pr_table_remove(params, "ssl_cert", NULL);
+  }
+
+  v = pr_table_get(params, "ssl_key", NULL);
+  if (v != NULL) {
+    data->ssl_key = pstrdup(p, v);
+    (void) pr_table_remove(params, "ssl_key", NULL);
+  }
+
+  v = pr_table_get(params, "bundle", NULL);
+  if (v != NULL) {
+    res = pr_str_is_boolean(v);
+    if (res == TRUE) {
+      data->bundle = TRUE;
+    }
+
+    (void) pr_table_remove(params, "bundle", NULL);
+  }
+
+  v = pr_table_get(params, "delta", NULL);
+  if (v != NULL) {
+    res = pr_str_is_boolean(v);
+    if (res == TRUE) {
+      data->delta = TRUE;
+
+      /* The ETag of each response identifies the base of the next delta. */
+      data->resp_headers = pr_table_alloc(p, 0);
+    }
+
+    (void) pr_table_remove(params, "delta", NULL);
+  }
+
+  v = pr_table_get(params, "integrity", NULL);
+  if (v != NULL) {
+    data->integrity = pstrdup(p, v);
+    (void) pr_table_remove(params, "integrity", NULL);
+  }
+
+  v = pr_table_get(params, "retries", NULL);
+  if (v != NULL) {
+    unsigned long retries;
+
+    if (urlconf_parse_number(v, &retries) < 0 ||
+        retries > URLCONF_MAX_RETRIES) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid retries '%s', ignoring", (const char *) v);
+
+    } else {
+      data->retries = (unsigned int) retries;
+    }
+
+    (void) pr_table_remove(params, "retries", NULL);
+  }
+
+  v = pr_table_get(params, "http_version", NULL);
+  if (v != NULL) {
+    if (strcmp(v, "1.1") == 0) {
+      data->http_version = 0;
+
+    } else if (strcmp(v, "2") == 0) {
+      data->http_version = 2;
+      if (urlconf_flags & URLCONF_FL_CURL_NO_HTTP2) {
+        pr_log_debug(DEBUG2, MOD_CONF_URL_VERSION
+          ": libcurl lacks HTTP/2 support, using HTTP/1.1 for URI '%.200s'",
+          *uri);
+      }
+
+    } else if (strcmp(v, "3") == 0) {
+      data->http_version = 3;
+      if (urlconf_flags & URLCONF_FL_CURL_NO_HTTP3) {
+        pr_log_debug(DEBUG2, MOD_CONF_URL_VERSION
+          ": libcurl lacks HTTP/3 support, using %s for URI '%.200s'",
+          (urlconf_flags & URLCONF_FL_CURL_NO_HTTP2) ? "HTTP/1.1" : "HTTP/2",
+          *uri);
+      }
+
+    } else {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid http_version '%s', ignoring", (const char *) v);
+    }
+
+    (void) pr_table_remove(params, "http_version", NULL);
+  }
+
+  v = pr_table_get(params, "watch", NULL);
+  if (v != NULL) {
+    res = urlconf_watch_get_type(v);
+    if (res < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": unsupported watch type '%s' in URI '%.200s'", (const char *) v,
+        *uri);
+      pr_table_free(params);
+      errno = EINVAL;
+      return -1;
+    }
+
+    data->watch_type = res;
+    data->resp_headers = pr_table_alloc(p, 0);
+    (void) pr_table_remove(params, "watch", NULL);
+  }
+
+  v = pr_table_get(params, "cache_dir", NULL);
+  if (v != NULL) {
+    if (*((const char *) v) != '/') {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": cache_dir '%s' is not an absolute path, ignoring",
+        (const char *) v);
+
+    } else {
+      urlconf_cache_dir = pstrdup(urlconf_get_parse_pool(), v);
+    }
+
+    (void) pr_table_remove(params, "cache_dir", NULL);
+  }
+
+  v = pr_table_get(params, "fleet_cache", NULL);
+  if (v != NULL) {
+    if (strchr(v, ':') == NULL) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": fleet_cache '%s' is not host:port, ignoring", (const char *) v);
+
+    } else if (urlconf_fleet_set_server(v) == 0) {
+      urlconf_fleet_set = TRUE;
+    }
+
+    (void) pr_table_remove(params, "fleet_cache", NULL);
   }
 
-  data = user_data;
+  v = pr_table_get(params, "fleet_require_integrity", NULL);
+  if (v != NULL) {
+    res = pr_str_is_boolean(v);
+    if (res == TRUE) {
+      urlconf_fleet_require_integrity = TRUE;
+    }
+
+    (void) pr_table_remove(params, "fleet_require_integrity", NULL);
+  }
+
+  v = pr_table_get(params, "compress_bodies", NULL);
+  if (v != NULL) {
+    res = pr_str_is_boolean(v);
+    if (res == TRUE) {
+      if (urlconf_compress_available() == FALSE) {
+        pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+          ": compress_bodies requires zlib support, ignoring");
+
+      } else {
+        urlconf_compress_bodies = TRUE;
+      }
+    }
+
+    (void) pr_table_remove(params, "compress_bodies", NULL);
+  }
+
+  /* The fetch backend to use, e.g. "mock" for testing and benchmarking;
+   * handles are not portable between backends, so any kept so far are
+   * closed first.
+   */
+  v = pr_table_get(params, "backend", NULL);
+  if (v != NULL) {
+    if (strcmp(urlconf_backend_get()->name, v) != 0) {
+      urlconf_free_handles();
+
+      if (urlconf_backend_use(v) < 0) {
+        pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+          ": unsupported backend '%s', ignoring", (const char *) v);
+
+      } else {
+        pr_trace_msg(trace_channel, 9, "using '%s' backend", (const char *) v);
+      }
+    }
+
+    (void) pr_table_remove(params, "backend", NULL);
+  }
+
+  v = pr_table_get(params, "mock_responses", NULL);
+  if (v != NULL) {
+    if (urlconf_mock_load(p, v) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": error loading mock_responses '%s': %s, ignoring", (const char *) v,
+        strerror(errno));
+    }
+
+    (void) pr_table_remove(params, "mock_responses", NULL);
+  }
+
+  v = pr_table_get(params, "mock_latency", NULL);
+  if (v != NULL) {
+    unsigned long latency_ms;
+
+    if (urlconf_parse_number(v, &latency_ms) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid mock_latency '%s', ignoring", (const char *) v);
+
+    } else {
+      (void) urlconf_mock_set_latency(latency_ms);
+    }
+
+    (void) pr_table_remove(params, "mock_latency", NULL);
+  }
+
+  v = pr_table_get(params, "mock_chunk_size", NULL);
+  if (v != NULL) {
+    unsigned long chunksz;
+
+    if (urlconf_parse_number(v, &chunksz) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid mock_chunk_size '%s', ignoring", (const char *) v);
+
+    } else {
+      (void) urlconf_mock_set_chunk_size((size_t) chunksz);
+    }
+
+    (void) pr_table_remove(params, "mock_chunk_size", NULL);
+  }
+
+  v = pr_table_get(params, "cache_ttl", NULL);
+  if (v != NULL) {
+    unsigned long ttl;
+
+    if (urlconf_parse_number(v, &ttl) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid cache_ttl '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_cache_ttl = ttl;
+    }
+
+    (void) pr_table_remove(params, "cache_ttl", NULL);
+  }
+
+  v = pr_table_get(params, "not_found_ttl", NULL);
+  if (v != NULL) {
+    unsigned long ttl;
+
+    if (urlconf_parse_number(v, &ttl) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid not_found_ttl '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_breaker_get_config()->not_found_ttl = ttl;
+    }
+
+    (void) pr_table_remove(params, "not_found_ttl", NULL);
+  }
+
+  v = pr_table_get(params, "dns_failure_ttl", NULL);
+  if (v != NULL) {
+    unsigned long ttl;
+
+    if (urlconf_parse_number(v, &ttl) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid dns_failure_ttl '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_breaker_get_config()->dns_failure_ttl = ttl;
+    }
+
+    (void) pr_table_remove(params, "dns_failure_ttl", NULL);
+  }
+
+  v = pr_table_get(params, "breaker_threshold", NULL);
+  if (v != NULL) {
+    unsigned long threshold;
+
+    if (urlconf_parse_number(v, &threshold) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid breaker_threshold '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_breaker_get_config()->threshold = (unsigned int) threshold;
+    }
+
+    (void) pr_table_remove(params, "breaker_threshold", NULL);
+  }
+
+  v = pr_table_get(params, "breaker_ttl", NULL);
+  if (v != NULL) {
+    unsigned long ttl;
+
+    if (urlconf_parse_number(v, &ttl) < 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid breaker_ttl '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_breaker_get_config()->ttl = ttl;
+    }
+
+    (void) pr_table_remove(params, "breaker_ttl", NULL);
+  }
+
+  v = pr_table_get(params, "watch_interval", NULL);
+  if (v != NULL) {
+    unsigned long interval;
+
+    if (urlconf_parse_number(v, &interval) < 0 ||
+        interval == 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid watch_interval '%s', ignoring", (const char *) v);
+
+    } else {
+      urlconf_watch_interval = interval;
+      (void) urlconf_watch_set_interval(interval);
+    }
+
+    (void) pr_table_remove(params, "watch_interval", NULL);
+  }
+
+  v = pr_table_get(params, "token_url", NULL);
+  if (v != NULL) {
+    const char *credentials_path, *scope;
+
+    credentials_path = pr_table_get(params, "token_credentials", NULL);
+    scope = pr_table_get(params, "token_scope", NULL);
+
+    if (credentials_path != NULL &&
+        *credentials_path != '/') {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": token_credentials '%s' is not an absolute path, ignoring",
+        credentials_path);
+
+    } else if (strncmp(v, "https://", 8) != 0 &&
+               strncmp(v, "http://", 7) != 0) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": token_url '%s' is not an HTTP(S) URL, ignoring", (const char *) v);
+
+    } else if (urlconf_token_set_endpoint(v, credentials_path, scope,
+        strncmp(v, "https://", 8) == 0 ?
+          urlconf_flags|URLCONF_FL_CURL_USE_TLS : urlconf_flags) == 0) {
+      urlconf_token_origin = pstrdup(urlconf_get_parse_pool(), data->host);
+    }
+
+    (void) pr_table_remove(params, "token_url", NULL);
+  }
+
+  (void) pr_table_remove(params, "token_credentials", NULL);
+  (void) pr_table_remove(params, "token_scope", NULL);
+
+  v = pr_table_get(params, "metrics_log", NULL);
+  if (v != NULL) {
+    if (*((const char *) v) != '/') {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": metrics_log '%s' is not an absolute path, ignoring",
+        (const char *) v);
+
+    } else if (urlconf_metrics_open(v) == 0) {
+      urlconf_metrics_log_set = TRUE;
+    }
+
+    (void) pr_table_remove(params, "metrics_log", NULL);
+  }
+
+  v = pr_table_get(params, "state_file", NULL);
+  if (v != NULL) {
+    if (*((const char *) v) != '/') {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": state_file '%s' is not an absolute path, ignoring",
+        (const char *) v);
+
+    } else {
+      if (urlconf_state_path == NULL ||
+          strcmp(urlconf_state_path, v) != 0) {
+        if (urlconf_state_pool != NULL) {
+          destroy_pool(urlconf_state_pool);
+        }
+
+        urlconf_state_pool = make_sub_pool(urlconf_pool);
+        pr_pool_tag(urlconf_state_pool, MOD_CONF_URL_VERSION
+          ": State File Pool");
+        urlconf_state_path = pstrdup(urlconf_state_pool, v);
+      }
+
+      urlconf_state_path_set = TRUE;
+    }
+
+    (void) pr_table_remove(params, "state_file", NULL);
+  }
+
+  /* Polling, and the include graph, use the validators of each response,
+   * if any.
+   */
+  if ((urlconf_watch_interval > 0 || urlconf_state_path_set == TRUE) &&
+      data->resp_headers == NULL) {
+    data->resp_headers = pr_table_alloc(p, 0);
+  }
+
+  if (urlconf_parse_dns_params(params) < 0) {
+    pr_table_free(params);
+    errno = EINVAL;
+    return -1;
+  }
+
+  urlconf_update_uri(p, uri, params);
+  return 0;
+}
+
+static void urlconf_data_append(struct urlconf_data *data, const char *buf,
+    size_t buflen) {
+
+  if (data->buflen + buflen > data->bufsz) {
+    char *ptr;
+    size_t bufsz;
+
+    /* Grow the buffer geometrically, to avoid copying the entire body for
+     * every chunk received.
+     */
+    bufsz = data->bufsz > 0 ? data->bufsz : 8192;
+    while (bufsz < data->buflen + buflen) {
+      bufsz *= 2;
+    }
+
+    ptr = palloc(data->pool, bufsz);
+    data->alloc_bytes += bufsz;
+    if (data->buflen > 0) {
+      memcpy(ptr, data->buf, data->buflen);
+    }
+
+    data->buf = ptr;
+    data->bufsz = bufsz;
+  }
+
+  memcpy(data->buf + data->buflen, buf, buflen);
+  data->buflen += buflen;
+  data->ptr = data->buf;
+}
+
+static size_t urlconf_data_cb(char *buf, size_t itemsz, size_t item_count,
+    void *user_data) {
+  size_t bufsz;
+
+  bufsz = itemsz * item_count;
+  if (bufsz == 0) {
+    return 0;
+  }
+
+  urlconf_data_append(user_data, buf, bufsz);
+  return bufsz;
+}
+
+/* Maps the response code for the given URL to an errno, returning -1 for
+ * anything other than success.
+ */
+static int urlconf_resp_errno(long resp_code, const char *url) {
+  switch (resp_code) {
+    case URLCONF_FILE_RESPONSE_CODE_OK:
+    case URLCONF_FTP_RESPONSE_CODE_OK:
+    case URLCONF_HTTP_RESPONSE_CODE_OK:
+      break;
+
+    case URLCONF_HTTP_RESPONSE_CODE_BAD_REQUEST:
+      pr_trace_msg(trace_channel, 2,
+        "received %ld response code for '%s' request", resp_code, url);
+      errno = EINVAL;
+      return -1;
+
+    case URLCONF_FTP_RESPONSE_CODE_NOT_LOGGED_IN:
+    case URLCONF_HTTP_RESPONSE_CODE_FORBIDDEN:
+      pr_trace_msg(trace_channel, 2,
+        "received %ld response code for '%s' request", resp_code, url);
+      errno = EACCES;
+      return -1;
+
+    case URLCONF_FTP_RESPONSE_CODE_NOT_FOUND:
+    case URLCONF_HTTP_RESPONSE_CODE_NOT_FOUND:
+      pr_trace_msg(trace_channel, 2,
+        "received %ld response code for '%s' request", resp_code, url);
+      errno = ENOENT;
+      return -1;
+
+    default:
+      pr_trace_msg(trace_channel, 2,
+        "received %ld response code for '%s' request", resp_code, url);
+      errno = EPERM;
+      return -1;
+  }
+
+  return 0;
+}
+
+/* Returns TRUE if requests for the given URL carry the bearer token, i.e.
+ * if the URL has the origin of the URL which set the token endpoint.
+ */
+static int urlconf_token_wanted(const char *url) {
+  size_t originlen;
+
+  if (urlconf_token_origin == NULL ||
+      url == NULL) {
+    return FALSE;
+  }
+
+  originlen = strlen(urlconf_token_origin);
+  if (strncmp(url, urlconf_token_origin, originlen) != 0) {
+    return FALSE;
+  }
+
+  switch (url[originlen]) {
+    case '\0':
+    case '/':
+    case '?':
+      return TRUE;
+
+    default:
+      break;
+  }
+
+  return FALSE;
+}
+
+/* Returns the headers for a request, including the bearer token, if the URL
+ * wants one.  Failing to obtain a token is not fatal here; the request will
+ * fail, as unauthorized, instead.
+ */
+static pr_table_t *urlconf_request_headers(pool *p, const char *url) {
+  pr_table_t *headers;
+
+  headers = urlconf_http_default_headers(p);
+  if (urlconf_token_wanted(url) == TRUE) {
+    (void) urlconf_token_add_header(p, headers);
+  }
+
+  return headers;
+}
+
+/* Returns TRUE if the request for the given URL is to be made again, with a
+ * new token, having had its token rejected; only done once per request.
+ */
+static int urlconf_token_retry(const char *url, long resp_code,
+    int *refreshed) {
+  if (resp_code != URLCONF_HTTP_RESPONSE_CODE_UNAUTHORIZED ||
+      urlconf_token_wanted(url) == FALSE ||
+      *refreshed == TRUE) {
+    return FALSE;
+  }
+
+  pr_trace_msg(trace_channel, 9, "token rejected, obtaining a new token");
+  (void) urlconf_token_expire();
+  *refreshed = TRUE;
+  return TRUE;
+}
+
+static int urlconf_get_data(pool *p, void *http, const char *url,
+    struct urlconf_data *data, pr_table_t *resp_headers) {
+  int res, token_refreshed = FALSE;
+  long resp_code = 0L;
+
+  while (TRUE) {
+    pr_table_t *headers;
+
+    headers = urlconf_request_headers(p, url);
+    res = urlconf_backend_get()->get(p, http, url, headers, urlconf_data_cb,
+      data, &resp_code, resp_headers);
+    if (res < 0) {
+      return -1;
+    }
+
+    if (urlconf_token_retry(url, resp_code, &token_refreshed) == FALSE) {
+      break;
+    }
+
+    /* Discard the error response. */
+    data->buflen = 0;
+    data->ptr = data->buf;
+    if (resp_headers != NULL) {
+      (void) pr_table_empty(resp_headers);
+    }
+  }
+
+  return urlconf_resp_errno(resp_code, url);
+}
+
+static int urlconf_list_data(pool *p, void *http, const char *url,
+    size_t (*resp_body)(char *, size_t, size_t, void *),
+    void *user_data) {
+  int res;
+  long resp_code;
+  pr_table_t *headers;
+
+  if (urlconf_backend_can(URLCONF_BACKEND_CAP_LIST) == FALSE) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  headers = urlconf_http_default_headers(p);
+  res = urlconf_http_list(p, http, url, headers, resp_body, user_data,
+    &resp_code);
+  if (res < 0) {
+    return -1;
+  }
+
+  return urlconf_resp_errno(resp_code, url);
+}
+
+static unsigned long urlconf_http_flags(struct urlconf_data *data) {
+  unsigned long http_flags;
+
+  http_flags = urlconf_flags;
+  if (data->ftps) {
+    http_flags |= URLCONF_FL_CURL_USE_SSL;
+
+    if (data->ftps_data) {
+      http_flags |= URLCONF_FL_CURL_USE_SSL_DATA;
+    }
+  }
+
+  if (data->ftps ||
+      (data->host != NULL &&
+       strncmp(data->host, "https://", 8) == 0)) {
+    http_flags |= URLCONF_FL_CURL_USE_TLS;
+  }
+
+  if (data->ssl_verify == FALSE) {
+    http_flags |= URLCONF_FL_CURL_NO_VERIFY;
+  }
+
+  /* libcurl only uses HTTP/2 and HTTP/3 for HTTPS URLs; older versions
+   * reject HTTP/3 for other URLs.
+   */
+  if (data->http_version != 0 &&
+      data->host != NULL &&
+      strncmp(data->host, "https://", 8) == 0) {
+    if (data->http_version == 3) {
+      http_flags |= URLCONF_FL_CURL_USE_HTTP3;
+
+    } else {
+      http_flags |= URLCONF_FL_CURL_USE_HTTP2;
+    }
+  }
+
+  return http_flags;
+}
+
+/* Returns a handle for fetching the URL described by the given data,
+ * reusing a previously allocated handle with the same origin, credentials,
+ * and settings if possible.
+ */
+static void *urlconf_get_http(pool *p, struct urlconf_data *data) {
+  void *http;
+  unsigned long http_flags;
+  char flags_text[32];
+  const char *key;
+
+  http_flags = urlconf_http_flags(data);
+
+  memset(flags_text, '\0', sizeof(flags_text));
+  snprintf(flags_text, sizeof(flags_text)-1, "%lu", http_flags);
+
+  key = pstrcat(p, data->host, "|", data->username ? data->username : "",
+    "|", flags_text, "|", data->ssl_ca_file ? data->ssl_ca_file : "",
+    "|", data->ssl_ca_path ? data->ssl_ca_path : "",
+    "|", data->ssl_cert ? data->ssl_cert : "",
+    "|", data->ssl_key ? data->ssl_key : "", NULL);
+
+  if (urlconf_handles != NULL) {
+    http = (void *) pr_table_get(urlconf_handles, key, NULL);
+    if (http != NULL) {
+      pr_trace_msg(trace_channel, 17, "reusing handle for '%s'", data->host);
+      return http;
+    }
+
+  } else {
+    urlconf_handles = pr_table_alloc(urlconf_get_parse_pool(), 0);
+  }
+
+  http = urlconf_backend_get()->alloc(urlconf_pool, URLCONF_CONNECT_TIMEOUT,
+    URLCONF_REQUEST_TIMEOUT, http_flags);
+  if (http == NULL) {
+    return NULL;
+  }
+
+  if (urlconf_backend_can(URLCONF_BACKEND_CAP_TLS) == TRUE &&
+      (http_flags & URLCONF_FL_CURL_USE_TLS) &&
+      (data->ssl_ca_file != NULL ||
+       data->ssl_ca_path != NULL ||
+       data->ssl_cert != NULL)) {
+    if (urlconf_http_set_ssl(http, data->ssl_ca_file, data->ssl_ca_path,
+        data->ssl_cert, data->ssl_key) < 0) {
+      int xerrno = errno;
+
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": unable to use client certificate '%s' for '%s': %s",
+        data->ssl_cert, data->host, strerror(xerrno));
+      (void) urlconf_backend_get()->destroy(urlconf_pool, http);
+
+      errno = xerrno;
+      return NULL;
+    }
+  }
+
+  if (pr_table_add(urlconf_handles, pstrdup(urlconf_get_parse_pool(), key),
+      http, sizeof(void *)) < 0) {
+    pr_trace_msg(trace_channel, 3, "error stashing handle for '%s': %s",
+      data->host, strerror(errno));
+    (void) urlconf_backend_get()->destroy(urlconf_pool, http);
+
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  return http;
+}
+
+/* Adds the timing of the last transfer, if known, to the given data. */
+static void urlconf_add_timing(struct urlconf_data *data) {
+  if (urlconf_backend_can(URLCONF_BACKEND_CAP_TIMING) == TRUE) {
+    (void) urlconf_http_add_timing(&(data->timing));
+  }
+}
+
+static void urlconf_free_handles(void) {
+  const void *key;
+
+  if (urlconf_handles == NULL) {
+    return;
+  }
+
+  pr_table_rewind(urlconf_handles);
+  key = pr_table_next(urlconf_handles);
+  while (key != NULL) {
+    void *http;
+
+    http = (void *) pr_table_get(urlconf_handles, key, NULL);
+    if (http != NULL) {
+      (void) urlconf_backend_get()->destroy(urlconf_pool, http);
+    }
+
+    key = pr_table_next(urlconf_handles);
+  }
+
+  urlconf_handles = NULL;
+}
+
+/* Returns the validator with which to resume a response, for If-Range: its
+ * ETag, if strong, otherwise its Last-Modified date.
+ */
+static const char *urlconf_if_range(pr_table_t *resp_headers) {
+  const char *v;
+
+  v = pr_table_get(resp_headers, "etag", NULL);
+  if (v != NULL &&
+      strncmp(v, "W/", 2) != 0) {
+    return v;
+  }
+
+  return pr_table_get(resp_headers, "last-modified", NULL);
+}
+
+/* Checks that a partial response holds the content from the given offset,
+ * and, if known, of the same total length, per its Content-Range header.
+ */
+static int urlconf_range_valid(pr_table_t *resp_headers, size_t offset,
+    const char *total) {
+  const char *v, *ptr;
+  char *endp = NULL;
+
+  v = pr_table_get(resp_headers, "content-range", NULL);
+  if (v == NULL ||
+      strncasecmp(v, "bytes ", 6) != 0) {
+    return FALSE;
+  }
+
+  if (strtoull(v + 6, &endp, 10) != (unsigned long long) offset ||
+      endp == v + 6 ||
+      *endp != '-') {
+    return FALSE;
+  }
+
+  ptr = strchr(endp, '/');
+  if (ptr == NULL) {
+    return FALSE;
+  }
+
+  if (total != NULL &&
+      strcmp(ptr + 1, "*") != 0 &&
+      strcmp(ptr + 1, total) != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns TRUE if the data received in an HTTP response with the given
+ * code can be resumed, i.e. the response is the expected one, and its
+ * content is not encoded: a range applies to the encoded content, not the
+ * decoded content which we have.
+ */
+static int urlconf_resp_resumable(long resp_code, long expected_code,
+    pr_table_t *resp_headers) {
+  const char *encoding;
+
+  if (resp_code != expected_code) {
+    return FALSE;
+  }
+
+  encoding = pr_table_get(resp_headers, "content-encoding", NULL);
+  if (encoding != NULL &&
+      strcasecmp(encoding, "identity") != 0) {
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Fetches the URL, retrying failed transfers up to the configured number of
+ * times.  The data received by a failed transfer are kept, and the retry
+ * asks only for the remainder; for HTTP, a partial response is appended only
+ * if it starts where the data received end, and an entire response replaces
+ * them.
+ */
+static int urlconf_fetch_resumable(pool *p, void *http,
+    struct urlconf_data *data, const char *url) {
+  unsigned int attempts = 0;
+  const char *if_range = NULL, *total = NULL;
+  int is_http, resumable = FALSE, token_refreshed = FALSE;
+  long resp_code = 0L;
+  pr_table_t *resp_headers = NULL;
+
+  is_http = (strncasecmp(url, "http", 4) == 0);
+
+  while (TRUE) {
+    int res, xerrno;
+    struct urlconf_data *rest;
+    size_t offset;
+
+    pr_signals_handle();
+
+    resp_code = 0L;
+
+    resp_headers = pr_table_alloc(p, 0);
+    offset = resumable == TRUE ? data->buflen : 0;
+
+    if (offset == 0) {
+      data->buflen = 0;
+      data->ptr = data->buf;
+
+      res = urlconf_http_get_with_headers(p, http, url,
+        urlconf_request_headers(p, url), urlconf_data_cb, data, &resp_code,
+        resp_headers);
+      xerrno = errno;
+      urlconf_add_timing(data);
+
+      if (res == 0) {
+        if (urlconf_token_retry(url, resp_code, &token_refreshed) == TRUE) {
+          continue;
+        }
+
+        break;
+      }
+
+      /* Only the data of a successful, unencoded response are worth
+       * keeping.
+       */
+      resumable = TRUE;
+      if (is_http) {
+        resumable = urlconf_resp_resumable(resp_code,
+          URLCONF_HTTP_RESPONSE_CODE_OK, resp_headers);
+
+        if_range = urlconf_if_range(resp_headers);
+        total = pr_table_get(resp_headers, "content-length", NULL);
+      }
+
+    } else {
+      rest = pcalloc(p, sizeof(struct urlconf_data));
+      rest->pool = data->pool;
+
+      res = urlconf_http_resume(p, http, url, urlconf_request_headers(p, url),
+        (off_t) offset, if_range, urlconf_data_cb, rest, &resp_code,
+        resp_headers);
+      xerrno = errno;
+      urlconf_add_timing(data);
+      data->alloc_bytes += rest->alloc_bytes;
+
+      if (is_http == FALSE ||
+          (urlconf_resp_resumable(resp_code,
+             URLCONF_HTTP_RESPONSE_CODE_PARTIAL_CONTENT,
+             resp_headers) == TRUE &&
+           urlconf_range_valid(resp_headers, offset, total) == TRUE)) {
+        pr_trace_msg(trace_channel, 12,
+          "appending %lu bytes to %lu bytes received for '%s'",
+          (unsigned long) rest->buflen, (unsigned long) offset, url);
+
+        if (rest->buflen > 0) {
+          urlconf_data_append(data, rest->buf, rest->buflen);
+        }
+
+        if (res == 0) {
+          if (is_http) {
+            /* The remainder completes our successful response. */
+            resp_code = URLCONF_HTTP_RESPONSE_CODE_OK;
+          }
+
+          break;
+        }
+
+      } else if (resp_code == URLCONF_HTTP_RESPONSE_CODE_OK) {
+        /* The content changed, or the server ignored our range; what we
+         * have now is (the start of) the entire content.
+         */
+        pr_trace_msg(trace_channel, 12,
+          "'%s' server sent entire content, discarding %lu bytes received",
+          url, (unsigned long) offset);
+
+        data->buf = data->ptr = rest->buf;
+        data->buflen = rest->buflen;
+        data->bufsz = rest->bufsz;
+
+        if (res == 0) {
+          break;
+        }
+
+        /* As for the first attempt, an encoded replacement cannot be
+         * resumed.
+         */
+        resumable = urlconf_resp_resumable(resp_code,
+          URLCONF_HTTP_RESPONSE_CODE_OK, resp_headers);
+        if_range = urlconf_if_range(resp_headers);
+        total = pr_table_get(resp_headers, "content-length", NULL);
+
+      } else {
+        pr_trace_msg(trace_channel, 3,
+          "unusable %ld response resuming '%s', starting over", resp_code,
+          url);
+        resumable = FALSE;
+
+        /* Unlike a failed transfer, an error response is not retried; an
+         * unusable partial response (e.g. an encoded one) is.
+         */
+        if (res == 0 &&
+            resp_code != URLCONF_HTTP_RESPONSE_CODE_PARTIAL_CONTENT &&
+            resp_code != URLCONF_HTTP_RESPONSE_CODE_RANGE_NOT_SATISFIABLE) {
+          return urlconf_resp_errno(resp_code, url);
+        }
+      }
+    }
+
+    /* A fetch interrupted for a pending shutdown/restart is not retried. */
+    if (xerrno == EINTR ||
+        attempts++ >= data->retries) {
+      errno = xerrno;
+      return -1;
+    }
+
+    pr_trace_msg(trace_channel, 9, "retrying failed '%s' request "
+      "(attempt %u of %u, %lu bytes received)", url, attempts + 1,
+      data->retries + 1, (unsigned long) (resumable ? data->buflen : 0));
+  }
+
+  if (data->resp_headers != NULL) {
+    data->resp_headers = resp_headers;
+  }
+
+  return urlconf_resp_errno(resp_code, url);
+}
+
+/* Construct the configuration file from the URL. */
+static int urlconf_fetch_url(pool *p, pr_fh_t *fh, const char *url) {
+  int res, xerrno;
+  void *http;
+  struct urlconf_data *data;
+
+  data = fh->fh_data;
+
+  http = urlconf_get_http(p, data);
+  if (http == NULL) {
+    return -1;
+  }
+
+  if (data->retries > 0 &&
+      urlconf_backend_can(URLCONF_BACKEND_CAP_RESUME) == TRUE) {
+    res = urlconf_fetch_resumable(p, http, data, url);
+
+  } else {
+    res = urlconf_get_data(p, http, url, fh->fh_data,
+      data->resp_headers);
+    urlconf_add_timing(data);
+  }
+  xerrno = errno;
+
+  (void) urlconf_breaker_record(data->host, url, res == 0 ? 0 : xerrno);
+
+  errno = xerrno;
+  return res;
+}
+
+/* Returns the URL as a fleet cache key: with its scheme and host
+ * lowercased, and without any fragment, so that all nodes use the same key
+ * for the same resource.  Fleet cache values start with their keys, in the
+ * clear, so any userinfo (i.e. credentials) is dropped as well.
+ */
+static const char *urlconf_fleet_url(pool *p, const char *url) {
+  char *canon, *ptr, *host, *end, *userinfo = NULL;
+
+  canon = pstrdup(p, url);
+
+  ptr = strchr(canon, '#');
+  if (ptr != NULL) {
+    *ptr = '\0';
+  }
+
+  host = strstr(canon, "://");
+  if (host == NULL) {
+    return canon;
+  }
+
+  for (ptr = canon; ptr < host; ptr++) {
+    *ptr = tolower((int) *ptr);
+  }
+
+  host += 3;
+  end = host + strcspn(host, "/?");
+
+  for (ptr = host; ptr < end; ptr++) {
+    if (*ptr == '@') {
+      userinfo = host;
+      host = ptr + 1;
+    }
+  }
+
+  for (ptr = host; ptr < end; ptr++) {
+    *ptr = tolower((int) *ptr);
+  }
+
+  if (userinfo != NULL) {
+    return pstrcat(p, pstrndup(p, canon, userinfo - canon), host, NULL);
+  }
+
+  return canon;
+}
+
+/* Returns the validator of the response, as "<header> <value>", for keying
+ * its fleet cache entry; NULL if it has none.
+ */
+static const char *urlconf_fleet_validator(pool *p, pr_table_t *resp_headers) {
+  const char *v;
+
+  if (resp_headers == NULL) {
+    return NULL;
+  }
+
+  v = pr_table_get(resp_headers, "etag", NULL);
+  if (v != NULL) {
+    return pstrcat(p, "etag ", v, NULL);
+  }
+
+  v = pr_table_get(resp_headers, "last-modified", NULL);
+  if (v != NULL) {
+    return pstrcat(p, "last-modified ", v, NULL);
+  }
+
+  return NULL;
+}
+
+/* Looks up the fleet cache entry for the URL.  Responses whose content is
+ * known are keyed by their integrity metadata.  Others are keyed by their
+ * validator: the entry for the URL itself names the validator of the
+ * current response, whose entry holds the response.
+ */
+static int urlconf_fleet_lookup(pool *p, struct urlconf_data *data,
+    const char *canon_url, const char **key, char **cached_data,
+    size_t *cached_datalen) {
+  char *validator = NULL, *ptr;
+  size_t validatorlen = 0;
+
+  if (data->integrity != NULL) {
+    *key = pstrcat(p, canon_url, " integrity ", data->integrity, NULL);
+    return urlconf_fleet_get(p, *key, cached_data, cached_datalen);
+  }
+
+  if (urlconf_fleet_get(p, canon_url, &validator, &validatorlen) < 0) {
+    return -1;
+  }
+
+  *key = pstrcat(p, canon_url, " ", validator, NULL);
+  if (urlconf_fleet_get(p, *key, cached_data, cached_datalen) < 0) {
+    return -1;
+  }
+
+  /* Restore the validator, e.g. for watching the URL by polling. */
+  ptr = strchr(validator, ' ');
+  if (ptr != NULL &&
+      data->resp_headers != NULL) {
+    (void) pr_table_add_dup(data->resp_headers,
+      pstrndup(p, validator, ptr - validator), ptr + 1, 0);
+  }
+
+  return 0;
+}
+
+/* Publishes the response, fetched from the origin, to the fleet cache.
+ * Responses with integrity metadata are only published once verified, and
+ * then never expire; others are published for the cache TTL, provided that
+ * they have a validator.
+ */
+static void urlconf_fleet_publish(pool *p, struct urlconf_data *data,
+    const char *canon_url) {
+  const char *key, *validator, *buf;
+
+  buf = data->buf != NULL ? data->buf : "";
+
+  if (data->integrity != NULL) {
+    if (urlconf_integrity_check(p, data->integrity, buf, data->buflen) < 0) {
+      pr_trace_msg(trace_channel, 3,
+        "'%s' response failed integrity check, not publishing to fleet cache",
+        canon_url);
+      return;
+    }
+
+    key = pstrcat(p, canon_url, " integrity ", data->integrity, NULL);
+
+    /* Note that a TTL of zero means no expiry, to the fleet cache. */
+    (void) urlconf_fleet_put(p, key, buf, data->buflen, 0);
+    return;
+  }
+
+  if (urlconf_cache_ttl == 0) {
+    return;
+  }
+
+  validator = urlconf_fleet_validator(p, data->resp_headers);
+  if (validator == NULL) {
+    pr_trace_msg(trace_channel, 12,
+      "'%s' response has no validator, not publishing to fleet cache",
+      canon_url);
+    return;
+  }
+
+  /* Publish the response before naming it as current. */
+  key = pstrcat(p, canon_url, " ", validator, NULL);
+  if (urlconf_fleet_put(p, key, buf, data->buflen, urlconf_cache_ttl) == 0) {
+    (void) urlconf_fleet_put(p, canon_url, validator, strlen(validator),
+      urlconf_cache_ttl);
+  }
+}
+
+/* Fetches the URL via the fleet cache, if any: using the response which
+ * another node published there, or else fetching the URL from the origin,
+ * and publishing it.  While one node fetches a URL, any other nodes wait
+ * for it, rather than also asking the origin.  Failure to use the fleet
+ * cache is not fatal; we simply fetch the URL ourselves.
+ */
+static int urlconf_fetch_fleet(pool *p, pr_fh_t *fh, const char *url) {
+  int claimed = FALSE, res, xerrno;
+  struct urlconf_data *data;
+  const char *canon_url, *key = NULL;
+  char *cached_data = NULL;
+  size_t cached_datalen = 0;
+  unsigned long fill_secs, waited_msecs = 0;
+
+  data = fh->fh_data;
+  if (urlconf_fleet_set == FALSE) {
+    return urlconf_fetch_url(p, fh, url);
+  }
+
+  if (urlconf_fleet_require_integrity == TRUE &&
+      data->integrity == NULL) {
+    pr_trace_msg(trace_channel, 12,
+      "'%s' has no integrity metadata, not using fleet cache", url);
+    return urlconf_fetch_url(p, fh, url);
+  }
+
+  canon_url = urlconf_fleet_url(p, url);
+
+  /* Entries are keyed by the validators of the responses. */
+  if (data->resp_headers == NULL) {
+    data->resp_headers = pr_table_alloc(data->pool, 0);
+  }
+
+  fill_secs = URLCONF_CONNECT_TIMEOUT + URLCONF_REQUEST_TIMEOUT;
+
+  while (TRUE) {
+    if (urlconf_fleet_lookup(p, data, canon_url, &key, &cached_data,
+        &cached_datalen) == 0) {
+
+      /* Any node can write to the fleet cache, so check what it gave us;
+       * a response which fails its check is removed, and fetched from the
+       * origin instead.
+       */
+      if (data->integrity != NULL &&
+          urlconf_integrity_check(p, data->integrity, cached_data,
+            cached_datalen) < 0) {
+        pr_log_pri(PR_LOG_WARNING, MOD_CONF_URL_VERSION
+          ": fleet cache entry for '%s' failed integrity check, removing it",
+          url);
+        (void) urlconf_fleet_delete(p, key);
+        break;
+      }
+
+      data->alloc_bytes += cached_datalen + 1;
+      if (cached_datalen > 0) {
+        urlconf_data_append(data, cached_data, cached_datalen);
+      }
+
+      data->cache = "fleet";
+      return 0;
+    }
+
+    if (errno != ENOENT) {
+      break;
+    }
+
+    if (urlconf_fleet_claim(p, canon_url, fill_secs) == 0) {
+      claimed = TRUE;
+      break;
+    }
+
+    if (errno != EEXIST ||
+        waited_msecs >= fill_secs * 1000) {
+      break;
+    }
+
+    pr_signals_handle();
+    pr_timer_usleep(URLCONF_FLEET_POLL_MSECS * 1000);
+    waited_msecs += URLCONF_FLEET_POLL_MSECS;
+  }
+
+  res = urlconf_fetch_url(p, fh, url);
+  xerrno = errno;
+
+  /* Only successful responses are published. */
+  if (res == 0) {
+    urlconf_fleet_publish(p, data, canon_url);
+  }
+
+  if (claimed == TRUE) {
+    (void) urlconf_fleet_release(p, canon_url);
+  }
+
+  errno = xerrno;
+  return res;
+}
+
+/* Fetches only the changes to the cached response for the URL, as an
+ * RFC 3229 delta against that response (identified by its ETag).  The new
+ * content is rebuilt locally, and checked against the instance digest (see
+ * RFC 3230) of the response.  If the delta cannot be fetched or used, the
+ * caller fetches the entire content instead.
+ */
+static int urlconf_fetch_delta(pool *p, pr_fh_t *fh, const char *url) {
+  int res;
+  void *http;
+  long resp_code = 0L;
+  struct urlconf_data *data, *delta_data;
+  const char *etag, *delta_base;
+  char *base = NULL, *content = NULL;
+  size_t baselen = 0, contentlen = 0;
+  pr_table_t *headers, *resp_headers;
+
+  data = fh->fh_data;
+
+  etag = urlconf_cache_get_etag(p, urlconf_cache_dir, url);
+  if (etag == NULL) {
+    return -1;
+  }
+
+  /* The base may be stale; that is the point. */
+  if (urlconf_cache_get(p, urlconf_cache_dir, url, (unsigned long) -1, &base,
+      &baselen) < 0) {
+    return -1;
+  }
+
+  http = urlconf_get_http(p, data);
+  if (http == NULL) {
+    return -1;
+  }
+
+  headers = urlconf_request_headers(p, url);
+  (void) pr_table_add(headers, URLCONF_HTTP_HEADER_A_IM,
+    URLCONF_DELTA_IM_DIFFE, 0);
+  (void) pr_table_add(headers, URLCONF_HTTP_HEADER_IF_NONE_MATCH, etag, 0);
+  (void) pr_table_add(headers, URLCONF_HTTP_HEADER_WANT_DIGEST, "SHA-256", 0);
+
+  delta_data = pcalloc(p, sizeof(struct urlconf_data));
+  delta_data->pool = data->pool;
+  resp_headers = pr_table_alloc(p, 0);
+
+  res = urlconf_backend_get()->get(p, http, url, headers, urlconf_data_cb,
+    delta_data, &resp_code, resp_headers);
+  urlconf_add_timing(data);
+  data->alloc_bytes += baselen + 1 + delta_data->alloc_bytes;
+  if (res < 0) {
+    return -1;
+  }
+
+  switch (resp_code) {
+    case URLCONF_HTTP_RESPONSE_CODE_NOT_MODIFIED:
+      pr_trace_msg(trace_channel, 12, "cached response for '%s' unchanged",
+        url);
+      content = base;
+      contentlen = baselen;
+      data->cache = "revalidated";
+      break;
+
+    case URLCONF_HTTP_RESPONSE_CODE_IM_USED: {
+      const char *im, *digest;
+
+      im = pr_table_get(resp_headers, "im", NULL);
+      delta_base = pr_table_get(resp_headers, "delta-base", NULL);
+      digest = pr_table_get(resp_headers, "digest", NULL);
+
+      if (im == NULL ||
+          (delta_base != NULL && strcmp(delta_base, etag) != 0)) {
+        pr_trace_msg(trace_channel, 3,
+          "'%s' delta is not for cached response %s, ignoring", url, etag);
+        return -1;
+      }
+
+      if (urlconf_delta_apply(p, im, base, baselen,
+          delta_data->buf != NULL ? delta_data->buf : "", delta_data->buflen,
+          &content, &contentlen) < 0) {
+        pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+          ": unable to apply '%s' delta for '%s': %s", im, url,
+          strerror(errno));
+        return -1;
+      }
+
+      /* Without a digest, there is no telling if we rebuilt the content
+       * correctly.
+       */
+      if (digest == NULL ||
+          urlconf_delta_check_digest(p, digest, content, contentlen) < 0) {
+        pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+          ": unable to verify content rebuilt from delta for '%s': %s", url,
+          digest != NULL ? strerror(errno) : "no Digest header");
+        return -1;
+      }
+
+      pr_trace_msg(trace_channel, 9, "rebuilt '%s' from %lu byte delta", url,
+        (unsigned long) delta_data->buflen);
+      data->alloc_bytes += contentlen + 1;
+      data->cache = "delta";
+      break;
+    }
+
+    case URLCONF_HTTP_RESPONSE_CODE_OK:
+      /* The server sent the entire content, instead. */
+      content = delta_data->buf;
+      contentlen = delta_data->buflen;
+      data->cache = "miss";
+      break;
+
+    default:
+      return -1;
+  }
+
+  data->buf = data->ptr = content;
+  data->buflen = data->bufsz = contentlen;
+  data->resp_headers = resp_headers;
+
+  (void) urlconf_breaker_record(data->host, url, 0);
+  return 0;
+}
+
+static int urlconf_read_url(pool *p, pr_fh_t *fh, const char *url) {
+  int lockfd, res, xerrno;
+  struct urlconf_data *data;
+  char *cached_data = NULL;
+  size_t cached_datalen = 0;
+
+  data = fh->fh_data;
+
+  /* Use the response body fetched in advance, if any, as is. */
+  if (urlconf_bodies != NULL) {
+    const struct urlconf_body *body;
+
+    body = pr_table_get(urlconf_bodies, url, NULL);
+    if (body != NULL) {
+      pr_trace_msg(trace_channel, 17, "using prefetched response for '%s'",
+        url);
+
+      if (body->zbuflen > 0) {
+        /* Inflated as it is read, unless its content is needed first. */
+        data->zbuf = body->buf;
+        data->zbuflen = body->zbuflen;
+        data->buflen = body->buflen;
+
+      } else {
+        data->buf = data->ptr = body->buf;
+        data->buflen = data->bufsz = body->buflen;
+      }
+
+      data->bundled = body->bundled;
+      data->cache = body->cache;
+      data->alloc_bytes = body->alloc_bytes;
+      data->prefetched = TRUE;
+
+      if (body->timing != NULL) {
+        memcpy(&(data->timing), body->timing,
+          sizeof(struct urlconf_http_timing));
+      }
+
+      if (data->resp_headers != NULL &&
+          body->resp_headers != NULL) {
+        data->resp_headers = body->resp_headers;
+      }
+
+      return 0;
+    }
+  }
+
+  /* For URLs whose content is known, use the content store, if it holds
+   * that content; this needs no network I/O at all.
+   */
+  if (data->integrity != NULL &&
+      urlconf_cache_dir != NULL) {
+    if (urlconf_cache_get_blob(p, urlconf_cache_dir, data->integrity,
+        &cached_data, &cached_datalen) == 0 &&
+        urlconf_integrity_check(p, data->integrity, cached_data,
+          cached_datalen) == 0) {
+      pr_trace_msg(trace_channel, 12, "using stored content for '%s'", url);
+
+      data->buf = data->ptr = cached_data;
+      data->buflen = data->bufsz = cached_datalen;
+      data->alloc_bytes += cached_datalen + 1;
+      data->integrity_stored = TRUE;
+      data->cache = "stored";
+      return 0;
+    }
+  }
+
+  /* Fail fast for URLs, or hosts, which have recently failed. */
+  if (urlconf_breaker_check(data->host, url) < 0) {
+    return -1;
+  }
+
+  /* URLs whose content is known do not use the TTL-based cache, lest they
+   * see stale content.
+   */
+  data->cache = "none";
+  if (urlconf_cache_dir == NULL ||
+      data->integrity != NULL) {
+    return urlconf_fetch_fleet(p, fh, url);
+  }
+
+  /* Only one process at a time fetches a given URL; any others wait on the
+   * lock, and then use the response published by that process.  Failure
+   * to use the cache is not fatal; we simply fetch the URL ourselves.
+   */
+  lockfd = urlconf_cache_lock(p, urlconf_cache_dir, url);
+  if (lockfd < 0) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": unable to use cache directory '%s' for '%s': %s", urlconf_cache_dir,
+      url, strerror(errno));
+    return urlconf_fetch_fleet(p, fh, url);
+  }
+
+  if (urlconf_cache_get(p, urlconf_cache_dir, url, urlconf_cache_ttl,
+      &cached_data, &cached_datalen) == 0) {
+    data->alloc_bytes += cached_datalen + 1;
+    if (cached_datalen > 0) {
+      urlconf_data_append(data, cached_data, cached_datalen);
+    }
+
+    data->cache = "hit";
+
+    (void) urlconf_cache_unlock(lockfd);
+    return 0;
+  }
+
+  if (data->delta == TRUE &&
+      urlconf_fetch_delta(p, fh, url) == 0) {
+    res = 0;
+
+  } else {
+    data->cache = "miss";
+    res = urlconf_fetch_fleet(p, fh, url);
+  }
+  xerrno = errno;
+
+  if (res == 0) {
+    (void) urlconf_cache_put(p, urlconf_cache_dir, url,
+      data->buf != NULL ? data->buf : "", data->buflen);
+
+    if (data->delta == TRUE) {
+      (void) urlconf_cache_put_etag(p, urlconf_cache_dir, url,
+        pr_table_get(data->resp_headers, "etag", NULL));
+    }
+  }
+
+  (void) urlconf_cache_unlock(lockfd);
+
+  errno = xerrno;
+  return res;
+}
+
+/* Checks the response against its expected digest, before the parser sees
+ * it, and adds verified responses to the content store.
+ */
+static int urlconf_check_integrity(pool *p, struct urlconf_data *data,
+    const char *url) {
+  if (urlconf_integrity_check(p, data->integrity,
+      data->buf != NULL ? data->buf : "", data->buflen) < 0) {
+    int xerrno = errno;
+
+    pr_log_pri(PR_LOG_WARNING, MOD_CONF_URL_VERSION
+      ": '%s' response failed integrity check: %s", url, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (data->integrity_stored == FALSE &&
+      urlconf_cache_dir != NULL) {
+    (void) urlconf_cache_put_blob(p, urlconf_cache_dir, data->integrity,
+      data->buf != NULL ? data->buf : "", data->buflen);
+  }
+
+  return 0;
+}
+
+/* Records the URL, as fetched, for the watcher process. */
+static void urlconf_watch_url(pool *p, struct urlconf_data *data,
+    const char *url) {
+  const char *hash;
+  int watch_type;
+
+  /* Bundle members are watched via their bundle. */
+  if (data->bundled == TRUE) {
+    return;
+  }
+
+  watch_type = data->watch_type;
+  if (watch_type == 0) {
+    /* Any URL can be polled. */
+    watch_type = URLCONF_WATCH_TYPE_POLL;
+
+  } else if (strncmp(url, "http", 4) != 0) {
+    pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+      ": unable to watch '%s': only HTTP(S) URLs can be watched", url);
+    return;
+  }
+
+  hash = urlconf_utils_hash_data(p, data->buf, data->buflen);
+
+  if (urlconf_watch_add(url, watch_type, urlconf_http_flags(data),
+      data->ssl_ca_file, data->ssl_ca_path, data->ssl_cert, data->ssl_key,
+      urlconf_token_wanted(url), data->resp_headers, hash) < 0) {
+    pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+      ": error watching '%s': %s", url, strerror(errno));
+  }
+}
+
+/* Adds the given name, listed by the server, to the list of names, ignoring
+ * subdirectories, parent/relative links, and absolute URLs.
+ */
+static void urlconf_listing_add(pool *p, array_header *names,
+    pr_table_t *seen, const char *name, size_t namelen) {
+  const char *ptr;
+  char *text;
+
+  /* FTP servers may list the entries with their directory. */
+  ptr = memchr(name, '/', namelen);
+  while (ptr != NULL &&
+         (size_t) (ptr - name) < namelen - 1) {
+    namelen -= (ptr - name) + 1;
+    name = ptr + 1;
+    ptr = memchr(name, '/', namelen);
+  }
+
+  if (namelen == 0 ||
+      ptr != NULL ||
+      *name == '.' ||
+      *name == '?' ||
+      *name == '#' ||
+      memchr(name, ':', namelen) != NULL) {
+    return;
+  }
+
+  text = pstrndup(p, name, namelen);
+  if (pr_table_exists(seen, text) > 0) {
+    return;
+  }
+
+  (void) pr_table_add(seen, text, "", 0);
+  *((char **) push_array(names)) = text;
+}
+
+/* Parses the names from a directory listing: either an HTML index page,
+ * using the links in that page, or a plain list of names, one per line (as
+ * from FTP servers).
+ */
+static array_header *urlconf_parse_listing(pool *p, const char *text,
+    size_t textlen) {
+  array_header *names;
+  pr_table_t *seen;
+  const char *ptr, *end;
+
+  names = make_array(p, 0, sizeof(char *));
+  seen = pr_table_alloc(p, 0);
+  end = text + textlen;
+
+  if (textlen > 2 &&
+      (memchr(text, '<', textlen) != NULL)) {
+    ptr = text;
+
+    while (ptr < end) {
+      const char *href, *val;
+      char quote;
+
+      pr_signals_handle();
+
+      href = ptr;
+      while (href + 5 < end &&
+             strncasecmp(href, "href=", 5) != 0) {
+        href++;
+      }
+
+      if (href + 5 >= end) {
+        break;
+      }
+
+      val = href + 5;
+      quote = *val;
+      if (quote != '"' &&
+          quote != '\'') {
+        ptr = val;
+        continue;
+      }
+
+      val++;
+      ptr = val;
+      while (ptr < end &&
+             *ptr != quote) {
+        ptr++;
+      }
+
+      if (ptr >= end) {
+        break;
+      }
+
+      urlconf_listing_add(p, names, seen, val, ptr - val);
+      ptr++;
+    }
+
+    return names;
+  }
+
+  ptr = text;
+  while (ptr < end) {
+    const char *eol;
+    size_t len;
+
+    pr_signals_handle();
+
+    eol = memchr(ptr, '\n', end - ptr);
+    if (eol == NULL) {
+      eol = end;
+    }
+
+    len = eol - ptr;
+    if (len > 0 &&
+        ptr[len-1] == '\r') {
+      len--;
+    }
+
+    urlconf_listing_add(p, names, seen, ptr, len);
+    ptr = eol + 1;
+  }
+
+  return names;
+}
+
+/* Lists the names in the directory at the given URL. */
+static array_header *urlconf_list_url(pool *p, const char *path) {
+  int res, xerrno;
+  void *http;
+  char *url;
+  const char *dir_url;
+  struct urlconf_data *data;
+  struct urlconf_listing *listing;
+
+  data = pcalloc(p, sizeof(struct urlconf_data));
+  data->pool = p;
+  data->ssl_verify = TRUE;
+
+  url = pstrdup(p, path);
+  if (urlconf_parse_uri(p, &url, data, &use_tracing) < 0) {
+    return NULL;
+  }
+
+  dir_url = url;
+  if (url[strlen(url)-1] != '/') {
+    dir_url = pstrcat(p, url, "/", NULL);
+
+  } else {
+    url[strlen(url)-1] = '\0';
+  }
+
+  /* Directories of bundle members are already known. */
+  if (urlconf_listings != NULL) {
+    listing = (struct urlconf_listing *) pr_table_get(urlconf_listings, url,
+      NULL);
+    if (listing != NULL) {
+      return listing->names;
+    }
+  }
+
+  if (urlconf_breaker_check(data->host, url) < 0) {
+    return NULL;
+  }
+
+  http = urlconf_get_http(p, data);
+  if (http == NULL) {
+    return NULL;
+  }
+
+  pr_trace_msg(trace_channel, 12, "listing directory '%s'", dir_url);
+
+  if (strncmp(url, "ftp://", 6) == 0) {
+    res = urlconf_list_data(p, http, dir_url, urlconf_data_cb, data);
+
+  } else {
+    res = urlconf_get_data(p, http, dir_url, data, NULL);
+  }
+
+  xerrno = errno;
+
+  (void) urlconf_breaker_record(data->host, dir_url, res == 0 ? 0 : xerrno);
+
+  if (res < 0) {
+    errno = xerrno;
+    return NULL;
+  }
+
+  listing = pcalloc(urlconf_get_parse_pool(), sizeof(struct urlconf_listing));
+  listing->names = urlconf_parse_listing(urlconf_get_parse_pool(), data->buf,
+    data->buflen);
+
+  pr_trace_msg(trace_channel, 12, "listed %d %s in directory '%s'",
+    listing->names->nelts, listing->names->nelts != 1 ? "names" : "name",
+    dir_url);
+
+  if (urlconf_listings == NULL) {
+    urlconf_listings = pr_table_alloc(urlconf_get_parse_pool(), 0);
+  }
+
+  if (pr_table_exists(urlconf_listings, url) > 0) {
+    (void) pr_table_set(urlconf_listings, url, listing,
+      sizeof(struct urlconf_listing *));
+
+  } else {
+    (void) pr_table_add(urlconf_listings,
+      pstrdup(urlconf_get_parse_pool(), url), listing,
+      sizeof(struct urlconf_listing *));
+  }
+
+  return listing->names;
+}
+
+/* Stores a response body, fetched in advance, for later use.  Bundle
+ * members are kept as is, within their bundle; other bodies are copied,
+ * compressed if so configured, so that the given buffer need not last.
+ */
+static struct urlconf_body *urlconf_add_body(const char *url, char *buf,
+    size_t buflen, int bundled, pr_table_t *resp_headers) {
+  struct urlconf_body *body;
+
+  if (urlconf_bodies == NULL) {
+    urlconf_bodies = pr_table_alloc(urlconf_get_parse_pool(), 0);
+  }
+
+  body = pcalloc(urlconf_get_parse_pool(), sizeof(struct urlconf_body));
+  body->buf = buf;
+  body->buflen = buflen;
+  body->bundled = bundled;
+  body->resp_headers = resp_headers;
+  body->cache = bundled ? "bundled" : "none";
+  body->alloc_bytes = buflen + 1;
+
+  if (bundled == FALSE) {
+    if (urlconf_compress_bodies == TRUE &&
+        buflen > 0 &&
+        urlconf_compress_data(urlconf_get_parse_pool(), buf, buflen,
+          &(body->buf), &(body->zbuflen)) == 0) {
+      pr_trace_msg(trace_channel, 17,
+        "keeping response for '%s' compressed (%lu bytes, from %lu bytes)",
+        url, (unsigned long) body->zbuflen, (unsigned long) buflen);
+      body->alloc_bytes = body->zbuflen;
+
+    } else {
+      body->buf = pstrndup(urlconf_get_parse_pool(), buf != NULL ? buf : "",
+        buflen);
+    }
+  }
+
+  if (pr_table_add(urlconf_bodies, pstrdup(urlconf_get_parse_pool(), url),
+      body, sizeof(struct urlconf_body *)) < 0) {
+    pr_trace_msg(trace_channel, 3, "error stashing response for '%s': %s",
+      url, strerror(errno));
+    return NULL;
+  }
+
+  return body;
+}
+
+/* Records, for the metrics log, how a response fetched in advance was
+ * obtained.
+ */
+static void urlconf_body_set_metrics(struct urlconf_body *body,
+    const char *cache, const struct urlconf_http_timing *timing) {
+  if (body == NULL) {
+    return;
+  }
+
+  body->cache = cache;
+
+  if (timing != NULL) {
+    body->timing = palloc(urlconf_get_parse_pool(),
+      sizeof(struct urlconf_http_timing));
+    memcpy(body->timing, timing, sizeof(struct urlconf_http_timing));
+  }
+}
+
+/* Returns the URL of the directory containing the given URL. */
+static const char *urlconf_dir_url(pool *p, const char *url) {
+  const char *ptr, *slash;
+
+  ptr = strstr(url, "://");
+  ptr = ptr != NULL ? ptr + 3 : url;
+
+  slash = strrchr(ptr, '/');
+  if (slash == NULL) {
+    return url;
+  }
+
+  return pstrndup(p, url, slash - url);
+}
+
+/* Adds a bundle member to the listing of its directory, so that wildcard
+ * Includes of bundle members need not list the directory.
+ */
+static void urlconf_add_listing(const char *url) {
+  pool *parse_pool;
+  const char *dir_url;
+  struct urlconf_listing *listing = NULL;
+
+  parse_pool = urlconf_get_parse_pool();
+  dir_url = urlconf_dir_url(parse_pool, url);
+
+  if (urlconf_listings == NULL) {
+    urlconf_listings = pr_table_alloc(parse_pool, 0);
+
+  } else {
+    listing = (struct urlconf_listing *) pr_table_get(urlconf_listings,
+      dir_url, NULL);
+  }
+
+  if (listing == NULL) {
+    listing = pcalloc(parse_pool, sizeof(struct urlconf_listing));
+    listing->names = make_array(parse_pool, 0, sizeof(char *));
+
+    /* The members are already in memory. */
+    listing->prefetched = TRUE;
+
+    (void) pr_table_add(urlconf_listings, dir_url, listing,
+      sizeof(struct urlconf_listing *));
+  }
+
+  *((char **) push_array(listing->names)) = pstrdup(parse_pool,
+    url + strlen(dir_url) + 1);
+}
+
+/* Checks that a bundle member name is a relative path, within the bundle's
+ * directory.
+ */
+static int urlconf_bundle_name_valid(const char *name) {
+  const char *ptr;
+
+  if (*name == '\0' ||
+      *name == '/') {
+    return FALSE;
+  }
+
+  ptr = name;
+  while (ptr != NULL) {
+    if (strncmp(ptr, "..", 2) == 0 &&
+        (ptr[2] == '/' || ptr[2] == '\0')) {
+      return FALSE;
+    }
+
+    ptr = strchr(ptr, '/');
+    if (ptr != NULL) {
+      ptr++;
+    }
+  }
+
+  return TRUE;
+}
+
+/* Unpacks a bundle, i.e. a configuration file and the files it includes,
+ * all in a single response:
+ *
+ *  URLCONF-BUNDLE 1
+ *  <name> <length>
+ *  <data>
+ *  ...
+ *
+ * The first member is the configuration file itself; the others are kept
+ * in memory, for use by Includes of their URLs, relative to the directory
+ * of the bundle URL.
+ */
+static int urlconf_unpack_bundle(pool *p, struct urlconf_data *data,
+    const char *url) {
+  const char *ptr, *end, *dir_url;
+  char *main_buf = NULL;
+  size_t magiclen, main_buflen = 0;
+  int count = 0;
+
+  magiclen = strlen(URLCONF_BUNDLE_MAGIC);
+  if (data->buflen < magiclen ||
+      strncmp(data->buf, URLCONF_BUNDLE_MAGIC, magiclen) != 0) {
+    pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+      ": '%s' response is not a bundle", url);
+    errno = EINVAL;
+    return -1;
+  }
+
+  dir_url = urlconf_dir_url(p, url);
+  ptr = data->buf + magiclen;
+  end = data->buf + data->buflen;
+
+  while (ptr < end) {
+    const char *eol, *sp, *member;
+    char *name, *buf;
+    unsigned long len;
+
+    pr_signals_handle();
+
+    eol = memchr(ptr, '\n', end - ptr);
+    if (eol == NULL) {
+      break;
+    }
+
+    sp = eol;
+    while (sp > ptr &&
+           *sp != ' ') {
+      sp--;
+    }
+
+    name = pstrndup(p, ptr, sp - ptr);
+    if (sp == ptr ||
+        urlconf_parse_number(pstrndup(p, sp + 1, eol - sp - 1), &len) < 0 ||
+        urlconf_bundle_name_valid(name) == FALSE) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": invalid member header '%.*s' in '%s' bundle", (int) (eol - ptr),
+        ptr, url);
+      errno = EINVAL;
+      return -1;
+    }
+
+    member = eol + 1;
+    if ((size_t) (end - member) < len) {
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": truncated member '%s' in '%s' bundle", name, url);
+      errno = EINVAL;
+      return -1;
+    }
+
+    buf = palloc(urlconf_get_parse_pool(), len + 1);
+    memcpy(buf, member, len);
+    buf[len] = '\0';
+
+    if (count == 0) {
+      main_buf = buf;
+      main_buflen = len;
+
+    } else {
+      const char *member_url;
+
+      member_url = pstrcat(urlconf_get_parse_pool(), dir_url, "/", name,
+        NULL);
+      pr_trace_msg(trace_channel, 15, "unpacked bundle member '%s' (%lu bytes)",
+        member_url, len);
+
+      (void) urlconf_add_body(member_url, buf, len, TRUE, NULL);
+      urlconf_add_listing(member_url);
+    }
+
+    count++;
+
+    ptr = member + len;
+    if (ptr < end &&
+        *ptr == '\n') {
+      ptr++;
+    }
+  }
+
+  if (count == 0) {
+    pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION ": '%s' bundle is empty", url);
+    errno = EINVAL;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "unpacked %d %s from '%s' bundle", count,
+    count != 1 ? "members" : "member", url);
+
+  data->buf = data->ptr = main_buf;
+  data->buflen = data->bufsz = main_buflen;
+  data->alloc_bytes += main_buflen + 1;
+
+  return 0;
+}
+
+/* A URL to be fetched in advance, with the libcurl handle flags and TLS
+ * settings to use and, for revalidating a cached copy, the size and
+ * validators of the response last seen.
+ */
+struct urlconf_fetch {
+  const char *url;
+  unsigned long flags;
+  const char *ssl_ca_file;
+  const char *ssl_ca_path;
+  const char *ssl_cert;
+  const char *ssl_key;
+  size_t size;
+  const char *etag;
+  const char *last_modified;
+};
+
+/* Fetches the given URLs concurrently, storing their response bodies for
+ * use when the parser opens them.  Fresh cached responses are used as is;
+ * stale ones, whose validators are known, are revalidated rather than
+ * fetched again.  Failed URLs are simply fetched again, when opened, so
+ * that any errors are reported then.
+ */
+static int urlconf_fetch_many(pool *p, array_header *fetches,
+    const char *what) {
+  register unsigned int i;
+  pool *resp_pool;
+  array_header *reqs;
+  char **stale_data;
+  size_t *stale_datalens;
+
+  /* Without concurrent fetches, the parser fetches each URL as it goes. */
+  if (urlconf_backend_can(URLCONF_BACKEND_CAP_MANY) == FALSE) {
+    errno = ENOSYS;
+    return -1;
+  }
+
+  /* The responses are received into this pool; the bodies kept are copied
+   * out of it, without the buffers outgrown while receiving them.
+   */
+  resp_pool = make_sub_pool(p);
+  pr_pool_tag(resp_pool, "URL Configuration fetch responses pool");
+
+  reqs = make_array(p, 0, sizeof(struct urlconf_http_req *));
+
+  /* The stale cached copies being revalidated, indexed as the requests. */
+  stale_data = pcalloc(p, (fetches->nelts + 1) * sizeof(char *));
+  stale_datalens = pcalloc(p, (fetches->nelts + 1) * sizeof(size_t));
+
+  for (i = 0; i < fetches->nelts; i++) {
+    struct urlconf_fetch *fetch;
+    struct urlconf_http_req *req;
+    struct urlconf_data *fetch_data;
+    char *cached_data = NULL;
+    size_t cached_datalen = 0;
+
+    fetch = ((struct urlconf_fetch **) fetches->elts)[i];
+
+    if (urlconf_bodies != NULL &&
+        pr_table_exists(urlconf_bodies, fetch->url) > 0) {
+      continue;
+    }
+
+    req = pcalloc(p, sizeof(struct urlconf_http_req));
+
+    if (urlconf_cache_dir != NULL) {
+      if (urlconf_cache_get(p, urlconf_cache_dir, fetch->url,
+          urlconf_cache_ttl, &cached_data, &cached_datalen) == 0) {
+        urlconf_body_set_metrics(urlconf_add_body(fetch->url, cached_data,
+          cached_datalen, FALSE, NULL), "hit", NULL);
+        continue;
+      }
+
+      /* A stale copy can be revalidated, provided that it is the copy to
+       * which the validators apply.
+       */
+      if ((fetch->etag != NULL || fetch->last_modified != NULL) &&
+          urlconf_cache_get(p, urlconf_cache_dir, fetch->url, (unsigned long) -1,
+            &cached_data, &cached_datalen) == 0 &&
+          cached_datalen == fetch->size) {
+        req->headers = pr_table_alloc(p, 0);
+        if (fetch->etag != NULL) {
+          (void) pr_table_add(req->headers,
+            URLCONF_HTTP_HEADER_IF_NONE_MATCH, fetch->etag, 0);
+        }
+
+        if (fetch->last_modified != NULL) {
+          (void) pr_table_add(req->headers,
+            URLCONF_HTTP_HEADER_IF_MODIFIED_SINCE, fetch->last_modified, 0);
+        }
+
+        stale_data[reqs->nelts] = cached_data;
+        stale_datalens[reqs->nelts] = cached_datalen;
+      }
+    }
+
+    fetch_data = pcalloc(p, sizeof(struct urlconf_data));
+    fetch_data->pool = resp_pool;
+
+    req->url = fetch->url;
+    req->resp_body = urlconf_data_cb;
+    req->user_data = fetch_data;
+    req->flags = fetch->flags;
+    req->ssl_ca_file = fetch->ssl_ca_file;
+    req->ssl_ca_path = fetch->ssl_ca_path;
+    req->ssl_cert = fetch->ssl_cert;
+    req->ssl_key = fetch->ssl_key;
+    /* The headers are kept with the prefetched body, beyond this pool. */
+    req->resp_headers_pool = urlconf_get_parse_pool();
+    req->resp_headers = pr_table_alloc(req->resp_headers_pool, 0);
+
+    /* The shared headers carry no token; only these requests may. */
+    if (urlconf_token_wanted(fetch->url) == TRUE) {
+      if (req->headers == NULL) {
+        req->headers = pr_table_alloc(p, 0);
+      }
+
+      (void) urlconf_token_add_header(p, req->headers);
+    }
+
+    *((struct urlconf_http_req **) push_array(reqs)) = req;
+  }
+
+  if (reqs->nelts == 0) {
+    destroy_pool(resp_pool);
+    return 0;
+  }
+
+  pr_trace_msg(trace_channel, 9, "fetching %d %s concurrently", reqs->nelts,
+    what);
+
+  if (urlconf_http_get_many(p, reqs, urlconf_request_headers(p, NULL),
+      URLCONF_CONNECT_TIMEOUT, URLCONF_REQUEST_TIMEOUT, 0UL) < 0) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "error fetching %s: %s", what,
+      strerror(xerrno));
+    destroy_pool(resp_pool);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  for (i = 0; i < reqs->nelts; i++) {
+    struct urlconf_http_req *req;
+    struct urlconf_data *fetch_data;
+    struct urlconf_body *body;
+
+    req = ((struct urlconf_http_req **) reqs->elts)[i];
+    fetch_data = req->user_data;
+
+    if (req->xerrno != 0) {
+      continue;
+    }
+
+    if (req->resp_code == URLCONF_HTTP_RESPONSE_CODE_NOT_MODIFIED &&
+        stale_data[i] != NULL) {
+      pr_trace_msg(trace_channel, 15, "cached response for '%s' revalidated",
+        req->url);
+
+      urlconf_body_set_metrics(urlconf_add_body(req->url, stale_data[i],
+        stale_datalens[i], FALSE, req->resp_headers), "revalidated",
+        &(req->timing));
+
+      /* Refresh the cached copy, restarting its TTL. */
+      (void) urlconf_cache_put(p, urlconf_cache_dir, req->url, stale_data[i],
+        stale_datalens[i]);
+      continue;
+    }
+
+    if (urlconf_resp_errno(req->resp_code, req->url) < 0) {
+      continue;
+    }
+
+    body = urlconf_add_body(req->url, fetch_data->buf, fetch_data->buflen,
+      FALSE, req->resp_headers);
+    if (body != NULL) {
+      body->alloc_bytes += fetch_data->alloc_bytes;
+    }
+
+    urlconf_body_set_metrics(body, urlconf_cache_dir != NULL ? "miss" : "none",
+      &(req->timing));
+
+    if (urlconf_cache_dir != NULL) {
+      (void) urlconf_cache_put(p, urlconf_cache_dir, req->url,
+        fetch_data->buf != NULL ? fetch_data->buf : "", fetch_data->buflen);
+    }
+  }
+
+  destroy_pool(resp_pool);
+  return 0;
+}
+
+/* When opening an entry of a listed directory, i.e. from a wildcard Include,
+ * fetch all of the listed entries with the same extension concurrently,
+ * rather than one at a time as the parser opens them.
+ */
+static void urlconf_prefetch_entries(pool *p, struct urlconf_data *data,
+    const char *url) {
+  register unsigned int i;
+  const char *ptr, *name, *ext, *dir_url;
+  struct urlconf_listing *listing;
+  array_header *fetches;
+  char **names;
+
+  if (urlconf_listings == NULL) {
+    return;
+  }
+
+  ptr = strrchr(url, '/');
+  if (ptr == NULL) {
+    return;
+  }
+
+  dir_url = pstrndup(p, url, ptr - url);
+  name = ptr + 1;
+
+  listing = (struct urlconf_listing *) pr_table_get(urlconf_listings, dir_url,
+    NULL);
+  if (listing == NULL ||
+      listing->prefetched == TRUE) {
+    return;
+  }
+
+  listing->prefetched = TRUE;
+  ext = strrchr(name, '.');
+
+  fetches = make_array(p, 0, sizeof(struct urlconf_fetch *));
+  names = listing->names->elts;
+
+  for (i = 0; i < listing->names->nelts; i++) {
+    struct urlconf_fetch *fetch;
+    const char *entry_url, *entry_ext;
+
+    entry_ext = strrchr(names[i], '.');
+    if (ext != NULL ?
+          (entry_ext == NULL || strcmp(ext, entry_ext) != 0) :
+          entry_ext != NULL) {
+      continue;
+    }
+
+    entry_url = pstrcat(p, dir_url, "/", names[i], NULL);
+    if (urlconf_bodies != NULL &&
+        pr_table_exists(urlconf_bodies, entry_url) > 0) {
+      continue;
+    }
+
+    if (urlconf_breaker_check(data->host, entry_url) < 0) {
+      continue;
+    }
+
+    fetch = pcalloc(p, sizeof(struct urlconf_fetch));
+    fetch->url = entry_url;
+    fetch->flags = urlconf_http_flags(data);
+    fetch->ssl_ca_file = data->ssl_ca_file;
+    fetch->ssl_ca_path = data->ssl_ca_path;
+    fetch->ssl_cert = data->ssl_cert;
+    fetch->ssl_key = data->ssl_key;
+
+    *((struct urlconf_fetch **) push_array(fetches)) = fetch;
+  }
+
+  if (fetches->nelts < 2) {
+    /* Nothing gained by fetching a single entry in advance. */
+    return;
+  }
+
+  (void) urlconf_fetch_many(p, fetches,
+    pstrcat(p, "entries of '", dir_url, "'", NULL));
+}
+
+/* Records the opened URL, and the URL which included it, in the include
+ * graph.
+ */
+static void urlconf_state_url(struct urlconf_data *data, const char *url) {
+  const char *parent = NULL, *etag = NULL, *last_modified = NULL;
+
+  /* Bundle members are fetched with their bundle. */
+  if (data->bundled == TRUE) {
+    return;
+  }
+
+  if (urlconf_open_urls != NULL &&
+      urlconf_open_urls->nelts > 0) {
+    parent = ((char **) urlconf_open_urls->elts)[urlconf_open_urls->nelts-1];
+  }
+
+  if (data->resp_headers != NULL) {
+    etag = pr_table_get(data->resp_headers, "etag", NULL);
+    last_modified = pr_table_get(data->resp_headers, "last-modified", NULL);
+  }
+
+  if (urlconf_state_add(url, parent, data->buflen, urlconf_http_flags(data),
+      etag, last_modified, data->ssl_ca_file, data->ssl_ca_path,
+      data->ssl_cert, data->ssl_key) < 0) {
+    pr_trace_msg(trace_channel, 3, "error recording '%s' in include graph: %s",
+      url, strerror(errno));
+  }
+}
+
+/* Fetches, or revalidates, all of the URLs recorded in the state file
+ * concurrently, before the parser reaches them.
+ */
+static void urlconf_warm_up(void) {
+  register unsigned int i;
+  pool *tmp_pool;
+  array_header *entries, *fetches;
+
+  if (urlconf_state_path == NULL ||
+      urlconf_warmed_up == TRUE) {
+    return;
+  }
+
+  urlconf_warmed_up = TRUE;
+
+  tmp_pool = make_sub_pool(urlconf_get_parse_pool());
+  pr_pool_tag(tmp_pool, "URL Configuration warm-up pool");
+
+  entries = urlconf_state_load(tmp_pool, urlconf_state_path);
+  if (entries == NULL) {
+    destroy_pool(tmp_pool);
+    return;
+  }
+
+  fetches = make_array(tmp_pool, 0, sizeof(struct urlconf_fetch *));
+
+  for (i = 0; i < entries->nelts; i++) {
+    struct urlconf_state_entry *entry;
+    struct urlconf_fetch *fetch;
+
+    entry = ((struct urlconf_state_entry **) entries->elts)[i];
+
+    /* Local files gain nothing from being read in advance. */
+    if (strncasecmp(entry->url, "file://", 7) == 0) {
+      continue;
+    }
+
+    fetch = pcalloc(tmp_pool, sizeof(struct urlconf_fetch));
+    fetch->url = entry->url;
+    fetch->flags = entry->flags;
+    fetch->size = entry->size;
+    fetch->etag = entry->etag;
+    fetch->last_modified = entry->last_modified;
+    fetch->ssl_ca_file = entry->ssl_ca_file;
+    fetch->ssl_ca_path = entry->ssl_ca_path;
+    fetch->ssl_cert = entry->ssl_cert;
+    fetch->ssl_key = entry->ssl_key;
+
+    *((struct urlconf_fetch **) push_array(fetches)) = fetch;
+  }
+
+  (void) urlconf_fetch_many(tmp_pool, fetches, "recorded URLs");
+  destroy_pool(tmp_pool);
+}
+
+/* Scans the given configuration text for Include directives whose paths
+ * are URLs that we handle, returning a list of those URLs.
+ */
+static array_header *urlconf_scan_includes(pool *p, const char *text,
+    size_t textlen) {
+  array_header *urls;
+  const char *line, *end;
+
+  urls = make_array(p, 0, sizeof(char *));
+  end = text + textlen;
+
+  for (line = text; line < end;) {
+    const char *eol, *ptr, *word;
+    size_t linelen;
+
+    pr_signals_handle();
+
+    eol = memchr(line, '\n', end - line);
+    if (eol == NULL) {
+      eol = end;
+    }
+
+    linelen = eol - line;
+    ptr = line;
+    while (ptr < eol &&
+           PR_ISSPACE(*ptr)) {
+      ptr++;
+    }
+
+    if ((size_t) (eol - ptr) > 8 &&
+        strncasecmp(ptr, "Include", 7) == 0 &&
+        PR_ISSPACE(ptr[7])) {
+      ptr += 8;
+      while (ptr < eol &&
+             PR_ISSPACE(*ptr)) {
+        ptr++;
+      }
+
+      if (ptr < eol &&
+          *ptr == '"') {
+        ptr++;
+      }
+
+      word = ptr;
+      while (ptr < eol &&
+             !PR_ISSPACE(*ptr) &&
+             *ptr != '"') {
+        ptr++;
+      }
+
+      if (ptr > word) {
+        char *url;
+
+        url = pstrndup(p, word, ptr - word);
+        if (urlconf_scheme_supported(url) == TRUE) {
+          *((char **) push_array(urls)) = url;
+        }
+      }
+    }
+
+    line += linelen + 1;
+  }
+
+  return urls;
+}
+
+/* Resolves, concurrently, the hosts of any URLs Included by the given
+ * configuration text, so that those lookups are not done one at a time
+ * as the parser reaches each Include.  Failures are remembered, so that
+ * Includes for unresolvable/unreachable hosts fail fast.
+ */
+static void urlconf_prefetch_dns(pool *p, const char *text, size_t textlen) {
+  register unsigned int i;
+  array_header *includes, *urls, *hosts;
+  char **elts;
+  int *errnos;
+
+  includes = urlconf_scan_includes(p, text, textlen);
+  if (includes->nelts == 0) {
+    return;
+  }
+
+  if (urlconf_prefetched_hosts == NULL) {
+    urlconf_prefetched_hosts = pr_table_alloc(urlconf_get_parse_pool(), 0);
+  }
+
+  urls = make_array(p, includes->nelts, sizeof(char *));
+  hosts = make_array(p, includes->nelts, sizeof(char *));
+
+  elts = includes->elts;
+  for (i = 0; i < includes->nelts; i++) {
+    char *scheme = NULL, *host = NULL, *path = NULL, *username, *password;
+    const char *host_key, *default_port;
+    unsigned int port = 0;
+    pr_table_t *params;
+    char port_text[16];
+
+    params = pr_table_alloc(p, 0);
+    if (urlconf_uri_parse(p, elts[i], &scheme, &host, &port, &path, &username,
+        &password, params) < 0) {
+      continue;
+    }
+
+    if (strcmp(scheme, "file://") == 0) {
+      continue;
+    }
+
+    host_key = urlconf_host_key(p, scheme, host, port);
+    if (pr_table_exists(urlconf_prefetched_hosts, host_key) > 0) {
+      continue;
+    }
+
+    (void) pr_table_add_dup(urlconf_prefetched_hosts,
+      pstrdup(urlconf_get_parse_pool(), host_key), "", 0);
 
-  if (data->bufsz > 0) {
-    ptr = data->buf;
+    /* We only want the lookup, not any TLS or application protocol
+     * handshakes; thus we always use an "http://" URL, to the port that the
+     * real URL would use (which is part of the DNS cache key).
+     */
+    if (port == 0) {
+      if (strcmp(scheme, "https://") == 0) {
+        default_port = "443";
 
-    data->ptr = data->buf = palloc(data->pool, data->bufsz + bufsz);
-    memcpy(data->buf, ptr, data->bufsz);
+      } else if (strcmp(scheme, "http://") == 0) {
+        default_port = "80";
 
-    ptr = data->buf + data->bufsz;
-    data->buf += bufsz;
+      } else {
+        default_port = "21";
+      }
 
-  } else {
-    data->bufsz = data->buflen = bufsz;
-    data->ptr = data->buf = palloc(data->pool, bufsz);
+    } else {
+      memset(port_text, '\0', sizeof(port_text));
+      snprintf(port_text, sizeof(port_text)-1, "%u", port);
+      default_port = port_text;
+    }
 
-    ptr = data->buf;
+    *((char **) push_array(urls)) = pstrcat(p, "http://",
+      strchr(host, ':') != NULL ? "[" : "", host,
+      strchr(host, ':') != NULL ? "]" : "", ":", default_port, "/", NULL);
+    *((const char **) push_array(hosts)) = host_key;
   }
 
-  memcpy(ptr, buf, bufsz);
-  return bufsz;
-}
-
-static int urlconf_get_data(pool *p, void *http, const char *url,
-    size_t (*resp_body)(char *, size_t, size_t, void *),
-    void *user_data) {
-  int res;
-  long resp_code;
-  const char *content_type = NULL;
-  pr_table_t *headers;
+  if (urls->nelts == 0) {
+    return;
+  }
 
-  headers = urlconf_http_default_headers(p);
-  res = urlconf_http_get(p, http, url, headers, resp_body, user_data,
-    &resp_code, &content_type);
-  if (res < 0) {
-    return -1;
+  errnos = pcalloc(p, urls->nelts * sizeof(int));
+  if (urlconf_http_resolve(p, urls, URLCONF_CONNECT_TIMEOUT, errnos) < 0) {
+    pr_trace_msg(trace_channel, 3, "error resolving Included hosts: %s",
+      strerror(errno));
+    return;
   }
 
-  switch (resp_code) {
-    case URLCONF_FILE_RESPONSE_CODE_OK:
-    case URLCONF_FTP_RESPONSE_CODE_OK:
-    case URLCONF_HTTP_RESPONSE_CODE_OK:
-      break;
+  /* Only the lookups were done, so only their failures say anything about
+   * the hosts; e.g. timing out while resolving a host is not a failure to
+   * connect to it, and a successful lookup is not a successful fetch.
+   */
+  elts = urls->elts;
+  for (i = 0; i < urls->nelts; i++) {
+    const char *host_key;
 
-    case URLCONF_HTTP_RESPONSE_CODE_BAD_REQUEST:
-      pr_trace_msg(trace_channel, 2,
-        "received %ld response code for '%s' request", resp_code, url);
-      errno = EINVAL;
-      return -1;
+    if (errnos[i] != ESRCH) {
+      continue;
+    }
 
-    case URLCONF_FTP_RESPONSE_CODE_NOT_LOGGED_IN:
-    case URLCONF_HTTP_RESPONSE_CODE_FORBIDDEN:
-      pr_trace_msg(trace_channel, 2,
-        "received %ld response code for '%s' request", resp_code, url);
-      errno = EACCES;
-      return -1;
+    host_key = ((const char **) hosts->elts)[i];
+    (void) urlconf_breaker_record(host_key, elts[i], errnos[i]);
+  }
+}
 
-    case URLCONF_FTP_RESPONSE_CODE_NOT_FOUND:
-    case URLCONF_HTTP_RESPONSE_CODE_NOT_FOUND:
-      pr_trace_msg(trace_channel, 2,
-        "received %ld response code for '%s' request", resp_code, url);
-      errno = ENOENT;
-      return -1;
+/* Returns the peak resident set size of the process, in KB, or -1 if not
+ * known.
+ */
+static long urlconf_get_maxrss(void) {
+  struct rusage ru;
 
-    default:
-      pr_trace_msg(trace_channel, 2,
-        "received %ld response code for '%s' request", resp_code, url);
-      errno = EPERM;
-      return -1;
+  if (getrusage(RUSAGE_SELF, &ru) < 0) {
+    return -1;
   }
 
-  return 0;
+#if defined(__APPLE__)
+  /* Reported in bytes, rather than KB. */
+  return (long) (ru.ru_maxrss / 1024);
+#else
+  return (long) ru.ru_maxrss;
+#endif
 }
 
-/* Construct the configuration file from the URL. */
-static int urlconf_read_url(pool *p, pr_fh_t *fh, const char *url) {
-  int res, xerrno;
-  void *http;
-  unsigned long http_flags;
-  struct urlconf_data *data;
-
-  data = fh->fh_data;
-
-  http_flags = urlconf_flags;
-  if (data->ftps) {
-    http_flags |= URLCONF_FL_CURL_USE_SSL;
+/* Adds the details of fetching the URL to the cumulative statistics, and
+ * the memory used by this parse, and writes them to the metrics log, if
+ * any.  The given maxrss is the peak resident set size before fetching.
+ */
+static void urlconf_log_metrics(struct urlconf_data *data, const char *url,
+    int xerrno, long maxrss) {
+  struct urlconf_metrics metrics;
+  long maxrss_growth = 0;
+  pool *tmp_pool;
+
+  if (maxrss >= 0) {
+    long now_maxrss;
+
+    now_maxrss = urlconf_get_maxrss();
+    if (now_maxrss > maxrss) {
+      maxrss_growth = now_maxrss - maxrss;
+    }
   }
 
-  if (data->ssl_verify == FALSE) {
-    http_flags |= URLCONF_FL_CURL_NO_VERIFY;
-  }
+  pr_trace_msg(trace_channel, 9, "'%s': %lu bytes of content, %lu bytes of "
+    "buffers, peak RSS grew by %ld KB", url, (unsigned long) data->buflen,
+    (unsigned long) data->alloc_bytes, maxrss_growth);
 
-  http = urlconf_http_alloc(p, URLCONF_CONNECT_TIMEOUT,
-    URLCONF_REQUEST_TIMEOUT, http_flags);
-  if (http == NULL) {
-    return -1;
-  }
+  urlconf_mem_urls++;
+  urlconf_mem_size += data->buflen;
+  urlconf_mem_alloc_bytes += data->alloc_bytes;
 
-  res = urlconf_get_data(p, http, url, urlconf_data_cb, fh->fh_data);
-  xerrno = errno;
+  memset(&metrics, 0, sizeof(metrics));
+  metrics.url = url;
+  metrics.cache = data->cache;
+  metrics.prefetched = data->prefetched;
+  metrics.xerrno = xerrno;
+  metrics.size = data->buflen;
+  metrics.timing = &(data->timing);
+  metrics.alloc_bytes = data->alloc_bytes;
+  metrics.maxrss_growth = maxrss_growth;
 
-  urlconf_http_destroy(p, http);
+  (void) urlconf_stats_record(&metrics);
 
-  errno = xerrno;
-  return res;
+  if (urlconf_metrics_log_set == FALSE) {
+    return;
+  }
+
+  tmp_pool = make_sub_pool(data->pool);
+  (void) urlconf_metrics_log(tmp_pool, &metrics);
+  destroy_pool(tmp_pool);
 }
 
 /* FSIO callbacks
@@ -367,39 +3285,147 @@ static int urlconf_fsio_stat(pr_fs_t *fs, const char *path, struct stat *st) {
   return stat(path, st);
 }
 
-static int urlconf_fsio_open(pr_fh_t *fh, const char *path, int flags) {
+/* Opens the URL for the configuration parser, returning our fake file
+ * descriptor.
+ */
+static int urlconf_open_url(pr_fh_t *fh, const char *path) {
+  pool *p;
+  char *url;
+  long maxrss;
+  struct urlconf_data *data;
 
-  /* Is this a path that we can use? */
-  if (urlconf_scheme_supported(path) == TRUE) {
-    pool *p;
-    char *url;
-    struct urlconf_data *data;
-    int ftps = FALSE, ssl_verify = TRUE;
+  p = make_sub_pool(fh->fh_pool);
+  pr_pool_tag(p, "URL Configuration Pool");
+  data = pcalloc(p, sizeof(struct urlconf_data));
+  data->pool = p;
+  data->ssl_verify = TRUE;
+  fh->fh_data = data;
+
+  url = pstrdup(data->pool, path);
+  pr_log_debug(DEBUG10, MOD_CONF_URL_VERSION ": opening path '%s'", url);
 
-    p = make_sub_pool(fh->fh_pool);
-    pr_pool_tag(p, "URL Configuration Pool");
-    data = pcalloc(p, sizeof(struct urlconf_data));
-    data->pool = p;
-    fh->fh_data = data;
+  /* Parse through the given URI, breaking out the needed pieces. */
+  if (urlconf_parse_uri(data->pool, &url, data, &use_tracing) < 0) {
+    return -1;
+  }
 
-    url = pstrdup(data->pool, path);
-    pr_log_debug(DEBUG10, MOD_CONF_URL_VERSION ": opening path '%s'", url);
+  if (urlconf_state_path_set == TRUE) {
+    urlconf_warm_up();
+  }
 
-    /* Parse through the given URI, breaking out the needed pieces. */
-    if (urlconf_parse_uri(data->pool, &url, &ftps, &use_tracing,
-        &ssl_verify) < 0) {
-      return -1;
-    }
+  maxrss = urlconf_get_maxrss();
+  if (urlconf_mem_maxrss < 0) {
+    urlconf_mem_maxrss = maxrss;
+  }
 
-    data->ftps = ftps;
-    data->ssl_verify = ssl_verify;
+  urlconf_prefetch_entries(data->pool, data, url);
 
-    if (urlconf_read_url(data->pool, fh, url) < 0) {
-      return -1;
+  if (urlconf_read_url(data->pool, fh, url) < 0) {
+    int xerrno = errno;
+
+    urlconf_log_metrics(data, url, xerrno, maxrss);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  urlconf_log_metrics(data, url, 0, maxrss);
+
+  /* Compressed responses are inflated as they are read, except when their
+   * content is needed before then.
+   */
+  if (data->zbuf != NULL) {
+    if (data->integrity != NULL ||
+        data->watch_type != 0 ||
+        urlconf_watch_interval > 0 ||
+        data->bundle == TRUE ||
+        urlconf_dns_prefetch == TRUE) {
+      if (urlconf_compress_inflate_data(data->pool, data->zbuf,
+          data->zbuflen, &(data->buf), data->buflen) < 0) {
+        return -1;
+      }
+
+      data->ptr = data->buf;
+      data->bufsz = data->buflen;
+      data->zbuf = NULL;
+      data->zbuflen = 0;
+
+    } else {
+      data->zh = urlconf_compress_inflate_open(data->pool, data->zbuf,
+        data->zbuflen);
+      if (data->zh == NULL) {
+        return -1;
+      }
     }
+  }
+
+  if (data->integrity != NULL &&
+      urlconf_check_integrity(data->pool, data, url) < 0) {
+    return -1;
+  }
+
+  if (data->watch_type != 0 ||
+      urlconf_watch_interval > 0) {
+    urlconf_watch_url(data->pool, data, url);
+  }
+
+  if (data->bundle == TRUE &&
+      urlconf_unpack_bundle(data->pool, data, url) < 0) {
+    return -1;
+  }
+
+  if (urlconf_dns_prefetch == TRUE &&
+      urlconf_backend_can(URLCONF_BACKEND_CAP_MANY) == TRUE &&
+      data->buflen > 0) {
+    pool *tmp_pool;
+
+    tmp_pool = make_sub_pool(data->pool);
+    urlconf_prefetch_dns(tmp_pool, data->buf, data->buflen);
+    destroy_pool(tmp_pool);
+  }
+
+  if (urlconf_state_path_set == TRUE) {
+    urlconf_state_url(data, url);
+  }
+
+  if (urlconf_open_urls == NULL) {
+    urlconf_open_urls = make_array(urlconf_get_parse_pool(), 0,
+      sizeof(char *));
+  }
+
+  /* The URL lasts as long as its handle, i.e. until it is popped when
+   * closed, so there is no need to copy it into the parse pool.
+   */
+  *((char **) push_array(urlconf_open_urls)) = url;
+
+  /* Return a fake file descriptor. */
+  return URLCONF_FILENO;
+}
 
-    /* Return a fake file descriptor. */
-    return URLCONF_FILENO;
+static int urlconf_fsio_open(pr_fh_t *fh, const char *path, int flags) {
+
+  /* Is this a path that we can use? */
+  if (urlconf_scheme_supported(path) == TRUE) {
+    int res, xerrno;
+    struct timeval start, end;
+    unsigned long usecs;
+
+    gettimeofday(&start, NULL);
+    res = urlconf_open_url(fh, path);
+    xerrno = errno;
+    gettimeofday(&end, NULL);
+
+    /* Track the time spent per open, including any fetching, for sizing
+     * configurations with many URLs.
+     */
+    usecs = (unsigned long) (((end.tv_sec - start.tv_sec) * 1000000L) +
+      (end.tv_usec - start.tv_usec));
+    urlconf_mem_open_usecs += usecs;
+
+    pr_trace_msg(trace_channel, 12, "opened '%s' in %lu usecs", path, usecs);
+
+    errno = xerrno;
+    return res;
   }
 
   /* Default normal open. */
@@ -408,6 +3434,11 @@ static int urlconf_fsio_open(pr_fh_t *fh, const char *path, int flags) {
 
 static int urlconf_fsio_close(pr_fh_t *fh, int fd) {
   if (fd == URLCONF_FILENO) {
+    if (urlconf_open_urls != NULL &&
+        urlconf_open_urls->nelts > 0) {
+      urlconf_open_urls->nelts--;
+    }
+
     return 0;
   }
 
@@ -416,29 +3447,35 @@ static int urlconf_fsio_close(pr_fh_t *fh, int fd) {
 
 static int urlconf_fsio_read(pr_fh_t *fh, int fd, char *buf, size_t buflen) {
 
-  /* Make sure this filehandle is for this module before trying to use it. */
+  /* Make sure this filehandle is for this module before trying to use it;
+   * only our open callback returns our fake file descriptor.
+   */
   if (fd == URLCONF_FILENO &&
-      fh->fh_path != NULL &&
-      urlconf_scheme_supported(fh->fh_path) == TRUE) {
+      fh->fh_data != NULL) {
     struct urlconf_data *data;
 
     data = fh->fh_data;
 
-    if (data->buflen > 0) {
+    /* Inflate compressed responses directly into the caller's buffer. */
+    if (data->zh != NULL) {
+      return urlconf_compress_inflate_read(data->zh, buf, buflen);
+    }
+
+    if (data->ptr != NULL &&
+        data->ptr < data->buf + data->buflen) {
       size_t len;
 
       /* Read from our built-up buffer, until there are no more data to be
        * read.
        */
 
-      len = data->buflen;
+      len = (data->buf + data->buflen) - data->ptr;
       if (len > buflen) {
         len = buflen;
       }
 
-      memmove(buf, data->buf, len);
-      data->buf += len;
-      data->buflen -= len;
+      memmove(buf, data->ptr, len);
+      data->ptr += len;
 
       return len;
     }
@@ -450,6 +3487,160 @@ static int urlconf_fsio_read(pr_fh_t *fh, int fd, char *buf, size_t buflen) {
   return read(fd, buf, buflen);
 }
 
+static void *urlconf_fsio_opendir(pr_fs_t *fs, const char *path) {
+  pool *p;
+  struct urlconf_dir *dir;
+
+  p = make_sub_pool(urlconf_get_parse_pool());
+  pr_pool_tag(p, "URL Configuration Directory Pool");
+
+  dir = pcalloc(p, sizeof(struct urlconf_dir));
+  dir->pool = p;
+  dir->dent = pcalloc(p, sizeof(struct dirent));
+
+  /* Is this a path that we can use? */
+  if (urlconf_scheme_supported(path) == TRUE &&
+      strncasecmp(path, "file://", 7) != 0) {
+    pr_log_debug(DEBUG10, MOD_CONF_URL_VERSION ": listing path '%s'", path);
+
+    dir->names = urlconf_list_url(p, path);
+    if (dir->names == NULL) {
+      int xerrno = errno;
+
+      destroy_pool(p);
+      errno = xerrno;
+      return NULL;
+    }
+
+    return dir;
+  }
+
+  if (strncasecmp(path, "file://", 7) == 0) {
+    path += 7;
+  }
+
+  /* Default normal opendir. */
+  dir->dirh = opendir(path);
+  if (dir->dirh == NULL) {
+    int xerrno = errno;
+
+    destroy_pool(p);
+    errno = xerrno;
+    return NULL;
+  }
+
+  return dir;
+}
+
+static struct dirent *urlconf_fsio_readdir(pr_fs_t *fs, void *dirh) {
+  struct urlconf_dir *dir;
+  char **names;
+
+  dir = dirh;
+  if (dir->dirh != NULL) {
+    return readdir(dir->dirh);
+  }
+
+  if (dir->idx >= dir->names->nelts) {
+    return NULL;
+  }
+
+  names = dir->names->elts;
+  sstrncpy(dir->dent->d_name, names[dir->idx++], sizeof(dir->dent->d_name));
+
+  return dir->dent;
+}
+
+static int urlconf_fsio_closedir(pr_fs_t *fs, void *dirh) {
+  struct urlconf_dir *dir;
+  int res = 0;
+
+  dir = dirh;
+  if (dir->dirh != NULL) {
+    res = closedir(dir->dirh);
+  }
+
+  destroy_pool(dir->pool);
+  return res;
+}
+
+/* Configuration handlers
+ */
+
+/* usage: ConfURLControlsACLs actions|all allow|deny user|group list */
+MODRET set_confurlctrlsacls(cmd_rec *cmd) {
+#if defined(PR_USE_CTRLS)
+  char *bad_action = NULL, **actions = NULL;
+
+  CHECK_ARGS(cmd, 4);
+  CHECK_CONF(cmd, CONF_ROOT);
+
+  actions = pr_ctrls_parse_acl(cmd->tmp_pool, cmd->argv[1]);
+
+  if (strcmp(cmd->argv[2], "allow") != 0 &&
+      strcmp(cmd->argv[2], "deny") != 0) {
+    CONF_ERROR(cmd, "second parameter must be 'allow' or 'deny'");
+  }
+
+  if (strcmp(cmd->argv[3], "user") != 0 &&
+      strcmp(cmd->argv[3], "group") != 0) {
+    CONF_ERROR(cmd, "third parameter must be 'user' or 'group'");
+  }
+
+  bad_action = pr_ctrls_set_module_acls(urlconf_acttab, urlconf_pool,
+    actions, cmd->argv[2], cmd->argv[3], cmd->argv[4]);
+  if (bad_action != NULL) {
+    CONF_ERROR(cmd, pstrcat(cmd->tmp_pool, ": unknown action: '",
+      bad_action, "'", NULL));
+  }
+
+  return PR_HANDLED(cmd);
+#else
+  CONF_ERROR(cmd, "requires Controls support (use --enable-ctrls)");
+#endif /* PR_USE_CTRLS */
+}
+
+/* Controls handlers
+ */
+
+#if defined(PR_USE_CTRLS)
+static int urlconf_handle_conf_url(pr_ctrls_t *ctrl, int reqargc,
+    char **reqargv) {
+  register unsigned int i;
+  array_header *lines;
+  char **elts;
+  pool *tmp_pool;
+
+  if (!pr_ctrls_check_acl(ctrl, urlconf_acttab, "conf_url")) {
+    pr_ctrls_add_response(ctrl, "access denied");
+    return -1;
+  }
+
+  if (reqargc != 1 ||
+      strcmp(reqargv[0], "stats") != 0) {
+    pr_ctrls_add_response(ctrl, "conf_url: usage: conf_url stats");
+    return -1;
+  }
+
+  tmp_pool = make_sub_pool(urlconf_pool);
+  lines = urlconf_stats_get_text(tmp_pool);
+  if (lines == NULL) {
+    pr_ctrls_add_response(ctrl, "conf_url: error getting stats: %s",
+      strerror(errno));
+    destroy_pool(tmp_pool);
+    return -1;
+  }
+
+  elts = lines->elts;
+  for (i = 0; i < lines->nelts; i++) {
+    pr_ctrls_add_response(ctrl, "%s", elts[i]);
+  }
+
+  destroy_pool(tmp_pool);
+  return 0;
+}
+#endif /* PR_USE_CTRLS */
+
 /* Event handlers
  */
 
@@ -461,11 +3652,27 @@ static void urlconf_mod_unload_ev(const void *event_data, void *user_data) {
 
   /* Unregister ourselves from all events. */
   pr_event_unregister(&conf_url_module, NULL, NULL);
+#if defined(PR_USE_CTRLS)
+  (void) pr_ctrls_unregister(&conf_url_module, "conf_url");
+#endif /* PR_USE_CTRLS */
   urlconf_fs_unregister();
+  urlconf_free_handles();
   urlconf_http_free();
+  urlconf_breaker_free();
+  urlconf_watch_free();
+  urlconf_state_free();
+  urlconf_metrics_free();
+  urlconf_stats_free();
+  urlconf_mock_free();
+  urlconf_backend_free();
+  urlconf_token_free();
+  urlconf_fleet_free();
 
   destroy_pool(urlconf_pool);
   urlconf_pool = NULL;
+  urlconf_parse_pool = NULL;
+  urlconf_state_pool = NULL;
+  urlconf_state_path = NULL;
 }
 #endif /* PR_SHARED_MODULE */
 
@@ -477,11 +3684,147 @@ static void urlconf_postparse_ev(const void *event_data, void *user_data) {
     pr_trace_use_stderr(FALSE);
     use_tracing = FALSE;
   }
+
+  urlconf_cache_dir = NULL;
+  urlconf_cache_ttl = URLCONF_CACHE_DEFAULT_TTL;
+  (void) urlconf_breaker_clear();
+
+  urlconf_resolve = NULL;
+  urlconf_ip_version = 0;
+  urlconf_dns_cache_ttl = -1;
+  urlconf_dns_prefetch = FALSE;
+  urlconf_prefetched_hosts = NULL;
+  (void) urlconf_http_set_dns(NULL, 0, -1);
+
+  urlconf_watch_interval = 0;
+
+  (void) urlconf_metrics_close();
+  urlconf_metrics_log_set = FALSE;
+
+  urlconf_token_origin = NULL;
+
+  (void) urlconf_fleet_set_server(NULL);
+  urlconf_fleet_set = FALSE;
+  urlconf_fleet_require_integrity = FALSE;
+
+  urlconf_compress_bodies = FALSE;
+
+  /* Summarize the memory used by the URLs of this parse, for sizing. */
+  if (urlconf_mem_urls > 0) {
+    long maxrss;
+
+    maxrss = urlconf_get_maxrss();
+    pr_log_debug(DEBUG2, MOD_CONF_URL_VERSION
+      ": configuration parse opened %u %s: %llu bytes of content, %llu bytes "
+      "of buffers; peak RSS %ld KB (grew by %ld KB)", urlconf_mem_urls,
+      urlconf_mem_urls != 1 ? "URLs" : "URL", urlconf_mem_size,
+      urlconf_mem_alloc_bytes, maxrss, maxrss >= 0 && urlconf_mem_maxrss >= 0 ?
+        maxrss - urlconf_mem_maxrss : 0L);
+    pr_log_debug(DEBUG2, MOD_CONF_URL_VERSION
+      ": configuration parse spent %llu ms opening URLs (%llu usecs per URL)",
+      urlconf_mem_open_usecs / 1000,
+      urlconf_mem_open_usecs / urlconf_mem_urls);
+  }
+
+  urlconf_mem_urls = 0;
+  urlconf_mem_size = urlconf_mem_alloc_bytes = 0;
+  urlconf_mem_maxrss = -1;
+  urlconf_mem_open_usecs = 0;
+
+  /* Record the include graph of this parse, for warming up the next. */
+  if (urlconf_state_path_set == TRUE) {
+    pool *tmp_pool;
+
+    tmp_pool = make_sub_pool(urlconf_pool);
+    (void) urlconf_state_save(tmp_pool, urlconf_state_path);
+    destroy_pool(tmp_pool);
+
+  } else if (urlconf_state_pool != NULL) {
+    destroy_pool(urlconf_state_pool);
+    urlconf_state_pool = NULL;
+    urlconf_state_path = NULL;
+  }
+
+  (void) urlconf_state_clear();
+  urlconf_state_path_set = FALSE;
+  urlconf_warmed_up = FALSE;
+  urlconf_open_urls = NULL;
+
+  /* Close any kept connections.  Then discard the loaded CA certificates,
+   * so that any changes to them are seen on restart.
+   */
+  urlconf_free_handles();
+  (void) urlconf_tls_clear();
+
+  /* Go back to the default backend, discarding any mock responses. */
+  if (strcmp(urlconf_backend_get()->name, urlconf_mock_backend.name) == 0) {
+    pr_log_debug(DEBUG2, MOD_CONF_URL_VERSION
+      ": configuration parse made %lu mock requests",
+      urlconf_mock_get_requests());
+  }
+
+  (void) urlconf_backend_use(NULL);
+  (void) urlconf_mock_clear();
+
+  urlconf_listings = NULL;
+  urlconf_bodies = NULL;
+
+  if (urlconf_parse_pool != NULL) {
+    destroy_pool(urlconf_parse_pool);
+    urlconf_parse_pool = NULL;
+  }
+
+  /* On restart, watch the URLs of the new configuration.  On startup, the
+   * watcher is started via the core.startup listener instead, as the
+   * configuration may only be being checked, and the daemon has yet to
+   * daemonize.
+   */
+  if (urlconf_restarting == TRUE) {
+    urlconf_restarting = FALSE;
+
+    if (ServerType == SERVER_STANDALONE) {
+      (void) urlconf_watch_start();
+    }
+  }
+}
+
+static void urlconf_exit_ev(const void *event_data, void *user_data) {
+  (void) urlconf_watch_stop();
 }
 
 static void urlconf_restart_ev(const void *event_data, void *user_data) {
+  /* Stop watching the URLs of the old configuration, and using its token
+   * endpoint.
+   */
+  (void) urlconf_watch_stop();
+  (void) urlconf_watch_clear();
+  (void) urlconf_token_set_endpoint(NULL, NULL, NULL, 0);
+  urlconf_restarting = TRUE;
+
   /* Register the FSes.. */
   urlconf_fs_register(urlconf_pool);
+
+  /* Fetch the URLs recorded by the previous parse, before the parser needs
+   * them.
+   */
+  urlconf_warm_up();
+}
+
+/* Scheduled at startup, this runs from the daemon's main loop, i.e. in the
+ * daemon process proper.
+ */
+static void urlconf_watch_start_cb(void *d1, void *d2, void *d3, void *d4) {
+  (void) urlconf_watch_start();
+}
+
+static void urlconf_startup_ev(const void *event_data, void *user_data) {
+  /* At core.startup, the daemon has not yet daemonized; the process which
+   * generates this event is about to fork, and exit.  Thus we only start
+   * the watcher once the daemon runs its main loop.
+   */
+  if (ServerType == SERVER_STANDALONE) {
+    schedule(urlconf_watch_start_cb, 0, NULL, NULL, NULL, NULL);
+  }
 }
 
 /* Initialization functions
@@ -490,14 +3833,23 @@ static void urlconf_restart_ev(const void *event_data, void *user_data) {
 static void urlconf_fs_register(pool *p) {
   register unsigned int i;
 
+  memset(urlconf_scheme_index, 0, sizeof(urlconf_scheme_index));
+
   /* Register FSes, with which we will watch for supported scheme URLs
    * being opened, and intercept them.
    */
-  for (i = 0; urlconf_schemes[i]; i++) {
+  for (i = 0; urlconf_schemes[i].name; i++) {
     pr_fs_t *fs = NULL;
     const char *scheme;
+    unsigned char first;
 
-    scheme = urlconf_schemes[i];
+    scheme = urlconf_schemes[i].name;
+
+    first = (unsigned char) scheme[0];
+    if (urlconf_scheme_index[first] == 0) {
+      urlconf_scheme_index[first] = i + 1;
+      urlconf_scheme_index[toupper(first)] = i + 1;
+    }
 
     fs = pr_register_fs(p, "urlconf", scheme);
     if (fs == NULL) {
@@ -518,6 +3870,9 @@ static void urlconf_fs_register(pool *p) {
     fs->close = urlconf_fsio_close;
     fs->read = urlconf_fsio_read;
     fs->stat = urlconf_fsio_stat;
+    fs->opendir = urlconf_fsio_opendir;
+    fs->readdir = urlconf_fsio_readdir;
+    fs->closedir = urlconf_fsio_closedir;
 
 #if PROFTPD_VERSION_NUMBER >= 0x0001030603
     /* Tell the FSIO API that these are non-standard paths. */
@@ -530,10 +3885,10 @@ static void urlconf_fs_unregister(void) {
   register unsigned int i;
 
   /* Unregister the registered FSes. */
-  for (i = 0; urlconf_schemes[i]; i++) {
+  for (i = 0; urlconf_schemes[i].name; i++) {
     const char *scheme;
 
-    scheme = urlconf_schemes[i];
+    scheme = urlconf_schemes[i].name;
 
     if (pr_unregister_fs(scheme) < 0) {
       if (errno != ENOENT) {
@@ -549,6 +3904,10 @@ static void urlconf_fs_unregister(void) {
 }
 
 static int urlconf_init(void) {
+#if defined(PR_USE_CTRLS)
+  register unsigned int i;
+#endif /* PR_USE_CTRLS */
+
   urlconf_pool = make_sub_pool(permanent_pool);
   pr_pool_tag(urlconf_pool, MOD_CONF_URL_VERSION);
 
@@ -561,9 +3920,40 @@ static int urlconf_init(void) {
     NULL);
   pr_event_register(&conf_url_module, "core.restart", urlconf_restart_ev,
     NULL);
+  pr_event_register(&conf_url_module, "core.startup", urlconf_startup_ev,
+    NULL);
+  pr_event_register(&conf_url_module, "core.exit", urlconf_exit_ev, NULL);
 
   urlconf_fs_register(urlconf_pool);
+
+  /* libcurl is the default fetch backend. */
+  urlconf_backend_init(urlconf_pool);
+  urlconf_backend_register(&urlconf_http_backend);
+  urlconf_mock_init(urlconf_pool);
+  urlconf_backend_register(&urlconf_mock_backend);
+
   urlconf_http_init(urlconf_pool, &urlconf_flags);
+  urlconf_breaker_init(urlconf_pool);
+  urlconf_watch_init(urlconf_pool);
+  urlconf_state_init(urlconf_pool);
+  urlconf_metrics_init(urlconf_pool);
+  urlconf_stats_init(urlconf_pool);
+  urlconf_token_init(urlconf_pool);
+  urlconf_fleet_init(urlconf_pool);
+
+#if defined(PR_USE_CTRLS)
+  for (i = 0; urlconf_acttab[i].act_action != NULL; i++) {
+    urlconf_acttab[i].act_acl = pcalloc(urlconf_pool, sizeof(ctrls_acl_t));
+    pr_ctrls_init_acl(urlconf_acttab[i].act_acl);
+
+    if (pr_ctrls_register(&conf_url_module, urlconf_acttab[i].act_action,
+        urlconf_acttab[i].act_desc, urlconf_acttab[i].act_cb) < 0) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_CONF_URL_VERSION
+        ": error registering '%s' control: %s", urlconf_acttab[i].act_action,
+        strerror(errno));
+    }
+  }
+#endif /* PR_USE_CTRLS */
 
   return 0;
 }
@@ -571,6 +3961,19 @@ static int urlconf_init(void) {
 /* Module API tables
  */
 
+static conftable urlconf_conftab[] = {
+  { "ConfURLControlsACLs",	set_confurlctrlsacls,	NULL },
+  { NULL }
+};
+
+#if defined(PR_USE_CTRLS)
+static ctrls_acttab_t urlconf_acttab[] = {
+  { "conf_url", "report mod_conf_url fetch statistics", NULL,
+    urlconf_handle_conf_url },
+  { NULL, NULL, NULL, NULL }
+};
+#endif /* PR_USE_CTRLS */
+
 module conf_url_module = {
   NULL, NULL,
 
@@ -581,7 +3984,7 @@ module conf_url_module = {
   "conf_url",
 
   /* Module configuration handler table */
-  NULL,
+  urlconf_conftab,
 
   /* Module command handler table */
   NULL,
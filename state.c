@@ -0,0 +1,325 @@
+/*
+ * ProFTPD - mod_conf_url include graph state
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "state.h"
+
+/* The state file is text: a first line identifying the format and its
+ * version, then one line per URL, in the order opened, with tab-separated
+ * fields:
+ *
+ *  <url> <parent> <size> <flags> <etag> <last-modified> <ca-file> <ca-path>
+ *    <cert> <key>
+ *
+ * where missing values (e.g. the parent of the top-level configuration)
+ * are written as "-".
+ */
+#define STATE_MAGIC		"URLCONF-STATE 2\n"
+#define STATE_NFIELDS		10
+#define STATE_MAX_LINE_LEN	8192
+
+static pool *state_parent_pool = NULL;
+static pool *state_pool = NULL;
+static array_header *state_entries = NULL;
+
+static const char *trace_channel = "conf_url";
+
+/* Returns TRUE if the given field, if any, cannot be written as is. */
+static int state_field_invalid(const char *text) {
+  if (text != NULL &&
+      (*text == '\0' ||
+       strcmp(text, "-") == 0 ||
+       strpbrk(text, "\t\r\n") != NULL)) {
+    return TRUE;
+  }
+
+  return FALSE;
+}
+
+int urlconf_state_add(const char *url, const char *parent, size_t size,
+    unsigned long flags, const char *etag, const char *last_modified,
+    const char *ssl_ca_file, const char *ssl_ca_path, const char *ssl_cert,
+    const char *ssl_key) {
+  struct urlconf_state_entry *entry;
+
+  if (url == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Tabs or newlines in any field would corrupt the state file. */
+  if (strpbrk(url, "\t\r\n") != NULL ||
+      (etag != NULL && strpbrk(etag, "\t\r\n") != NULL) ||
+      (last_modified != NULL && strpbrk(last_modified, "\t\r\n") != NULL)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Nor could the TLS settings be read back as written. */
+  if (state_field_invalid(ssl_ca_file) == TRUE ||
+      state_field_invalid(ssl_ca_path) == TRUE ||
+      state_field_invalid(ssl_cert) == TRUE ||
+      state_field_invalid(ssl_key) == TRUE) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (state_pool == NULL) {
+    state_pool = make_sub_pool(state_parent_pool);
+    pr_pool_tag(state_pool, MOD_CONF_URL_VERSION ": State Pool");
+
+    state_entries = make_array(state_pool, 0,
+      sizeof(struct urlconf_state_entry *));
+  }
+
+  entry = pcalloc(state_pool, sizeof(struct urlconf_state_entry));
+  entry->url = pstrdup(state_pool, url);
+  entry->parent = parent ? pstrdup(state_pool, parent) : NULL;
+  entry->size = size;
+  entry->flags = flags;
+  entry->etag = etag ? pstrdup(state_pool, etag) : NULL;
+  entry->last_modified = last_modified ?
+    pstrdup(state_pool, last_modified) : NULL;
+  entry->ssl_ca_file = ssl_ca_file ? pstrdup(state_pool, ssl_ca_file) : NULL;
+  entry->ssl_ca_path = ssl_ca_path ? pstrdup(state_pool, ssl_ca_path) : NULL;
+  entry->ssl_cert = ssl_cert ? pstrdup(state_pool, ssl_cert) : NULL;
+  entry->ssl_key = ssl_key ? pstrdup(state_pool, ssl_key) : NULL;
+
+  *((struct urlconf_state_entry **) push_array(state_entries)) = entry;
+  return 0;
+}
+
+static const char *state_field(pool *p, const char *text) {
+  if (text == NULL ||
+      strcmp(text, "-") == 0) {
+    return NULL;
+  }
+
+  return pstrdup(p, text);
+}
+
+array_header *urlconf_state_load(pool *p, const char *path) {
+  FILE *fh;
+  array_header *entries;
+  char line[STATE_MAX_LINE_LEN];
+
+  if (p == NULL ||
+      path == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  fh = fopen(path, "r");
+  if (fh == NULL) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 9, "unable to read state file '%s': %s",
+      path, strerror(xerrno));
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  if (fgets(line, sizeof(line), fh) == NULL ||
+      strcmp(line, STATE_MAGIC) != 0) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": ignoring state file '%s' with unknown format", path);
+    fclose(fh);
+
+    errno = EINVAL;
+    return NULL;
+  }
+
+  entries = make_array(p, 0, sizeof(struct urlconf_state_entry *));
+
+  while (fgets(line, sizeof(line), fh) != NULL) {
+    struct urlconf_state_entry *entry;
+    char *fields[STATE_NFIELDS], *ptr;
+    unsigned int nfields = 0;
+    size_t linelen;
+
+    pr_signals_handle();
+
+    linelen = strlen(line);
+    if (linelen == 0 ||
+        line[linelen-1] != '\n') {
+      /* Overly long, or truncated, line. */
+      continue;
+    }
+
+    line[linelen-1] = '\0';
+
+    ptr = line;
+    while (nfields < STATE_NFIELDS) {
+      fields[nfields++] = ptr;
+
+      ptr = strchr(ptr, '\t');
+      if (ptr == NULL) {
+        break;
+      }
+
+      *ptr++ = '\0';
+    }
+
+    if (nfields != STATE_NFIELDS) {
+      continue;
+    }
+
+    entry = pcalloc(p, sizeof(struct urlconf_state_entry));
+    entry->url = pstrdup(p, fields[0]);
+    entry->parent = state_field(p, fields[1]);
+    entry->size = strtoul(fields[2], NULL, 10);
+    entry->flags = strtoul(fields[3], NULL, 10);
+    entry->etag = state_field(p, fields[4]);
+    entry->last_modified = state_field(p, fields[5]);
+    entry->ssl_ca_file = state_field(p, fields[6]);
+    entry->ssl_ca_path = state_field(p, fields[7]);
+    entry->ssl_cert = state_field(p, fields[8]);
+    entry->ssl_key = state_field(p, fields[9]);
+
+    *((struct urlconf_state_entry **) push_array(entries)) = entry;
+  }
+
+  fclose(fh);
+
+  pr_trace_msg(trace_channel, 9, "read %d %s from state file '%s'",
+    entries->nelts, entries->nelts != 1 ? "entries" : "entry", path);
+  return entries;
+}
+
+int urlconf_state_save(pool *p, const char *path) {
+  register unsigned int i;
+  FILE *fh;
+  char *tmp_path;
+  struct urlconf_state_entry **elts;
+  int fd, xerrno;
+
+  if (p == NULL ||
+      path == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (state_entries == NULL) {
+    return 0;
+  }
+
+  /* mkstemp(3) creates the temporary file exclusively, with 0600
+   * permissions, using a name which others cannot predict, and thus plant
+   * (e.g. as a symlink).
+   */
+  tmp_path = pstrcat(p, path, ".XXXXXX", NULL);
+  fd = mkstemp(tmp_path);
+  if (fd < 0) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": unable to write state file '%s': %s", tmp_path, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": unable to write state file '%s': %s", tmp_path, strerror(xerrno));
+    (void) close(fd);
+    (void) unlink(tmp_path);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  fputs(STATE_MAGIC, fh);
+
+  elts = state_entries->elts;
+  for (i = 0; i < state_entries->nelts; i++) {
+    fprintf(fh, "%s\t%s\t%lu\t%lu\t%s\t%s\t%s\t%s\t%s\t%s\n", elts[i]->url,
+      elts[i]->parent ? elts[i]->parent : "-", (unsigned long) elts[i]->size,
+      elts[i]->flags, elts[i]->etag ? elts[i]->etag : "-",
+      elts[i]->last_modified ? elts[i]->last_modified : "-",
+      elts[i]->ssl_ca_file ? elts[i]->ssl_ca_file : "-",
+      elts[i]->ssl_ca_path ? elts[i]->ssl_ca_path : "-",
+      elts[i]->ssl_cert ? elts[i]->ssl_cert : "-",
+      elts[i]->ssl_key ? elts[i]->ssl_key : "-");
+  }
+
+  if (fclose(fh) != 0) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": error writing state file '%s': %s", tmp_path, strerror(xerrno));
+    (void) unlink(tmp_path);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (rename(tmp_path, path) < 0) {
+    xerrno = errno;
+
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": error renaming '%s' to '%s': %s", tmp_path, path, strerror(xerrno));
+    (void) unlink(tmp_path);
+
+    errno = xerrno;
+    return -1;
+  }
+
+  pr_trace_msg(trace_channel, 9, "wrote %d %s to state file '%s'",
+    state_entries->nelts, state_entries->nelts != 1 ? "entries" : "entry",
+    path);
+  return 0;
+}
+
+int urlconf_state_clear(void) {
+  if (state_pool != NULL) {
+    destroy_pool(state_pool);
+    state_pool = NULL;
+  }
+
+  state_entries = NULL;
+  return 0;
+}
+
+int urlconf_state_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  state_parent_pool = p;
+  return 0;
+}
+
+int urlconf_state_free(void) {
+  (void) urlconf_state_clear();
+
+  state_parent_pool = NULL;
+  return 0;
+}
@@ -0,0 +1,73 @@
+/*
+ * ProFTPD - mod_conf_url include graph state
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_STATE_H
+#define MOD_CONF_URL_STATE_H
+
+/* A URL opened during a configuration parse: the URL which included it
+ * (NULL for the top-level configuration), the size of its content, the
+ * libcurl handle flags used, the validators of the response, if any, and
+ * the TLS settings used, if any.
+ */
+struct urlconf_state_entry {
+  const char *url;
+  const char *parent;
+  size_t size;
+  unsigned long flags;
+  const char *etag;
+  const char *last_modified;
+
+  const char *ssl_ca_file;
+  const char *ssl_ca_path;
+  const char *ssl_cert;
+  const char *ssl_key;
+};
+
+/* Records the given URL, in the order opened. */
+int urlconf_state_add(const char *url, const char *parent, size_t size,
+  unsigned long flags, const char *etag, const char *last_modified,
+  const char *ssl_ca_file, const char *ssl_ca_path, const char *ssl_cert,
+  const char *ssl_key);
+
+/* Reads the entries recorded in the given state file, returning an array
+ * of struct urlconf_state_entry pointers.
+ */
+array_header *urlconf_state_load(pool *p, const char *path);
+
+/* Writes the recorded entries to the given state file, atomically replacing
+ * any existing file.
+ */
+int urlconf_state_save(pool *p, const char *path);
+
+/* Discards the recorded entries. */
+int urlconf_state_clear(void);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_state_init(pool *p);
+int urlconf_state_free(void);
+
+#endif /* MOD_CONF_URL_STATE_H */
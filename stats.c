@@ -0,0 +1,256 @@
+/*
+ * ProFTPD - mod_conf_url fetch statistics
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "stats.h"
+
+/* The distinct errors counted; any others are counted together. */
+#define STATS_MAX_ERRORS		16
+
+/* The upper bounds, in milliseconds, of the latency histogram buckets; the
+ * last bucket is unbounded.
+ */
+static const unsigned long stats_latency_bounds[] = {
+  10, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 0
+};
+#define STATS_LATENCY_BUCKETS \
+  (sizeof(stats_latency_bounds) / sizeof(stats_latency_bounds[0]))
+
+struct stats_error {
+  int xerrno;
+  unsigned long count;
+};
+
+struct urlconf_stats {
+  time_t since;
+
+  unsigned long fetches;
+  unsigned long failures;
+  unsigned long long content_bytes;
+  unsigned long long bytes_received;
+
+  /* Cache outcomes. */
+  unsigned long cache_hits;
+  unsigned long cache_misses;
+  unsigned long cache_revalidations;
+  unsigned long cache_deltas;
+  unsigned long cache_stored;
+  unsigned long cache_fleet;
+  unsigned long bundled;
+  unsigned long prefetched;
+
+  unsigned long transfers;
+  unsigned long retries;
+  unsigned long conns_reused;
+  unsigned long conns_opened;
+
+  struct stats_error errors[STATS_MAX_ERRORS];
+  unsigned int nerrors;
+  unsigned long other_errors;
+
+  /* Latency histogram of fetches which transferred data. */
+  unsigned long latency[STATS_LATENCY_BUCKETS];
+};
+
+static struct urlconf_stats *stats = NULL;
+
+static void stats_record_error(int xerrno) {
+  register unsigned int i;
+
+  for (i = 0; i < stats->nerrors; i++) {
+    if (stats->errors[i].xerrno == xerrno) {
+      stats->errors[i].count++;
+      return;
+    }
+  }
+
+  if (stats->nerrors == STATS_MAX_ERRORS) {
+    stats->other_errors++;
+    return;
+  }
+
+  stats->errors[stats->nerrors].xerrno = xerrno;
+  stats->errors[stats->nerrors].count = 1;
+  stats->nerrors++;
+}
+
+int urlconf_stats_record(const struct urlconf_metrics *metrics) {
+  const struct urlconf_http_timing *timing;
+
+  if (metrics == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (stats == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  stats->fetches++;
+
+  if (metrics->xerrno != 0) {
+    stats->failures++;
+    stats_record_error(metrics->xerrno);
+
+  } else {
+    stats->content_bytes += metrics->size;
+  }
+
+  if (metrics->cache != NULL) {
+    if (strcmp(metrics->cache, "hit") == 0) {
+      stats->cache_hits++;
+
+    } else if (strcmp(metrics->cache, "miss") == 0) {
+      stats->cache_misses++;
+
+    } else if (strcmp(metrics->cache, "revalidated") == 0) {
+      stats->cache_revalidations++;
+
+    } else if (strcmp(metrics->cache, "delta") == 0) {
+      stats->cache_deltas++;
+
+    } else if (strcmp(metrics->cache, "stored") == 0) {
+      stats->cache_stored++;
+
+    } else if (strcmp(metrics->cache, "fleet") == 0) {
+      stats->cache_fleet++;
+
+    } else if (strcmp(metrics->cache, "bundled") == 0) {
+      stats->bundled++;
+    }
+  }
+
+  if (metrics->prefetched) {
+    stats->prefetched++;
+  }
+
+  timing = metrics->timing;
+  if (timing != NULL &&
+      timing->transfers > 0) {
+    register unsigned int i;
+    unsigned long millis;
+
+    stats->transfers += timing->transfers;
+    stats->retries += timing->transfers - 1;
+    stats->bytes_received += (unsigned long long) timing->bytes;
+
+    if (timing->reused) {
+      stats->conns_reused++;
+
+    } else {
+      stats->conns_opened++;
+    }
+
+    millis = (unsigned long) (timing->total_secs * 1000);
+    for (i = 0; i < STATS_LATENCY_BUCKETS - 1; i++) {
+      if (millis < stats_latency_bounds[i]) {
+        break;
+      }
+    }
+
+    stats->latency[i]++;
+  }
+
+  return 0;
+}
+
+array_header *urlconf_stats_get_text(pool *p) {
+  register unsigned int i;
+  array_header *lines;
+  char text[256];
+
+  if (p == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (stats == NULL) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  lines = make_array(p, 0, sizeof(char *));
+
+#define STATS_ADD_LINE(...) \
+  memset(text, '\0', sizeof(text)); \
+  snprintf(text, sizeof(text)-1, __VA_ARGS__); \
+  *((char **) push_array(lines)) = pstrdup(p, text);
+
+  STATS_ADD_LINE("since: %lu secs ago",
+    (unsigned long) (time(NULL) - stats->since));
+  STATS_ADD_LINE("fetches: %lu (%lu failed, %lu prefetched)", stats->fetches,
+    stats->failures, stats->prefetched);
+  STATS_ADD_LINE("bytes: %llu content, %llu received", stats->content_bytes,
+    stats->bytes_received);
+  STATS_ADD_LINE("cache: %lu hits, %lu misses, %lu revalidations, "
+    "%lu deltas, %lu stored, %lu fleet, %lu bundled", stats->cache_hits,
+    stats->cache_misses, stats->cache_revalidations, stats->cache_deltas,
+    stats->cache_stored, stats->cache_fleet, stats->bundled);
+  STATS_ADD_LINE("transfers: %lu (%lu retries)", stats->transfers,
+    stats->retries);
+  STATS_ADD_LINE("connections: %lu reused, %lu opened", stats->conns_reused,
+    stats->conns_opened);
+
+  for (i = 0; i < stats->nerrors; i++) {
+    STATS_ADD_LINE("failures: %s: %lu", strerror(stats->errors[i].xerrno),
+      stats->errors[i].count);
+  }
+
+  if (stats->other_errors > 0) {
+    STATS_ADD_LINE("failures: other: %lu", stats->other_errors);
+  }
+
+  for (i = 0; i < STATS_LATENCY_BUCKETS; i++) {
+    if (stats_latency_bounds[i] > 0) {
+      STATS_ADD_LINE("latency: < %lu ms: %lu", stats_latency_bounds[i],
+        stats->latency[i]);
+
+    } else {
+      STATS_ADD_LINE("latency: >= %lu ms: %lu", stats_latency_bounds[i-1],
+        stats->latency[i]);
+    }
+  }
+
+#undef STATS_ADD_LINE
+
+  return lines;
+}
+
+int urlconf_stats_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  stats = pcalloc(p, sizeof(struct urlconf_stats));
+  time(&(stats->since));
+  return 0;
+}
+
+int urlconf_stats_free(void) {
+  stats = NULL;
+  return 0;
+}
@@ -0,0 +1,42 @@
+/*
+ * ProFTPD - mod_conf_url fetch statistics
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "metrics.h"
+
+#ifndef MOD_CONF_URL_STATS_H
+#define MOD_CONF_URL_STATS_H
+
+/* Adds the details of a fetch to the cumulative statistics. */
+int urlconf_stats_record(const struct urlconf_metrics *metrics);
+
+/* Returns the cumulative statistics, as a list of lines of text. */
+array_header *urlconf_stats_get_text(pool *p);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_stats_init(pool *p);
+int urlconf_stats_free(void);
+
+#endif /* MOD_CONF_URL_STATS_H */
@@ -0,0 +1,152 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 6;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $proftpd_opts = "-t";
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $proftpd_opts = "-td10";
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+my $origin_dir = File::Spec->catdir($tmpdir, 'origin');
+mkpath($origin_dir);
+write_file(File::Spec->catfile($origin_dir, 'cached.conf'),
+  "ServerName \"Cached\"\n");
+write_file(File::Spec->catfile($origin_dir, 'coalesced.conf'),
+  "ServerName \"Coalesced\"\n");
+write_file(File::Spec->catfile($origin_dir, 'unsafe.conf'),
+  "ServerName \"Unsafe\"\n");
+
+# Start the local HTTP stand-in, which logs the requests it serves.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $origin_dir);
+  exit(1);
+}
+sleep(1);
+
+my $cache_dir = File::Spec->catdir($tmpdir, 'cache');
+
+my ($cmd, $ex, $res);
+my $cached_url = "http://127.0.0.1:$kv_port/cached.conf?cache_dir=$cache_dir&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$cached_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex) && origin_requests('/cached.conf') == 1,
+  "fetched HTTP URL, publishing it to cache directory");
+
+# Within the TTL, the cached response is used, without asking the origin.
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex) && origin_requests('/cached.conf') == 1,
+  "used cached response for HTTP URL within TTL");
+
+# Concurrent parses wait for the first to publish its response, rather than
+# all asking the origin; the slow origin ensures that they overlap.
+my $coalesced_url = "http://127.0.0.1:$kv_port/coalesced.conf?delay=2&cache_dir=$cache_dir&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$coalesced_url'";
+my @pids;
+for (my $i = 0; $i < 3; $i++) {
+  my $pid = fork();
+  if ($pid == 0) {
+    my $ok = eval { run_cmd($cmd, 1) };
+    exit($ok ? 0 : 1);
+  }
+
+  push(@pids, $pid);
+}
+
+my $failed = 0;
+foreach my $pid (@pids) {
+  waitpid($pid, 0);
+  $failed++ if $? != 0;
+}
+ok($failed == 0, "handled concurrent parses of HTTP URL using cache directory");
+ok(origin_requests('/coalesced.conf') == 1,
+  "coalesced concurrent fetches of HTTP URL");
+
+# A cache directory which others can write is not used.
+my $unsafe_dir = File::Spec->catdir($tmpdir, 'unsafe');
+mkpath($unsafe_dir);
+chmod(0777, $unsafe_dir);
+
+my $unsafe_url = "http://127.0.0.1:$kv_port/unsafe.conf?cache_dir=$unsafe_dir&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$unsafe_url'";
+$ex = undef;
+eval {
+  run_cmd($cmd, 1);
+  run_cmd($cmd, 1);
+};
+$ex = $@ if $@;
+ok(!defined($ex) && origin_requests('/unsafe.conf') == 2,
+  "fetched HTTP URL from origin with world-writable cache directory");
+
+my @unsafe = glob("$unsafe_dir/*");
+ok(scalar(@unsafe) == 0, "did not write to world-writable cache directory");
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub origin_requests {
+  my $path = shift;
+
+  my $count = 0;
+  if (open(my $fh, "< " . File::Spec->catfile($origin_dir, 'access.log'))) {
+    while (my $line = <$fh>) {
+      $count++ if $line =~ /^GET \Q$path\E(\?|$)/;
+    }
+
+    close($fh);
+  }
+
+  return $count;
+}
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd > /dev/null`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return 1;
+}
@@ -0,0 +1,205 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 5;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $ftpdctl = File::Spec->catfile(dirname($proftpd), 'ftpdctl');
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+my $user = (getpwuid($<))[0];
+
+# Start the local HTTP stand-in.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $tmpdir);
+  exit(1);
+}
+sleep(1);
+
+my $ftp_port = $kv_port + 1;
+my $pid_file = File::Spec->catfile($tmpdir, 'proftpd.pid');
+my $ctrls_sock = File::Spec->catfile($tmpdir, 'proftpd.sock');
+
+# The daemon allowed the conf_url action reports its fetch statistics, one
+# line per response.
+write_file(File::Spec->catfile($tmpdir, 'allowed.conf'),
+  daemon_config("ConfURLControlsACLs conf_url allow user $user\n"));
+write_file(File::Spec->catfile($tmpdir, 'included.conf'),
+  "MaxInstances 10\n");
+
+my $daemon_pid = start_daemon("http://127.0.0.1:$kv_port/allowed.conf?tracing=$tracing");
+ok(defined($daemon_pid), "started daemon with Controls enabled");
+
+my @output = ftpdctl('conf_url stats');
+ok(grep({ /^ftpdctl: since: \d+ secs ago$/ } @output) &&
+   grep({ /^ftpdctl: fetches: [1-9]\d* \(\d+ failed, \d+ prefetched\)$/ } @output) &&
+   grep({ /^ftpdctl: cache: \d+ hits, \d+ misses, / } @output) &&
+   grep({ /^ftpdctl: connections: \d+ reused, \d+ opened$/ } @output) &&
+   grep({ /^ftpdctl: latency: >= \d+ ms: \d+$/ } @output),
+  "reported fetch statistics for conf_url stats");
+
+@output = ftpdctl('conf_url foo');
+ok(grep({ /conf_url: usage: conf_url stats/ } @output),
+  "reported usage for unknown conf_url action");
+stop_daemon($daemon_pid);
+
+# Without an ACL allowing it, the action is denied.
+write_file(File::Spec->catfile($tmpdir, 'denied.conf'), daemon_config(''));
+
+$daemon_pid = start_daemon("http://127.0.0.1:$kv_port/denied.conf?tracing=$tracing");
+ok(defined($daemon_pid), "started daemon without conf_url ACL");
+
+@output = ftpdctl('conf_url stats');
+ok(grep({ /access denied/ } @output) &&
+   !grep({ /fetches:/ } @output),
+  "denied conf_url stats without ACL");
+stop_daemon($daemon_pid);
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub daemon_config {
+  my $extra = shift;
+
+  my $group = (getgrgid($())[0];
+  my $scoreboard_file = File::Spec->catfile($tmpdir, 'proftpd.scoreboard');
+  my $log_file = File::Spec->catfile($tmpdir, 'proftpd.log');
+
+  return <<EOC;
+ServerType standalone
+ServerName "Controlled"
+DefaultAddress 127.0.0.1
+Port $ftp_port
+User $user
+Group $group
+PidFile $pid_file
+ScoreboardFile $scoreboard_file
+SystemLog $log_file
+TransferLog none
+WtmpLog off
+<IfModule mod_delay.c>
+  DelayEngine off
+</IfModule>
+<IfModule mod_ctrls.c>
+  ControlsEngine on
+  ControlsSocket $ctrls_sock
+  ControlsSocketACL allow user $user
+</IfModule>
+Include http://127.0.0.1:$kv_port/included.conf
+$extra
+EOC
+}
+
+# Sends the given control request to the daemon, returning the responses.
+sub ftpdctl {
+  my $request = shift;
+
+  my $cmd = "$ftpdctl -s $ctrls_sock $request";
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd 2>&1`;
+  chomp(@output);
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join("\n", @output), "\n";
+  }
+
+  return @output;
+}
+
+sub wait_for {
+  my $cond = shift;
+  my $timeout = shift;
+  $timeout = 20 unless defined($timeout);
+
+  for (my $i = 0; $i < $timeout * 2; $i++) {
+    return 1 if $cond->();
+    select(undef, undef, undef, 0.5);
+  }
+
+  return 0;
+}
+
+# Starts the daemon, which daemonizes, and returns the PID of the daemon
+# process proper, per its PidFile, once its Controls socket exists.
+sub start_daemon {
+  my $url = shift;
+
+  unlink($pid_file);
+
+  my $cmd = "$proftpd -c '$url'";
+  eval { run_cmd($cmd, 1) };
+  return undef if $@;
+
+  my $pid;
+  wait_for(sub {
+    if (open(my $fh, "< $pid_file")) {
+      $pid = <$fh>;
+      close($fh);
+      chomp($pid) if defined($pid);
+    }
+
+    return defined($pid) && $pid =~ /^\d+$/ && -S $ctrls_sock;
+  }, 10);
+
+  return $pid;
+}
+
+sub stop_daemon {
+  my $pid = shift;
+  return unless defined($pid);
+
+  kill('TERM', $pid);
+  wait_for(sub { !kill(0, $pid) }, 10);
+  unlink($ctrls_sock);
+}
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd > /dev/null`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return 1;
+}
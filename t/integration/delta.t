@@ -0,0 +1,105 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 3;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $proftpd_opts = "-t";
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $proftpd_opts = "-td10";
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+my $config_file = File::Spec->catfile($tmpdir, 'delta.conf');
+write_file($config_file,
+  "ServerName \"Delta\"\nDefaultPort 2121\nMaxInstances 5\n");
+
+# Give the first version an older modification time, i.e. index.
+utime(time() - 60, time() - 60, $config_file);
+
+# Start the local KV stand-in, which serves deltas.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $tmpdir);
+  exit(1);
+}
+sleep(1);
+
+my ($cmd, $ex, $res);
+my $cache_dir = File::Spec->catfile($tmpdir, 'cache');
+my $delta_url = "http://127.0.0.1:$kv_port/delta.conf?cache_dir=$cache_dir&cache_ttl=0&delta=true&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$delta_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled HTTP URL with delta");
+
+# Change the file, and make sure the cached response is stale.
+my $new_conf = "ServerName \"Delta\"\nDefaultPort 2121\nMaxInstances 10\n" .
+  "MaxClients 20\n";
+write_file($config_file, $new_conf);
+sleep(2);
+
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled changed HTTP URL with delta");
+
+my $cached = "";
+my @cached = glob("$cache_dir/*.dat");
+if (scalar(@cached) == 1 && open(my $fh, "< $cached[0]")) {
+  local $/;
+  $cached = <$fh>;
+  close($fh);
+}
+ok($cached eq $new_conf &&
+   -f File::Spec->catfile($tmpdir, 'delta.log'),
+  "rebuilt changed HTTP URL response from delta");
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd > /dev/null`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return 1;
+}
@@ -4,9 +4,10 @@ use strict;
 
 use Carp;
 use Cwd qw(abs_path realpath);
+use Digest::SHA qw(sha256_base64);
 use File::Path qw(mkpath rmtree);
 use File::Spec;
-use Test::Simple tests => 2;
+use Test::Simple tests => 13;
 
 my $proftpd = $ENV{PROFTPD_TEST_BIN};
 my $proftpd_opts = "-t";
@@ -31,6 +32,143 @@ eval { $res = run_cmd($cmd, 1) };
 $ex = $@ if $@;
 ok(defined($ex), "handled file URL with good file");
 
+my $tmpdir = $ARGV[0];
+my $config_file = File::Spec->catfile($tmpdir, 'proftpd.conf');
+my $cache_dir = File::Spec->catfile($tmpdir, 'cache');
+write_file($config_file, "ServerName \"Cached\"\n");
+
+my $cached_url = "file://$config_file?cache_dir=$cache_dir&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$cached_url'";
+eval { $res = run_cmd($cmd, 0) };
+my @cached = glob("$cache_dir/*.dat");
+ok(scalar(@cached) == 1, "published file URL response to cache directory");
+
+my $include_dir = File::Spec->catfile($tmpdir, 'conf.d');
+mkpath($include_dir);
+write_file(File::Spec->catfile($include_dir, 'a.conf'), "DefaultPort 2121\n");
+write_file(File::Spec->catfile($include_dir, 'b.conf'), "MaxInstances 5\n");
+
+my $wildcard_file = File::Spec->catfile($tmpdir, 'wildcard.conf');
+write_file($wildcard_file, "Include file://$include_dir/*.conf\n");
+
+my $wildcard_url = "file://$wildcard_file?tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$wildcard_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled wildcard Include of file URLs");
+
+# The entries fetched in advance are kept compressed until read, and
+# inflated in pieces.  The section spans many of those pieces, so that any
+# lost or garbled bytes leave a directive unknown, or the section unclosed.
+my $zinclude_dir = File::Spec->catfile($tmpdir, 'zconf.d');
+mkpath($zinclude_dir);
+my $section_conf = "<Directory /tmp>\n  AllowOverwrite on\n";
+for (my $i = 0; $i < 500; $i++) {
+  $section_conf .= "  # Comment line $i, to span several inflated pieces\n";
+}
+$section_conf .= "  HideNoAccess on\n</Directory>\n";
+write_file(File::Spec->catfile($zinclude_dir, 'a.conf'), $section_conf);
+write_file(File::Spec->catfile($zinclude_dir, 'b.conf'), "MaxInstances 5\n");
+
+my $zwildcard_file = File::Spec->catfile($tmpdir, 'zwildcard.conf');
+write_file($zwildcard_file, "Include file://$zinclude_dir/*.conf\n");
+
+$wildcard_url = "file://$zwildcard_file?compress_bodies=true&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$wildcard_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled wildcard Include of compressed file URLs");
+
+# The inflated entries are what is parsed, so an unknown directive in one
+# fails the check.
+write_file(File::Spec->catfile($zinclude_dir, 'c.conf'),
+  "NoSuchDirective on\n");
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "parsed wildcard Include of compressed file URLs");
+unlink(File::Spec->catfile($zinclude_dir, 'c.conf'));
+
+my $member_url = "file://$tmpdir/bundle.d/vhost.conf";
+my $main_conf = "Include $member_url\n";
+my $member_conf = "DefaultPort 2121\n";
+my $bundle_file = File::Spec->catfile($tmpdir, 'proftpd.bundle');
+write_file($bundle_file, "URLCONF-BUNDLE 1\n" .
+  "proftpd.conf " . length($main_conf) . "\n$main_conf\n" .
+  "bundle.d/vhost.conf " . length($member_conf) . "\n$member_conf\n");
+
+# Note that the bundle member does not exist on disk.
+my $bundle_url = "file://$bundle_file?bundle=true&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$bundle_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled bundle file URL");
+
+my $pinned_conf = "DefaultPort 2121\n";
+my $pinned_file = File::Spec->catfile($tmpdir, 'pinned.conf');
+write_file($pinned_file, $pinned_conf);
+
+# Digest::SHA omits the base64 padding.
+my $integrity = "sha256-" . sha256_base64($pinned_conf);
+my $pinned_url = "file://$pinned_file?cache_dir=$cache_dir&integrity=$integrity&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$pinned_url'";
+eval { $res = run_cmd($cmd, 0) };
+my @stored = glob("$cache_dir/*.blob");
+ok(scalar(@stored) == 1, "stored file URL response matching integrity");
+
+# With the file gone, the stored content is used.
+unlink($pinned_file);
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "used stored content for file URL with integrity");
+
+my $state_file = File::Spec->catfile($tmpdir, 'conf_url.state');
+my $state_url = "file://$wildcard_file?state_file=$state_file&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$state_url'";
+eval { $res = run_cmd($cmd, 0) };
+my $state = "";
+if (open(my $fh, "< $state_file")) {
+  local $/;
+  $state = <$fh>;
+  close($fh);
+}
+ok($state =~ /^URLCONF-STATE 2\n/ &&
+   $state =~ /^file:\/\/\Q$include_dir\E\/a\.conf\tfile:\/\/\Q$wildcard_file\E\t/m,
+  "recorded include graph in state file");
+
+# The recorded URLs are read again on the next start.
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled file URL with existing state file");
+
+my $metrics_log = File::Spec->catfile($tmpdir, 'metrics.json');
+my $metrics_url = "file://$config_file?metrics_log=$metrics_log&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$metrics_url'";
+eval { $res = run_cmd($cmd, 0) };
+my $metrics = "";
+if (open(my $fh, "< $metrics_log")) {
+  $metrics = <$fh>;
+  close($fh);
+}
+ok($metrics =~ /^\{"url":"file:\/\/\Q$config_file\E",.*"cache":"none",.*"total":[\d.]+,/,
+  "wrote metrics for file URL");
+ok($metrics =~ /"alloc_bytes":[1-9]\d*,"maxrss_growth":\d+\}$/,
+  "wrote memory usage for file URL");
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
 sub run_cmd {
   my $cmd = shift;
   my $check_exit_status = shift;
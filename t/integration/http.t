@@ -4,9 +4,11 @@ use strict;
 
 use Carp;
 use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
 use File::Path qw(mkpath rmtree);
 use File::Spec;
-use Test::Simple tests => 4;
+use POSIX qw(:sys_wait_h);
+use Test::Simple tests => 13;
 
 my $proftpd = $ENV{PROFTPD_TEST_BIN};
 my $proftpd_opts = "-t";
@@ -45,6 +47,201 @@ eval { $res = run_cmd($cmd, 1) };
 $ex = $@ if $@;
 ok(defined($ex), "handled URL with unsupported scheme");
 
+my $tmpdir = $ARGV[0];
+write_file(File::Spec->catfile($tmpdir, 'pinned.conf'),
+  "ServerName \"Pinned\"\n");
+
+# Start the local HTTP stand-in.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $tmpdir);
+  exit(1);
+}
+sleep(1);
+
+# The host name cannot be resolved (RFC 2606), so this only works if the
+# pinned address is used.
+my $pinned_url = "http://config.invalid:$kv_port/pinned.conf?resolve=config.invalid:$kv_port:127.0.0.1&ip_version=4&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$pinned_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled HTTP URL with pinned address");
+
+# Includes from the same origin, with the same settings, reuse the handle
+# (and thus any kept connection) of the URL which included them.
+write_file(File::Spec->catfile($tmpdir, 'a.conf'), "DefaultPort 2121\n");
+write_file(File::Spec->catfile($tmpdir, 'b.conf'), "MaxInstances 5\n");
+write_file(File::Spec->catfile($tmpdir, 'reused.conf'),
+  "Include http://127.0.0.1:$kv_port/a.conf\n" .
+  "Include http://127.0.0.1:$kv_port/b.conf\n");
+
+my @output;
+$cmd = "$proftpd -td2 -c 'http://127.0.0.1:$kv_port/reused.conf?trace_level=17-17'";
+$ex = undef;
+eval { @output = run_cmd_output($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex) &&
+   scalar(grep({ /reusing handle for 'http:\/\/127\.0\.0\.1:$kv_port'/ } @output)) == 2,
+  "reused handle for Includes from same origin");
+
+# The libcurl debug data are logged only at the trace levels which show
+# them.
+$cmd = "$proftpd -td2 -c 'http://127.0.0.1:$kv_port/a.conf?trace_level=20'";
+@output = run_cmd_output($cmd);
+ok(grep({ /\[debug\] HEADER OUT: GET \/a\.conf / } @output) &&
+   grep({ /\[debug\] HEADER IN: HTTP\/1\.[01] 200 / } @output),
+  "logged libcurl debug data at trace level 20");
+
+$cmd = "$proftpd -td2 -c 'http://127.0.0.1:$kv_port/a.conf?trace_level=10'";
+@output = run_cmd_output($cmd);
+ok(!grep({ /\[debug\]/ } @output),
+  "did not log libcurl debug data at trace level 10");
+
+# On the second run, the recorded Includes are fetched in advance, and the
+# validators of their (revalidated) responses are recorded again.
+my $state_file = File::Spec->catfile($tmpdir, 'conf_url.state');
+$cmd = "$proftpd $proftpd_opts -c 'http://127.0.0.1:$kv_port/reused.conf?state_file=$state_file&tracing=$tracing'";
+eval { run_cmd($cmd, 1) };
+eval { run_cmd($cmd, 1) };
+my $state = eval { read_file($state_file) } || "";
+ok($state =~ /^http:\/\/127\.0\.0\.1:$kv_port\/a\.conf\t[^\t]+\t\d+\t\d+\t"\d+"\t/m &&
+   $state =~ /^http:\/\/127\.0\.0\.1:$kv_port\/b\.conf\t[^\t]+\t\d+\t\d+\t"\d+"\t/m,
+  "recorded validators of Includes fetched in advance");
+
+# A host whose name could not be resolved in advance is remembered, so that
+# its Include fails fast, without resolving the name again.
+my $base_url = "http://127.0.0.1:$kv_port";
+write_file(File::Spec->catfile($tmpdir, 'unresolved.conf'),
+  "Include http://config.invalid:$kv_port/included.conf\n");
+
+$cmd = "$proftpd -td2 -c '$base_url/unresolved.conf?dns_prefetch=true&trace_level=1-9'";
+@output = run_cmd_output($cmd);
+ok(grep({ /host 'http:\/\/config\.invalid:$kv_port' recently failed/ } @output),
+  "failed fast for Include of host which could not be resolved");
+
+$cmd = "$proftpd -td2 -c '$base_url/unresolved.conf?dns_prefetch=true&dns_failure_ttl=0&trace_level=1-9'";
+@output = run_cmd_output($cmd);
+ok(!grep({ /recently failed/ } @output),
+  "did not remember DNS failure with dns_failure_ttl=0");
+
+# Resolving a host in advance makes no connections, and so says nothing
+# about whether the host is reachable; even with a breaker threshold of one,
+# the Include of a refused port is requested.
+my $refused_port = $kv_port + 1;
+write_file(File::Spec->catfile($tmpdir, 'refused.conf'),
+  "Include http://127.0.0.1:$refused_port/included.conf\n");
+
+$cmd = "$proftpd -td2 -c '$base_url/refused.conf?dns_prefetch=true&breaker_threshold=1&trace_level=1-9'";
+@output = run_cmd_output($cmd);
+ok(grep({ /'http:\/\/127\.0\.0\.1:$refused_port\/included\.conf' request error/ } @output) &&
+   !grep({ /recently failed/ } @output),
+  "requested Include of refused port after resolving its host in advance");
+
+# A fetch stalled by a slow server is aborted once a signal to terminate is
+# pending, rather than when the request times out.
+write_file(File::Spec->catfile($tmpdir, 'stalled.conf'), "MaxInstances 5\n");
+unlink(File::Spec->catfile($tmpdir, 'access.log'));
+
+my $stalled_pid = fork();
+if ($stalled_pid == 0) {
+  open(STDOUT, '>', '/dev/null');
+  open(STDERR, '>', '/dev/null');
+  exec($proftpd, '-t', '-c',
+    "http://127.0.0.1:$kv_port/stalled.conf?delay=30&tracing=$tracing");
+  exit(1);
+}
+
+wait_for(sub { origin_requests(qr{^/stalled\.conf\?delay=30}) > 0 }, 10);
+kill('TERM', $stalled_pid);
+
+ok(wait_for(sub { waitpid($stalled_pid, WNOHANG) == $stalled_pid }, 5),
+  "exited promptly on SIGTERM during stalled fetch");
+if (kill(0, $stalled_pid)) {
+  kill('KILL', $stalled_pid);
+  waitpid($stalled_pid, 0);
+}
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub origin_requests {
+  my $pattern = shift;
+
+  my $count = 0;
+  if (open(my $fh, "< " . File::Spec->catfile($tmpdir, 'access.log'))) {
+    while (my $line = <$fh>) {
+      chomp($line);
+      $count++ if $line =~ /^GET (\S+)$/ && $1 =~ $pattern;
+    }
+
+    close($fh);
+  }
+
+  return $count;
+}
+
+sub wait_for {
+  my $cond = shift;
+  my $timeout = shift;
+  $timeout = 20 unless defined($timeout);
+
+  for (my $i = 0; $i < $timeout * 2; $i++) {
+    return 1 if $cond->();
+    select(undef, undef, undef, 0.5);
+  }
+
+  return 0;
+}
+
+sub read_file {
+  my $path = shift;
+
+  open(my $fh, "< $path") or croak("Can't read $path: $!");
+  local $/;
+  my $text = <$fh>;
+  close($fh);
+
+  return $text;
+}
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+# Runs the given command, returning its output, including the trace
+# logging written to stderr.
+sub run_cmd_output {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd 2>&1`;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return @output;
+}
+
 sub run_cmd {
   my $cmd = shift;
   my $check_exit_status = shift;
@@ -6,7 +6,7 @@ use Carp;
 use Cwd qw(abs_path realpath);
 use File::Path qw(mkpath rmtree);
 use File::Spec;
-use Test::Simple tests => 4;
+use Test::Simple tests => 13;
 
 my $proftpd = $ENV{PROFTPD_TEST_BIN};
 my $proftpd_opts = "-t";
@@ -45,6 +45,190 @@ eval { $res = run_cmd($cmd, 1) };
 $ex = $@ if $@;
 ok(defined($ex), "handled HTTPS URL with good file");
 
+# Serve files from the test directory over HTTPS locally, using a
+# self-signed certificate.  This server speaks neither HTTP/2 nor HTTP/3,
+# so requests for those versions must fall back to HTTP/1.x.
+my $tmpdir = $ARGV[0];
+my $cert_file = File::Spec->catfile($tmpdir, 'cert.pem');
+my $key_file = File::Spec->catfile($tmpdir, 'key.pem');
+system("openssl req -x509 -newkey rsa:2048 -nodes -days 1 " .
+  "-subj /CN=127.0.0.1 -addext subjectAltName=IP:127.0.0.1 " .
+  "-keyout $key_file -out $cert_file > /dev/null 2>&1");
+
+write_file(File::Spec->catfile($tmpdir, 'versioned.conf'),
+  "ServerName \"Versioned\"\n");
+
+my $https_port = 20000 + ($$ % 10000);
+my $https_pid = fork();
+if ($https_pid == 0) {
+  chdir($tmpdir);
+  open(STDOUT, "> /dev/null");
+  open(STDERR, "> /dev/null");
+  exec('openssl', 's_server', '-quiet', '-accept', $https_port, '-cert',
+    $cert_file, '-key', $key_file, '-WWW');
+  exit(1);
+}
+sleep(1);
+
+my $versioned_url = "https://127.0.0.1:$https_port/versioned.conf?ssl_ca_file=$cert_file&trace_level=1-9";
+my @output;
+
+$cmd = "$proftpd -td2 -c '$versioned_url&http_version=2'";
+$ex = undef;
+eval { @output = run_cmd_output($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex) &&
+   grep({ /transferred using HTTP\/1\.[01]/ } @output),
+  "fell back to HTTP/1.x for HTTPS URL using HTTP/2");
+
+# Depending on libcurl, the fallback is done by libcurl itself, by our
+# retry of the request, or (lacking HTTP/3 support) by not trying HTTP/3.
+$cmd = "$proftpd -td2 -c '$versioned_url&http_version=3'";
+$ex = undef;
+eval { @output = run_cmd_output($cmd, 1) };
+$ex = $@ if $@;
+foreach my $line (grep { /retrying without HTTP\/3|lacks HTTP\/3/ } @output) {
+  print STDOUT "# $line";
+}
+ok(!defined($ex) &&
+   grep({ /transferred using HTTP\/1\.[01]/ } @output) &&
+   !grep({ /transferred using HTTP\/3/ } @output),
+  "fell back to HTTP/1.x for HTTPS URL using HTTP/3");
+
+# The server's certificate is only trusted with the right CA certificates,
+# whether given as a file or as a (hashed) directory.
+$cmd = "$proftpd $proftpd_opts -c 'https://127.0.0.1:$https_port/versioned.conf?ssl_ca_file=$cert_file&tracing=$tracing'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "verified HTTPS server using ssl_ca_file");
+
+my $other_cert_file = File::Spec->catfile($tmpdir, 'other-cert.pem');
+my $other_key_file = File::Spec->catfile($tmpdir, 'other-key.pem');
+system("openssl req -x509 -newkey rsa:2048 -nodes -days 1 " .
+  "-subj /CN=127.0.0.1 -addext subjectAltName=IP:127.0.0.1 " .
+  "-keyout $other_key_file -out $other_cert_file > /dev/null 2>&1");
+
+$cmd = "$proftpd $proftpd_opts -c 'https://127.0.0.1:$https_port/versioned.conf?ssl_ca_file=$other_cert_file&tracing=$tracing'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "rejected HTTPS server using wrong ssl_ca_file");
+
+my $ca_dir = File::Spec->catdir($tmpdir, 'ca.d');
+mkpath($ca_dir);
+my $cert_hash = `openssl x509 -noout -hash -in $cert_file`;
+chomp($cert_hash);
+write_file(File::Spec->catfile($ca_dir, "$cert_hash.0"),
+  read_file($cert_file));
+
+$cmd = "$proftpd $proftpd_opts -c 'https://127.0.0.1:$https_port/versioned.conf?ssl_ca_path=$ca_dir&tracing=$tracing'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "verified HTTPS server using ssl_ca_path");
+
+# This server requires a client certificate, issued by (here, the same as)
+# the given CA certificate.
+my $client_cert_file = File::Spec->catfile($tmpdir, 'client-cert.pem');
+my $client_key_file = File::Spec->catfile($tmpdir, 'client-key.pem');
+system("openssl req -x509 -newkey rsa:2048 -nodes -days 1 " .
+  "-subj /CN=client -keyout $client_key_file -out $client_cert_file " .
+  "> /dev/null 2>&1");
+
+my $mtls_port = $https_port + 1;
+my $mtls_pid = fork();
+if ($mtls_pid == 0) {
+  chdir($tmpdir);
+  open(STDOUT, "> /dev/null");
+  open(STDERR, "> /dev/null");
+  exec('openssl', 's_server', '-quiet', '-accept', $mtls_port, '-cert',
+    $cert_file, '-key', $key_file, '-Verify', '1', '-CAfile',
+    $client_cert_file, '-WWW');
+  exit(1);
+}
+sleep(1);
+
+my $mtls_url = "https://127.0.0.1:$mtls_port/versioned.conf?ssl_ca_file=$cert_file&tracing=$tracing";
+
+$cmd = "$proftpd $proftpd_opts -c '$mtls_url&ssl_cert=$client_cert_file&ssl_key=$client_key_file'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "presented client certificate using ssl_cert/ssl_key");
+
+$cmd = "$proftpd $proftpd_opts -c '$mtls_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "rejected by HTTPS server without client certificate");
+
+# A certificate whose key cannot be read, or does not match, fails the fetch
+# rather than being left out of the handshake.
+my $no_key_file = File::Spec->catfile($tmpdir, 'no-such-key.pem');
+$cmd = "$proftpd $proftpd_opts -c '$mtls_url&ssl_cert=$client_cert_file&ssl_key=$no_key_file'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "failed HTTPS URL with missing ssl_key");
+
+$cmd = "$proftpd $proftpd_opts -c '$mtls_url&ssl_cert=$client_cert_file&ssl_key=$other_key_file'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "failed HTTPS URL with mismatched ssl_key");
+
+kill('TERM', $mtls_pid);
+waitpid($mtls_pid, 0);
+
+kill('TERM', $https_pid);
+waitpid($https_pid, 0);
+
+sub read_file {
+  my $path = shift;
+
+  open(my $fh, "< $path") or croak("Can't read $path: $!");
+  local $/;
+  my $text = <$fh>;
+  close($fh);
+
+  return $text;
+}
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+# Runs the given command, returning its output, including the trace
+# logging written to stderr.
+sub run_cmd_output {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd 2>&1`;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return @output;
+}
+
 sub run_cmd {
   my $cmd = shift;
   my $check_exit_status = shift;
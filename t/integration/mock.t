@@ -0,0 +1,101 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 5;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+
+# The mock backend serves these responses from memory; the host does not
+# resolve, so only the mock backend can succeed in fetching them.
+my $base_url = "http://config.invalid";
+my $mock_file = File::Spec->catfile($tmpdir, 'mock.txt');
+write_mock_file($mock_file,
+  ["$base_url/proftpd.conf", 200,
+    "ServerName \"Mock\"\nInclude $base_url/conf.d/a.conf\n" .
+    "Include $base_url/conf.d/b.conf\n"],
+  ["$base_url/conf.d/a.conf", 200, "DefaultPort 2121\n"],
+  ["$base_url/conf.d/b.conf", 200, "MaxInstances 5\n"],
+  ["$base_url/missing.conf", 200, "Include $base_url/conf.d/c.conf\n"],
+  ["$base_url/conf.d/c.conf", 404, "Not Found\n"],
+  ["$base_url/garbled.conf", 200, "NoSuchDirective on\n"],
+);
+
+my ($cmd, $ex, @output);
+my $params = "backend=mock&mock_responses=$mock_file&tracing=$tracing";
+
+$cmd = "$proftpd -td2 -c '$base_url/proftpd.conf?$params'";
+$ex = undef;
+eval { @output = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "parsed configuration from mock backend");
+ok(grep({ /configuration parse made 3 mock requests/ } @output),
+  "fetched every URL from mock backend");
+
+# Deliver the bodies a few bytes at a time, as a network would.
+$cmd = "$proftpd -t -c '$base_url/proftpd.conf?$params&mock_chunk_size=7&mock_latency=10'";
+$ex = undef;
+eval { run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "parsed configuration from mock backend in chunks");
+
+$cmd = "$proftpd -t -c '$base_url/missing.conf?$params'";
+$ex = undef;
+eval { run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "handled mock 404 response for Include");
+
+# The mock body is what is parsed, so an unknown directive in it fails.
+$cmd = "$proftpd -t -c '$base_url/garbled.conf?$params'";
+$ex = undef;
+eval { run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "parsed mock response body");
+
+sub write_mock_file {
+  my $path = shift;
+  my @resps = @_;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh "URLCONF-MOCK 1\n";
+  foreach my $resp (@resps) {
+    my ($url, $code, $data) = @$resp;
+    print $fh "$url $code ", length($data), "\n$data\n";
+  }
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd 2>&1`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return @output;
+}
@@ -0,0 +1,95 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 3;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $proftpd_opts = "-t";
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $proftpd_opts = "-td10";
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+my $config_file = File::Spec->catfile($tmpdir, 'resumed.conf');
+write_file($config_file,
+  "ServerName \"Resumed\"\nDefaultPort 2121\nMaxInstances 5\n");
+
+# Start the local KV stand-in, which supports range requests.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $tmpdir);
+  exit(1);
+}
+sleep(1);
+
+my ($cmd, $ex, $res);
+
+# The server closes the connection partway through the response body.
+my $truncated_url = "http://127.0.0.1:$kv_port/resumed.conf?truncate=20&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$truncated_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "failed truncated HTTP URL response without retries");
+
+my $resumed_url = "http://127.0.0.1:$kv_port/resumed.conf?truncate=20&retries=1&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$resumed_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "resumed truncated HTTP URL response with retries");
+
+my $retried_url = "http://127.0.0.1:$kv_port/resumed.conf?retries=2&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$retried_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled HTTP URL with retries");
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd > /dev/null`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return 1;
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 2;
+use Time::HiRes qw(time);
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $tracing = "true";
+}
+
+# How many URL Includes to use; e.g. 100000, for profiling large,
+# generated multi-tenant configurations.
+my $include_count = $ENV{URLCONF_SCALE_INCLUDES} || 10000;
+
+# Set URLCONF_SCALE_BACKEND=mock to serve the Includes as HTTP URLs, from
+# memory, measuring the cost of mod_conf_url itself rather than that of the
+# filesystem.
+my $backend = $ENV{URLCONF_SCALE_BACKEND} || 'file';
+
+my $tmpdir = $ARGV[0];
+my $include_dir = File::Spec->catdir($tmpdir, 'vhosts.d');
+mkpath($include_dir);
+
+my $mock_base_url = "http://config.invalid/vhosts.d";
+my $mock_data = '';
+
+my $config = "ServerName \"Scale\"\nDefaultPort 2121\n";
+for (my $i = 0; $i < $include_count; $i++) {
+  if ($backend eq 'mock') {
+    my $include_url = "$mock_base_url/vhost-$i.conf";
+    my $text = "# vhost $i\n";
+    $mock_data .= "$include_url 200 " . length($text) . "\n$text\n";
+    $config .= "Include $include_url\n";
+
+  } else {
+    my $include_file = File::Spec->catfile($include_dir, "vhost-$i.conf");
+    write_file($include_file, "# vhost $i\n");
+    $config .= "Include file://$include_file\n";
+  }
+}
+
+my $config_file = File::Spec->catfile($tmpdir, 'proftpd.conf');
+write_file($config_file, $config);
+
+# The parse summary, logged at DebugLevel 2, reports the URLs opened, and
+# the time spent opening them.
+my $url = "file://$config_file?tracing=$tracing";
+if ($backend eq 'mock') {
+  my $mock_url = "http://config.invalid/proftpd.conf";
+  my $mock_file = File::Spec->catfile($tmpdir, 'mock.txt');
+  write_file($mock_file, "URLCONF-MOCK 1\n$mock_url 200 " . length($config) .
+    "\n$config\n$mock_data");
+  $url = "$mock_url?backend=mock&mock_responses=$mock_file&tracing=$tracing";
+}
+my $cmd = "$proftpd -td2 -c '$url' 2>&1";
+
+if ($ENV{TEST_VERBOSE}) {
+  print STDOUT "# Executing: $cmd\n";
+}
+
+my $start = time();
+my @output = `$cmd`;
+my $exit_status = $?;
+my $elapsed = time() - $start;
+
+my $summary = join('', grep { /configuration parse (opened|spent)/ } @output);
+foreach my $line (split(/\n/, $summary)) {
+  print STDOUT "# $line\n";
+}
+printf STDOUT "# %d URL Includes parsed in %.2f secs\n", $include_count,
+  $elapsed;
+
+ok($exit_status == 0, "handled $include_count URL Includes");
+ok($summary =~ /opened (\d+) URLs/ && $1 == $include_count + 1,
+  "opened every URL Include once");
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
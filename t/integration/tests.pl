@@ -39,6 +39,15 @@ my $test_files = [
   ["$test_dir/ftp.t", 'ftp'],
   ["$test_dir/ftps.t", 'ftps'],
   ["$test_dir/file.t", 'file'],
+  ["$test_dir/cache.t", 'cache'],
+  ["$test_dir/watch.t", 'watch'],
+  ["$test_dir/ctrls.t", 'ctrls'],
+  ["$test_dir/resume.t", 'resume'],
+  ["$test_dir/delta.t", 'delta'],
+  ["$test_dir/token.t", 'token'],
+  ["$test_dir/fleet.t", 'fleet'],
+  ["$test_dir/mock.t", 'mock'],
+  ["$test_dir/scale.t", 'scale'],
 ];
 
 # Create a temp directory for each separate test, pass it in, cleanup afterward
@@ -48,6 +57,15 @@ my $tap_test_args = {
   'ftp' => [get_tmp_dir()],
   'ftps' => [get_tmp_dir()],
   'file' => [get_tmp_dir()],
+  'cache' => [get_tmp_dir()],
+  'watch' => [get_tmp_dir()],
+  'ctrls' => [get_tmp_dir()],
+  'resume' => [get_tmp_dir()],
+  'delta' => [get_tmp_dir()],
+  'token' => [get_tmp_dir()],
+  'fleet' => [get_tmp_dir()],
+  'mock' => [get_tmp_dir()],
+  'scale' => [get_tmp_dir()],
 };
 
 my $tap_opts = {
@@ -0,0 +1,141 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 7;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $proftpd_opts = "-t";
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $proftpd_opts = "-td10";
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+my $protected_dir = File::Spec->catdir($tmpdir, 'protected');
+mkpath($protected_dir);
+
+# Start the local KV stand-in, which also serves as the token endpoint, and
+# only serves "/protected/" paths given a token it issued.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $tmpdir);
+  exit(1);
+}
+sleep(1);
+
+my $credentials_file = File::Spec->catfile($tmpdir, 'token-credentials');
+write_file($credentials_file, "proftpd:s3cret\n");
+
+my $token_log = File::Spec->catfile($tmpdir, 'token.log');
+my $token_url = "http://127.0.0.1:$kv_port/token";
+my $token_params = "token_url=$token_url&token_credentials=$credentials_file";
+
+write_file(File::Spec->catfile($protected_dir, 'included.conf'),
+  "MaxInstances 5\n");
+write_file(File::Spec->catfile($protected_dir, 'proftpd.conf'),
+  "ServerName \"Protected\"\nDefaultPort 2121\n" .
+  "Include http://127.0.0.1:$kv_port/protected/included.conf\n");
+
+my ($cmd, $ex, $res);
+
+my $url = "http://127.0.0.1:$kv_port/protected/proftpd.conf?tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "failed protected HTTP URL without token");
+
+$url = "http://127.0.0.1:$kv_port/protected/proftpd.conf?$token_params&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled protected HTTP URL with token");
+ok(count_lines($token_log) == 1, "obtained one token for all URLs");
+
+# Each token is good for only one request, so the Include needs another.
+write_file(File::Spec->catfile($protected_dir, 'proftpd.conf'),
+  "ServerName \"Protected\"\nDefaultPort 2121\n" .
+  "Include http://127.0.0.1:$kv_port/protected/included.conf?token_uses=1\n");
+
+$url = "http://127.0.0.1:$kv_port/protected/proftpd.conf?token_uses=1&$token_params&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled protected HTTP URL with rejected token");
+ok(count_lines($token_log) == 3, "obtained new token once rejected");
+
+# The token is only sent to the origin of the URL which set the token
+# endpoint; "localhost" is the same server, but a different origin.  Thus
+# this parse obtains one token, which the other origin never rejects.
+write_file(File::Spec->catfile($protected_dir, 'other-origin.conf'),
+  "ServerName \"Protected\"\nDefaultPort 2121\n" .
+  "Include http://localhost:$kv_port/protected/included.conf\n");
+
+$url = "http://127.0.0.1:$kv_port/protected/other-origin.conf?$token_params&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "failed protected HTTP URL of other origin");
+ok(count_lines($token_log) == 4, "did not refresh token for other origin");
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub count_lines {
+  my $path = shift;
+
+  my $count = 0;
+  if (open(my $fh, "< $path")) {
+    $count++ while <$fh>;
+    close($fh);
+  }
+
+  return $count;
+}
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd > /dev/null`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return 1;
+}
@@ -0,0 +1,264 @@
+#!/usr/bin/env perl
+
+use strict;
+
+use Carp;
+use Cwd qw(abs_path realpath);
+use File::Basename qw(dirname);
+use File::Path qw(mkpath rmtree);
+use File::Spec;
+use Test::Simple tests => 9;
+
+my $proftpd = $ENV{PROFTPD_TEST_BIN};
+my $proftpd_opts = "-t";
+my $tracing = "false";
+if ($ENV{TEST_VERBOSE}) {
+  $proftpd_opts = "-td10";
+  $tracing = "true";
+}
+
+my $tmpdir = $ARGV[0];
+my $config_file = File::Spec->catfile($tmpdir, 'watched.conf');
+write_file($config_file, "ServerName \"Watched\"\n");
+
+# Start the local KV stand-in.
+my $kv_port = 20000 + ($$ % 10000);
+my $kv_server = File::Spec->catfile(dirname(abs_path($0)), '..',
+  'kv-server.pl');
+my $kv_pid = fork();
+if ($kv_pid == 0) {
+  exec($^X, $kv_server, $kv_port, $tmpdir);
+  exit(1);
+}
+sleep(1);
+
+my ($cmd, $ex, $res);
+my $consul_url = "http://127.0.0.1:$kv_port/watched.conf?watch=consul&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$consul_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled HTTP URL watched as Consul key");
+
+my $etcd_url = "http://127.0.0.1:$kv_port/watched.conf?watch=etcd&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$etcd_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled HTTP URL watched as etcd key");
+
+my $polled_url = "http://127.0.0.1:$kv_port/watched.conf?watch_interval=60&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$polled_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(!defined($ex), "handled HTTP URL polled for changes");
+
+my $bad_watch_url = "http://127.0.0.1:$kv_port/watched.conf?watch=zookeeper&tracing=$tracing";
+$cmd = "$proftpd $proftpd_opts -c '$bad_watch_url'";
+$ex = undef;
+eval { $res = run_cmd($cmd, 1) };
+$ex = $@ if $@;
+ok(defined($ex), "handled HTTP URL with unsupported watch type");
+
+# Now run the daemon itself, and check that a change to a watched key
+# restarts it.  The new configuration Includes a URL which the old one does
+# not, so that fetching it shows that the new configuration was parsed.
+my $ftp_port = $kv_port + 1;
+my $pid_file = File::Spec->catfile($tmpdir, 'proftpd.pid');
+
+my $daemon_url = "http://127.0.0.1:$kv_port/daemon.conf?watch=consul&tracing=$tracing";
+my $daemon_file = File::Spec->catfile($tmpdir, 'daemon.conf');
+write_file($daemon_file, daemon_config(''));
+write_file(File::Spec->catfile($tmpdir, 'restarted.conf'),
+  "MaxInstances 10\n");
+
+my $daemon_pid = start_daemon($daemon_url);
+ok(defined($daemon_pid) &&
+   wait_for(sub { origin_requests(qr{^/daemon\.conf\?index=\d+}) > 0 }),
+  "started watcher for daemon watching Consul key");
+
+my $index = change_file($daemon_file,
+  daemon_config("Include http://127.0.0.1:$kv_port/restarted.conf\n"));
+ok(wait_for(sub { origin_requests(qr{^/restarted\.conf$}) > 0 }),
+  "restarted daemon when Consul key changed");
+ok(wait_for(sub { origin_requests(qr{^/daemon\.conf\?index=$index&}) > 0 }),
+  "restarted watcher for daemon watching Consul key");
+stop_daemon($daemon_pid);
+
+# Likewise for a polled URL.
+my $polled_daemon_url = "http://127.0.0.1:$kv_port/polled-daemon.conf?watch_interval=1&tracing=$tracing";
+my $polled_daemon_file = File::Spec->catfile($tmpdir, 'polled-daemon.conf');
+write_file($polled_daemon_file, daemon_config(''));
+write_file(File::Spec->catfile($tmpdir, 'repolled.conf'),
+  "MaxInstances 10\n");
+
+$daemon_pid = start_daemon($polled_daemon_url);
+change_file($polled_daemon_file,
+  daemon_config("Include http://127.0.0.1:$kv_port/repolled.conf\n"));
+ok(defined($daemon_pid) &&
+   wait_for(sub { origin_requests(qr{^/repolled\.conf$}) > 0 }),
+  "restarted daemon when polled URL changed");
+stop_daemon($daemon_pid);
+
+# Likewise for a polled URL which needs a bearer token; as each token is
+# good for only one request, the watcher must obtain new tokens as its
+# tokens are rejected.
+my $protected_dir = File::Spec->catdir($tmpdir, 'protected');
+mkpath($protected_dir);
+
+my $token_params = "token_url=http://127.0.0.1:$kv_port/token";
+my $token_daemon_url = "http://127.0.0.1:$kv_port/protected/token-daemon.conf?token_uses=1&watch_interval=1&$token_params&tracing=$tracing";
+my $token_daemon_file = File::Spec->catfile($protected_dir,
+  'token-daemon.conf');
+write_file($token_daemon_file, daemon_config(''));
+write_file(File::Spec->catfile($protected_dir, 'retokened.conf'),
+  "MaxInstances 10\n");
+
+$daemon_pid = start_daemon($token_daemon_url);
+change_file($token_daemon_file,
+  daemon_config("Include http://127.0.0.1:$kv_port/protected/retokened.conf?token_uses=1\n"));
+ok(defined($daemon_pid) &&
+   wait_for(sub { origin_requests(qr{^/protected/retokened\.conf\?}) > 0 },
+     40),
+  "restarted daemon when token-protected polled URL changed");
+stop_daemon($daemon_pid);
+
+kill('TERM', $kv_pid);
+waitpid($kv_pid, 0);
+
+sub daemon_config {
+  my $extra = shift;
+
+  my $user = (getpwuid($<))[0];
+  my $group = (getgrgid($())[0];
+  my $scoreboard_file = File::Spec->catfile($tmpdir, 'proftpd.scoreboard');
+  my $log_file = File::Spec->catfile($tmpdir, 'proftpd.log');
+
+  return <<EOC;
+ServerType standalone
+ServerName "Watched"
+DefaultAddress 127.0.0.1
+Port $ftp_port
+User $user
+Group $group
+PidFile $pid_file
+ScoreboardFile $scoreboard_file
+SystemLog $log_file
+TransferLog none
+WtmpLog off
+<IfModule mod_delay.c>
+  DelayEngine off
+</IfModule>
+$extra
+EOC
+}
+
+# Replaces the content of the given file, making sure that its index (its
+# modification time) changes.  Returns the new index.
+sub change_file {
+  my $path = shift;
+  my $text = shift;
+
+  my $index = (stat($path))[9] + 5;
+  write_file($path, $text);
+  utime($index, $index, $path);
+
+  return $index;
+}
+
+sub origin_requests {
+  my $pattern = shift;
+
+  my $count = 0;
+  if (open(my $fh, "< " . File::Spec->catfile($tmpdir, 'access.log'))) {
+    while (my $line = <$fh>) {
+      chomp($line);
+      $count++ if $line =~ /^GET (\S+)$/ && $1 =~ $pattern;
+    }
+
+    close($fh);
+  }
+
+  return $count;
+}
+
+sub wait_for {
+  my $cond = shift;
+  my $timeout = shift;
+  $timeout = 20 unless defined($timeout);
+
+  for (my $i = 0; $i < $timeout * 2; $i++) {
+    return 1 if $cond->();
+    select(undef, undef, undef, 0.5);
+  }
+
+  return 0;
+}
+
+# Starts the daemon, which daemonizes, and returns the PID of the daemon
+# process proper, per its PidFile.
+sub start_daemon {
+  my $url = shift;
+
+  unlink($pid_file);
+
+  my $cmd = "$proftpd -c '$url'";
+  eval { run_cmd($cmd, 1) };
+  return undef if $@;
+
+  my $pid;
+  wait_for(sub {
+    if (open(my $fh, "< $pid_file")) {
+      $pid = <$fh>;
+      close($fh);
+      chomp($pid) if defined($pid);
+    }
+
+    return defined($pid) && $pid =~ /^\d+$/;
+  }, 10);
+
+  return $pid;
+}
+
+sub stop_daemon {
+  my $pid = shift;
+  return unless defined($pid);
+
+  kill('TERM', $pid);
+  wait_for(sub { !kill(0, $pid) }, 10);
+}
+
+sub write_file {
+  my $path = shift;
+  my $text = shift;
+
+  open(my $fh, "> $path") or croak("Can't write $path: $!");
+  print $fh $text;
+  close($fh);
+}
+
+sub run_cmd {
+  my $cmd = shift;
+  my $check_exit_status = shift;
+  $check_exit_status = 0 unless defined $check_exit_status;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Executing: $cmd\n";
+  }
+
+  my @output = `$cmd > /dev/null`;
+  my $exit_status = $?;
+
+  if ($ENV{TEST_VERBOSE}) {
+    print STDOUT "# Output: ", join('', @output), "\n";
+  }
+
+  if ($check_exit_status) {
+    if ($? != 0) {
+      croak("'$cmd' failed with exit code $?");
+    }
+  }
+
+  return 1;
+}
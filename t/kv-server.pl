@@ -0,0 +1,347 @@
+#!/usr/bin/env perl
+
+# A local stand-in for a KV-style HTTP endpoint which supports blocking
+# queries, for testing the mod_conf_url watcher without Consul or etcd.
+#
+# Every request path is served from the given directory.  The index of a
+# file is its modification time, reported in both the X-Consul-Index and
+# X-Etcd-Index response headers.  Requests with an "index" (Consul) or
+# "waitIndex" (etcd) query parameter block until the file's index differs
+# from (or, for etcd, reaches) that index, or until the "wait" time (Consul;
+# e.g. "30s" or "5m") elapses.
+#
+# Responses carry an ETag (the index, quoted), and honor "Range: bytes=N-"
+# requests (with If-Range) using 206 responses.  For testing resumption, a
+# "truncate" query parameter makes non-Range responses close the connection
+# after that many bytes of the body.
+#
+# Each version of a file served is kept (in a ".versions" subdirectory), so
+# that requests with "A-IM: diffe" and an If-None-Match naming an older
+# version get a 226 response: a "diff -e" delta against that version, with
+# a Digest header.  Such deltas are logged to "delta.log" in the directory.
+#
+# As an OAuth 2.0 token endpoint, POSTs to "/token" get a new bearer token,
+# logged to "token.log", if their Basic credentials match those in the
+# "token-credentials" file (if any).  Paths under "/protected/" need the
+# most recently issued token; a "token_uses" query parameter limits how many
+# requests each token may be used for.
+#
+# Every request is logged, as its method and URI, to "access.log" in the
+# directory.  A "delay" query parameter delays the response by that many
+# seconds.
+#
+# Usage: kv-server.pl <port> <directory>
+
+use strict;
+
+use Digest::SHA qw(sha256_base64);
+use File::Copy qw(copy);
+use File::Path qw(mkpath);
+use File::Spec;
+use IO::Socket::INET;
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(sleep);
+
+my $port = shift or die("Usage: $0 <port> <directory>\n");
+my $dir = shift or die("Usage: $0 <port> <directory>\n");
+
+my $listener = IO::Socket::INET->new(
+  LocalAddr => '127.0.0.1',
+  LocalPort => $port,
+  Listen => 16,
+  Proto => 'tcp',
+  ReuseAddr => 1,
+) or die("Can't listen on port $port: $!\n");
+
+$SIG{CHLD} = sub {
+  while (waitpid(-1, WNOHANG) > 0) {
+  }
+};
+
+while (1) {
+  my $client = $listener->accept();
+  next unless $client;
+
+  my $pid = fork();
+  if (!defined($pid)) {
+    close($client);
+    next;
+  }
+
+  if ($pid == 0) {
+    close($listener);
+    handle_client($client);
+    exit(0);
+  }
+
+  close($client);
+}
+
+sub file_index {
+  my $path = shift;
+
+  my @st = stat($path);
+  return undef unless @st;
+  return $st[9];
+}
+
+sub parse_wait {
+  my $wait = shift;
+
+  return 300 unless defined($wait);
+  if ($wait =~ /^(\d+)m$/) {
+    return $1 * 60;
+  }
+
+  if ($wait =~ /^(\d+)s?$/) {
+    return $1;
+  }
+
+  return 300;
+}
+
+sub handle_client {
+  my $client = shift;
+
+  my $request = <$client>;
+  return unless defined($request);
+
+  # Consume the request headers, noting any range requested.
+  my ($range_start, $if_range, $a_im, $if_none_match, $authz, $content_len);
+  while (my $line = <$client>) {
+    last if $line =~ /^\r?\n$/;
+
+    if ($line =~ /^Authorization:\s*(.*?)\s*$/i) {
+      $authz = $1;
+
+    } elsif ($line =~ /^Content-Length:\s*(\d+)\s*$/i) {
+      $content_len = $1;
+    }
+
+    if ($line =~ /^A-IM:\s*(.*?)\s*$/i) {
+      $a_im = $1;
+
+    } elsif ($line =~ /^If-None-Match:\s*(.*?)\s*$/i) {
+      $if_none_match = $1;
+    }
+
+    if ($line =~ /^Range:\s*bytes=(\d+)-\s*$/i) {
+      $range_start = $1;
+
+    } elsif ($line =~ /^If-Range:\s*(.*?)\s*$/i) {
+      $if_range = $1;
+    }
+  }
+
+  my ($method, $uri) = split(/\s+/, $request);
+  log_request($method, $uri);
+  my ($path, $query) = split(/\?/, $uri, 2);
+  my %params;
+  foreach my $kv (split(/&/, $query || '')) {
+    my ($k, $v) = split(/=/, $kv, 2);
+    $params{$k} = $v;
+  }
+
+  sleep($params{delay}) if defined($params{delay});
+
+  if ($method eq 'POST' && $path eq '/token') {
+    my $form = '';
+    read($client, $form, $content_len) if $content_len;
+    handle_token($client, $authz, $form);
+    close($client);
+    return;
+  }
+
+  if ($path =~ m{^/protected/} &&
+      !token_valid($authz, $params{token_uses})) {
+    print $client "HTTP/1.1 401 Unauthorized\r\n",
+      "WWW-Authenticate: Bearer\r\n",
+      "Content-Length: 0\r\n",
+      "Connection: close\r\n\r\n";
+    close($client);
+    return;
+  }
+
+  my $file = File::Spec->catfile($dir, $path);
+  my $index = file_index($file);
+
+  if (defined($index)) {
+    my $deadline = time() + parse_wait($params{wait});
+
+    if (defined($params{index})) {
+      while ($index == $params{index} && time() < $deadline) {
+        sleep(0.5);
+        $index = file_index($file);
+      }
+
+    } elsif (defined($params{waitIndex})) {
+      while ($index < $params{waitIndex} && time() < $deadline) {
+        sleep(0.5);
+        $index = file_index($file);
+      }
+    }
+  }
+
+  if (!defined($index) || !open(my $fh, "< $file")) {
+    print $client "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n",
+      "Connection: close\r\n\r\n";
+
+  } else {
+    local $/;
+    my $body = <$fh>;
+    close($fh);
+
+    my $etag = "\"$index\"";
+
+    my $versions_dir = File::Spec->catdir($dir, '.versions');
+    mkpath($versions_dir);
+    my $version_file = File::Spec->catfile($versions_dir, "$path\@$index");
+    $version_file =~ s{/+}{/}g;
+    mkpath((File::Spec->splitpath($version_file))[1]);
+    copy($file, $version_file) unless -f $version_file;
+
+    my $base_file;
+    if (defined($if_none_match) && $if_none_match =~ /^"(\d+)"$/) {
+      $base_file = File::Spec->catfile($versions_dir, "$path\@$1");
+      $base_file =~ s{/+}{/}g;
+    }
+
+    if (defined($if_none_match) && $if_none_match eq $etag) {
+      print $client "HTTP/1.1 304 Not Modified\r\n",
+        "ETag: $etag\r\n",
+        "Connection: close\r\n\r\n";
+
+    } elsif (defined($a_im) && $a_im =~ /\bdiffe\b/i &&
+             defined($base_file) && -f $base_file) {
+      my $delta = `diff -e '$base_file' '$file'`;
+      my $digest = sha256_base64($body);
+      $digest .= '=' while length($digest) % 4;
+
+      if (open(my $log, ">> " . File::Spec->catfile($dir, 'delta.log'))) {
+        print $log "$path $if_none_match $etag\n";
+        close($log);
+      }
+
+      print $client "HTTP/1.1 226 IM Used\r\n",
+        "Content-Type: text/plain\r\n",
+        "Content-Length: ", length($delta), "\r\n",
+        "IM: diffe\r\n",
+        "Delta-Base: $if_none_match\r\n",
+        "Digest: SHA-256=$digest\r\n",
+        "ETag: $etag\r\n",
+        "Connection: close\r\n\r\n",
+        $delta;
+
+    } elsif (defined($range_start) &&
+        (!defined($if_range) || $if_range eq $etag) &&
+        $range_start < length($body)) {
+      my $part = substr($body, $range_start);
+
+      print $client "HTTP/1.1 206 Partial Content\r\n",
+        "Content-Type: text/plain\r\n",
+        "Content-Length: ", length($part), "\r\n",
+        "Content-Range: bytes $range_start-", length($body) - 1, "/",
+          length($body), "\r\n",
+        "ETag: $etag\r\n",
+        "Connection: close\r\n\r\n",
+        $part;
+
+    } else {
+      print $client "HTTP/1.1 200 OK\r\n",
+        "Content-Type: text/plain\r\n",
+        "Content-Length: ", length($body), "\r\n",
+        "ETag: $etag\r\n",
+        "X-Consul-Index: $index\r\n",
+        "X-Etcd-Index: $index\r\n",
+        "Connection: close\r\n\r\n",
+        defined($params{truncate}) ? substr($body, 0, $params{truncate}) :
+          $body;
+    }
+  }
+
+  close($client);
+}
+
+sub log_request {
+  my $method = shift;
+  my $uri = shift;
+
+  if (open(my $log, ">> " . File::Spec->catfile($dir, 'access.log'))) {
+    print $log "$method $uri\n";
+    close($log);
+  }
+}
+
+sub read_lines {
+  my $path = shift;
+
+  my @lines;
+  if (open(my $fh, "< $path")) {
+    chomp(@lines = <$fh>);
+    close($fh);
+  }
+
+  return @lines;
+}
+
+sub handle_token {
+  my $client = shift;
+  my $authz = shift;
+  my $form = shift;
+
+  my ($credentials) = read_lines(File::Spec->catfile($dir,
+    'token-credentials'));
+  if (defined($credentials)) {
+    require MIME::Base64;
+    my $expected = 'Basic ' . MIME::Base64::encode_base64($credentials, '');
+
+    if (!defined($authz) || $authz ne $expected ||
+        $form !~ /(^|&)grant_type=client_credentials(&|$)/) {
+      my $body = '{"error":"invalid_client"}';
+      print $client "HTTP/1.1 401 Unauthorized\r\n",
+        "Content-Type: application/json\r\n",
+        "Content-Length: ", length($body), "\r\n",
+        "Connection: close\r\n\r\n", $body;
+      return;
+    }
+  }
+
+  my $token_log = File::Spec->catfile($dir, 'token.log');
+  my @tokens = read_lines($token_log);
+  my $token = 'tok' . (scalar(@tokens) + 1) . "-$$";
+
+  if (open(my $log, ">> $token_log")) {
+    print $log "$token\n";
+    close($log);
+  }
+
+  my $body = "{\"access_token\":\"$token\",\"token_type\":\"Bearer\"," .
+    "\"expires_in\":3600}";
+  print $client "HTTP/1.1 200 OK\r\n",
+    "Content-Type: application/json\r\n",
+    "Cache-Control: no-store\r\n",
+    "Content-Length: ", length($body), "\r\n",
+    "Connection: close\r\n\r\n", $body;
+}
+
+sub token_valid {
+  my $authz = shift;
+  my $max_uses = shift;
+
+  my @tokens = read_lines(File::Spec->catfile($dir, 'token.log'));
+  return 0 unless @tokens;
+  return 0 unless defined($authz) && $authz eq "Bearer $tokens[-1]";
+
+  return 1 unless defined($max_uses);
+
+  my $uses_file = File::Spec->catfile($dir, "token-uses.$tokens[-1]");
+  my @uses = read_lines($uses_file);
+  return 0 if scalar(@uses) >= $max_uses;
+
+  if (open(my $fh, ">> $uses_file")) {
+    print $fh "1\n";
+    close($fh);
+  }
+
+  return 1;
+}
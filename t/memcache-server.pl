@@ -0,0 +1,164 @@
+#!/usr/bin/env perl
+
+# A local stand-in for a memcached server, for testing the mod_conf_url
+# fleet cache without memcached.
+#
+# Supports the "get", "set", "add", and "delete" commands of the memcached
+# text protocol, with expiry times in seconds.  Each command is logged, as
+# "<command> <key>", to "memcache.log" in the given directory.  Entries are
+# kept in memory, by a single process, so that they are shared by all
+# clients.
+#
+# If a file named "corrupt-values" exists in the given directory, "get"
+# serves each value with an extra byte appended, as a tampered cache would.
+#
+# Usage: memcache-server.pl <port> <directory>
+
+use strict;
+
+use File::Spec;
+use IO::Select;
+use IO::Socket::INET;
+
+my $port = shift or die("Usage: $0 <port> <directory>\n");
+my $dir = shift or die("Usage: $0 <port> <directory>\n");
+
+my $listener = IO::Socket::INET->new(
+  LocalAddr => '127.0.0.1',
+  LocalPort => $port,
+  Listen => 16,
+  Proto => 'tcp',
+  ReuseAddr => 1,
+) or die("Can't listen on port $port: $!\n");
+
+my $log_path = File::Spec->catfile($dir, 'memcache.log');
+my $corrupt_path = File::Spec->catfile($dir, 'corrupt-values');
+
+# Key => [value, expires]
+my $entries = {};
+
+# Client => pending input
+my $pending = {};
+
+my $sel = IO::Select->new($listener);
+while (1) {
+  foreach my $fh ($sel->can_read()) {
+    if ($fh == $listener) {
+      my $client = $listener->accept();
+      if ($client) {
+        $sel->add($client);
+        $pending->{$client} = '';
+      }
+
+      next;
+    }
+
+    my $buf;
+    my $len = sysread($fh, $buf, 65536);
+    unless ($len) {
+      $sel->remove($fh);
+      delete($pending->{$fh});
+      close($fh);
+      next;
+    }
+
+    $pending->{$fh} .= $buf;
+    while (handle_command($fh)) {
+    }
+  }
+}
+
+sub log_command {
+  my $cmd = shift;
+  my $key = shift;
+
+  if (open(my $log, ">> $log_path")) {
+    print $log "$cmd $key\n";
+    close($log);
+  }
+}
+
+sub get_entry {
+  my $key = shift;
+
+  my $entry = $entries->{$key};
+  return undef unless $entry;
+
+  if ($entry->[1] > 0 &&
+      time() >= $entry->[1]) {
+    delete($entries->{$key});
+    return undef;
+  }
+
+  return $entry;
+}
+
+# Handles the first complete command pending for the client, if any.
+sub handle_command {
+  my $fh = shift;
+
+  my $input = $pending->{$fh};
+  my $eol = index($input, "\r\n");
+  return 0 if $eol < 0;
+
+  my $line = substr($input, 0, $eol);
+  my ($cmd, @args) = split(/\s+/, $line);
+  $cmd = '' unless defined($cmd);
+
+  if ($cmd eq 'set' || $cmd eq 'add') {
+    my ($key, $flags, $exptime, $bytes) = @args;
+
+    # Wait for the entire value, and its trailing CRLF.
+    return 0 if length($input) < $eol + 2 + $bytes + 2;
+
+    my $value = substr($input, $eol + 2, $bytes);
+    $pending->{$fh} = substr($input, $eol + 2 + $bytes + 2);
+    log_command($cmd, $key);
+
+    if ($cmd eq 'add' &&
+        defined(get_entry($key))) {
+      print $fh "NOT_STORED\r\n";
+      return 1;
+    }
+
+    $entries->{$key} = [$value, $exptime > 0 ? time() + $exptime : 0];
+    print $fh "STORED\r\n";
+    return 1;
+  }
+
+  $pending->{$fh} = substr($input, $eol + 2);
+
+  if ($cmd eq 'get') {
+    foreach my $key (@args) {
+      log_command($cmd, $key);
+
+      my $entry = get_entry($key);
+      if ($entry) {
+        my $value = $entry->[0];
+        $value .= 'X' if -e $corrupt_path;
+
+        my $len = length($value);
+        print $fh "VALUE $key 0 $len\r\n$value\r\n";
+      }
+    }
+
+    print $fh "END\r\n";
+
+  } elsif ($cmd eq 'delete') {
+    my $key = $args[0];
+    log_command($cmd, $key);
+
+    if (defined(get_entry($key))) {
+      delete($entries->{$key});
+      print $fh "DELETED\r\n";
+
+    } else {
+      print $fh "NOT_FOUND\r\n";
+    }
+
+  } else {
+    print $fh "ERROR\r\n";
+  }
+
+  return 1;
+}
@@ -0,0 +1,495 @@
+/*
+ * ProFTPD - mod_conf_url TLS implementation
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_conf_url.h"
+#include "tls.h"
+
+#if defined(PR_USE_OPENSSL)
+# include <openssl/crypto.h>
+# include <openssl/pem.h>
+# include <openssl/ssl.h>
+# include <openssl/x509.h>
+#endif /* PR_USE_OPENSSL */
+
+static pool *tls_parent_pool = NULL;
+static pool *tls_pool = NULL;
+static pr_table_t *tls_ctxs = NULL;
+static const char *tls_default_ca_file = NULL;
+
+static const char *trace_channel = "conf_url";
+
+static const char *tls_read_file(pool *p, const char *path, size_t *datalen) {
+  int fd, xerrno;
+  struct stat st;
+  char *data;
+  size_t len = 0;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  if (fstat(fd, &st) < 0) {
+    xerrno = errno;
+    (void) close(fd);
+
+    errno = xerrno;
+    return NULL;
+  }
+
+  data = palloc(p, st.st_size + 1);
+  while (len < (size_t) st.st_size) {
+    ssize_t res;
+
+    res = read(fd, data + len, st.st_size - len);
+    if (res < 0) {
+      xerrno = errno;
+
+      if (xerrno == EINTR) {
+        pr_signals_handle();
+        continue;
+      }
+
+      (void) close(fd);
+
+      errno = xerrno;
+      return NULL;
+    }
+
+    if (res == 0) {
+      break;
+    }
+
+    len += res;
+  }
+
+  (void) close(fd);
+  data[len] = '\0';
+
+  *datalen = len;
+  return data;
+}
+
+#if defined(PR_USE_OPENSSL)
+static X509_STORE *tls_load_ca_store(const char *ca_file, const char *ca_path) {
+  X509_STORE *store;
+
+  store = X509_STORE_new();
+  if (store == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  if (ca_file != NULL ||
+      ca_path != NULL) {
+    if (X509_STORE_load_locations(store, ca_file, ca_path) != 1) {
+      pr_trace_msg(trace_channel, 3,
+        "error loading CA certificates from file '%s', path '%s'",
+        ca_file ? ca_file : "(none)", ca_path ? ca_path : "(none)");
+      X509_STORE_free(store);
+
+      errno = EINVAL;
+      return NULL;
+    }
+
+  } else {
+    if (X509_STORE_set_default_paths(store) != 1) {
+      pr_trace_msg(trace_channel, 3,
+        "error loading default CA certificate locations");
+      X509_STORE_free(store);
+
+      errno = EINVAL;
+      return NULL;
+    }
+  }
+
+  return store;
+}
+
+static int tls_load_cert(struct urlconf_tls_ctx *ctx) {
+  BIO *bio;
+  X509 *cert;
+  STACK_OF(X509) *chain = NULL;
+
+  bio = BIO_new_mem_buf((void *) ctx->cert_data, (int) ctx->cert_datalen);
+  if (bio == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+  if (cert == NULL) {
+    pr_trace_msg(trace_channel, 3,
+      "error reading client certificate from '%s'", ctx->cert_file);
+    BIO_free(bio);
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  /* Any further certificates in the file are the chain. */
+  while (TRUE) {
+    X509 *chain_cert;
+
+    chain_cert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    if (chain_cert == NULL) {
+      break;
+    }
+
+    if (chain == NULL) {
+      chain = sk_X509_new_null();
+    }
+
+    if (chain == NULL ||
+        sk_X509_push(chain, chain_cert) == 0) {
+      X509_free(chain_cert);
+      break;
+    }
+  }
+
+  BIO_free(bio);
+
+  ctx->cert = cert;
+  ctx->cert_chain = chain;
+  return 0;
+}
+
+static int tls_load_key(struct urlconf_tls_ctx *ctx) {
+  BIO *bio;
+  EVP_PKEY *key;
+
+  bio = BIO_new_mem_buf((void *) ctx->key_data, (int) ctx->key_datalen);
+  if (bio == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  key = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+  BIO_free(bio);
+
+  if (key == NULL) {
+    pr_trace_msg(trace_channel, 3,
+      "error reading client key from '%s' (note that passphrase-protected "
+      "keys are not supported)", ctx->key_file);
+    errno = EINVAL;
+    return -1;
+  }
+
+  ctx->key = key;
+  return 0;
+}
+#endif /* PR_USE_OPENSSL */
+
+struct urlconf_tls_ctx *urlconf_tls_get_ctx(const char *ca_file,
+    const char *ca_path, const char *cert_file, const char *key_file) {
+  struct urlconf_tls_ctx *ctx;
+  const char *key;
+
+  if (tls_parent_pool == NULL) {
+    errno = EPERM;
+    return NULL;
+  }
+
+  if (tls_pool == NULL) {
+    tls_pool = make_sub_pool(tls_parent_pool);
+    pr_pool_tag(tls_pool, MOD_CONF_URL_VERSION ": TLS Pool");
+
+    tls_ctxs = pr_table_alloc(tls_pool, 0);
+  }
+
+  if (ca_file == NULL &&
+      ca_path == NULL) {
+    ca_file = tls_default_ca_file;
+  }
+
+  /* The key file defaults to the certificate file, for the case where both
+   * are in the same file.
+   */
+  if (cert_file != NULL &&
+      key_file == NULL) {
+    key_file = cert_file;
+  }
+
+  key = pstrcat(tls_pool, ca_file ? ca_file : "", "|",
+    ca_path ? ca_path : "", "|", cert_file ? cert_file : "", "|",
+    key_file ? key_file : "", NULL);
+
+  ctx = (struct urlconf_tls_ctx *) pr_table_get(tls_ctxs, key, NULL);
+  if (ctx != NULL) {
+    return ctx;
+  }
+
+  ctx = pcalloc(tls_pool, sizeof(struct urlconf_tls_ctx));
+  ctx->ca_file = ca_file ? pstrdup(tls_pool, ca_file) : NULL;
+  ctx->ca_path = ca_path ? pstrdup(tls_pool, ca_path) : NULL;
+  ctx->cert_file = cert_file ? pstrdup(tls_pool, cert_file) : NULL;
+  ctx->key_file = key_file ? pstrdup(tls_pool, key_file) : NULL;
+
+  /* Without its client certificate, a fetch would be made as some other
+   * client, or as none; thus failing to load it fails the fetch, and the
+   * next fetch using it tries again.
+   */
+  if (ctx->cert_file != NULL) {
+    int xerrno;
+
+    ctx->cert_data = tls_read_file(tls_pool, ctx->cert_file,
+      &(ctx->cert_datalen));
+    if (ctx->cert_data == NULL) {
+      xerrno = errno;
+
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": error reading client certificate '%s': %s", ctx->cert_file,
+        strerror(xerrno));
+
+      errno = xerrno;
+      return NULL;
+    }
+
+    ctx->key_data = tls_read_file(tls_pool, ctx->key_file,
+      &(ctx->key_datalen));
+    if (ctx->key_data == NULL) {
+      xerrno = errno;
+
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": error reading client key '%s': %s", ctx->key_file,
+        strerror(xerrno));
+
+      errno = xerrno;
+      return NULL;
+    }
+
+#if defined(PR_USE_OPENSSL)
+    if (tls_load_cert(ctx) < 0) {
+      xerrno = errno;
+
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": error loading client certificate '%s'", ctx->cert_file);
+
+      errno = xerrno;
+      return NULL;
+    }
+
+    if (tls_load_key(ctx) < 0) {
+      xerrno = errno;
+
+      pr_log_debug(DEBUG0, MOD_CONF_URL_VERSION
+        ": error loading client key '%s'", ctx->key_file);
+
+      X509_free(ctx->cert);
+      if (ctx->cert_chain != NULL) {
+        sk_X509_pop_free(ctx->cert_chain, X509_free);
+      }
+
+      errno = xerrno;
+      return NULL;
+    }
+
+    pr_trace_msg(trace_channel, 15, "loaded client certificate '%s', key '%s'",
+      ctx->cert_file, ctx->key_file);
+#endif /* PR_USE_OPENSSL */
+  }
+
+#if defined(PR_USE_OPENSSL)
+  ctx->ca_store = tls_load_ca_store(ctx->ca_file, ctx->ca_path);
+#endif /* PR_USE_OPENSSL */
+
+  if (ctx->ca_file != NULL) {
+    ctx->ca_data = tls_read_file(tls_pool, ctx->ca_file, &(ctx->ca_datalen));
+    if (ctx->ca_data == NULL) {
+      pr_trace_msg(trace_channel, 3, "error reading CA file '%s': %s",
+        ctx->ca_file, strerror(errno));
+    }
+  }
+
+  pr_trace_msg(trace_channel, 15,
+    "loaded CA certificates from file '%s', path '%s'",
+    ctx->ca_file ? ctx->ca_file : "(default)",
+    ctx->ca_path ? ctx->ca_path : "(default)");
+
+  (void) pr_table_add(tls_ctxs, key, ctx, sizeof(struct urlconf_tls_ctx));
+  return ctx;
+}
+
+int urlconf_tls_setup_ssl_ctx(void *ssl_ctx, struct urlconf_tls_ctx *ctx) {
+  if (ssl_ctx == NULL ||
+      ctx == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+#if defined(PR_USE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10100000L
+  if (ctx->ca_store != NULL) {
+    /* SSL_CTX_set_cert_store() takes ownership of the store, thus we need
+     * our own reference.
+     */
+    X509_STORE_up_ref(ctx->ca_store);
+    SSL_CTX_set_cert_store(ssl_ctx, ctx->ca_store);
+  }
+
+  if (ctx->cert != NULL &&
+      ctx->key != NULL) {
+    if (SSL_CTX_use_certificate(ssl_ctx, ctx->cert) != 1) {
+      pr_trace_msg(trace_channel, 3, "error using client certificate '%s'",
+        ctx->cert_file);
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (ctx->cert_chain != NULL) {
+      register int i;
+      STACK_OF(X509) *chain;
+
+      chain = ctx->cert_chain;
+      for (i = 0; i < sk_X509_num(chain); i++) {
+        (void) SSL_CTX_add1_chain_cert(ssl_ctx, sk_X509_value(chain, i));
+      }
+    }
+
+    if (SSL_CTX_use_PrivateKey(ssl_ctx, ctx->key) != 1 ||
+        SSL_CTX_check_private_key(ssl_ctx) != 1) {
+      pr_trace_msg(trace_channel, 3, "error using client key '%s'",
+        ctx->key_file);
+      errno = EINVAL;
+      return -1;
+    }
+  }
+
+  return 0;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif /* PR_USE_OPENSSL */
+}
+
+int urlconf_tls_clear(void) {
+#if defined(PR_USE_OPENSSL)
+  if (tls_ctxs != NULL) {
+    const void *key;
+
+    pr_table_rewind(tls_ctxs);
+    key = pr_table_next(tls_ctxs);
+    while (key != NULL) {
+      struct urlconf_tls_ctx *ctx;
+
+      ctx = (struct urlconf_tls_ctx *) pr_table_get(tls_ctxs, key, NULL);
+      if (ctx != NULL) {
+        if (ctx->ca_store != NULL) {
+          X509_STORE_free(ctx->ca_store);
+          ctx->ca_store = NULL;
+        }
+
+        if (ctx->cert != NULL) {
+          X509_free(ctx->cert);
+          ctx->cert = NULL;
+        }
+
+        if (ctx->cert_chain != NULL) {
+          sk_X509_pop_free(ctx->cert_chain, X509_free);
+          ctx->cert_chain = NULL;
+        }
+
+        if (ctx->key != NULL) {
+          EVP_PKEY_free(ctx->key);
+          ctx->key = NULL;
+        }
+      }
+
+      key = pr_table_next(tls_ctxs);
+    }
+  }
+#endif /* PR_USE_OPENSSL */
+
+  if (tls_pool != NULL) {
+    destroy_pool(tls_pool);
+    tls_pool = NULL;
+    tls_ctxs = NULL;
+  }
+
+  return 0;
+}
+
+int urlconf_tls_is_compatible(const char *ssl_version) {
+#if defined(PR_USE_OPENSSL)
+  const char *our_version;
+  char curl_name[64], our_name[64];
+  unsigned int curl_major = 0, curl_minor = 0, our_major = 0, our_minor = 0;
+
+  if (ssl_version == NULL) {
+    return FALSE;
+  }
+
+# if OPENSSL_VERSION_NUMBER >= 0x10100000L
+  our_version = OpenSSL_version(OPENSSL_VERSION);
+# else
+  our_version = SSLeay_version(SSLEAY_VERSION);
+# endif /* OpenSSL-1.1.0 and later */
+
+  /* libcurl reports its backend as e.g. "OpenSSL/3.0.2", listing any other
+   * backends which it is not using in parentheses; OpenSSL reports itself
+   * as e.g. "OpenSSL 3.0.2 15 Mar 2022".  Derivatives which report no
+   * version (e.g. BoringSSL), or report a different name (e.g. quictls),
+   * are not considered compatible.
+   */
+  if (sscanf(ssl_version, "%63[^/ (]/%u.%u", curl_name, &curl_major,
+        &curl_minor) != 3 ||
+      sscanf(our_version, "%63[^ ] %u.%u", our_name, &our_major,
+        &our_minor) != 3) {
+    return FALSE;
+  }
+
+  if (strcmp(curl_name, our_name) != 0 ||
+      curl_major != our_major ||
+      curl_minor != our_minor) {
+    pr_trace_msg(trace_channel, 9, "libcurl TLS library '%s' differs from "
+      "ProFTPD TLS library '%s'", ssl_version, our_version);
+    return FALSE;
+  }
+
+  return TRUE;
+#else
+  return FALSE;
+#endif /* PR_USE_OPENSSL */
+}
+
+int urlconf_tls_init(pool *p, const char *default_ca_file) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  tls_parent_pool = p;
+  if (default_ca_file != NULL) {
+    tls_default_ca_file = pstrdup(p, default_ca_file);
+  }
+
+  return 0;
+}
+
+int urlconf_tls_free(void) {
+  (void) urlconf_tls_clear();
+  tls_parent_pool = NULL;
+  tls_default_ca_file = NULL;
+
+  return 0;
+}
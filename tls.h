@@ -0,0 +1,84 @@
+/*
+ * ProFTPD - mod_conf_url TLS
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_TLS_H
+#define MOD_CONF_URL_TLS_H
+
+/* The TLS material shared by all handles using the same settings.  The
+ * ca_store field is an OpenSSL X509_STORE, the cert field an OpenSSL X509
+ * (with any chain certificates in cert_chain), and the key field an OpenSSL
+ * EVP_PKEY, if available.  The *_data fields hold the raw contents of those
+ * files, for libcurl TLS backends which cannot use the parsed objects.
+ */
+struct urlconf_tls_ctx {
+  const char *ca_file;
+  const char *ca_path;
+  const char *cert_file;
+  const char *key_file;
+
+  void *ca_store;
+  void *cert;
+  void *cert_chain;
+  void *key;
+
+  const char *ca_data;
+  size_t ca_datalen;
+  const char *cert_data;
+  size_t cert_datalen;
+  const char *key_data;
+  size_t key_datalen;
+};
+
+/* Returns the shared TLS material for the given CA file/path (either of
+ * which may be NULL, for the defaults), and client certificate/key files
+ * (which may be NULL, for none), loading it on first use.  Returns NULL,
+ * with errno set, if the client certificate or key cannot be loaded.
+ */
+struct urlconf_tls_ctx *urlconf_tls_get_ctx(const char *ca_file,
+  const char *ca_path, const char *cert_file, const char *key_file);
+
+/* Installs the shared TLS material into the given OpenSSL SSL_CTX. */
+int urlconf_tls_setup_ssl_ctx(void *ssl_ctx, struct urlconf_tls_ctx *ctx);
+
+/* Returns TRUE if the given libcurl TLS backend (as reported in its
+ * ssl_version, e.g. "OpenSSL/3.0.2") is the same library, of the same major
+ * and minor version, as the OpenSSL used by ProFTPD, and thus can be given
+ * our OpenSSL objects; FALSE otherwise.
+ */
+int urlconf_tls_is_compatible(const char *ssl_version);
+
+/* Discards all loaded TLS material, e.g. so that a restart picks up
+ * changes to the CA files.
+ */
+int urlconf_tls_clear(void);
+
+/* API lifetime functions, for mod_conf_url use only.  The default CA file
+ * is the one configured into libcurl, if known.
+ */
+int urlconf_tls_init(pool *p, const char *default_ca_file);
+int urlconf_tls_free(void);
+
+#endif /* MOD_CONF_URL_TLS_H */
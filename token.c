@@ -0,0 +1,392 @@
+/*
+ * ProFTPD - mod_conf_url bearer tokens
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "http.h"
+#include "token.h"
+
+/* Timeouts for token requests, in secs. */
+#define TOKEN_CONNECT_TIMEOUT		3UL
+#define TOKEN_REQUEST_TIMEOUT		10UL
+
+/* The lifetime assumed for tokens without an "expires_in", and how long
+ * before their expiry to stop using tokens, in secs.
+ */
+#define TOKEN_DEFAULT_LIFETIME		300
+#define TOKEN_EXPIRY_MARGIN		30
+
+/* The largest token response we accept. */
+#define TOKEN_MAX_RESPONSE_LEN		65536
+
+static const char *trace_channel = "conf_url";
+
+static pool *token_parent_pool = NULL;
+
+/* The current endpoint, and its token (with its expiry), kept in its own
+ * pool.
+ */
+static pool *token_pool = NULL;
+static const char *token_key = NULL;
+static const char *token_url = NULL;
+static const char *token_credentials_path = NULL;
+static const char *token_scope = NULL;
+static unsigned long token_flags = 0UL;
+
+static const char *token = NULL;
+static time_t token_expires = 0;
+
+struct token_resp {
+  pool *pool;
+  char *buf;
+  size_t buflen;
+};
+
+static size_t token_resp_cb(char *buf, size_t itemsz, size_t item_count,
+    void *user_data) {
+  struct token_resp *resp;
+  size_t datasz;
+  char *ptr;
+
+  resp = user_data;
+  datasz = itemsz * item_count;
+
+  if (resp->buflen + datasz > TOKEN_MAX_RESPONSE_LEN) {
+    pr_trace_msg(trace_channel, 3, "token response exceeds %lu bytes",
+      (unsigned long) TOKEN_MAX_RESPONSE_LEN);
+    return 0;
+  }
+
+  ptr = palloc(resp->pool, resp->buflen + datasz + 1);
+  if (resp->buflen > 0) {
+    memcpy(ptr, resp->buf, resp->buflen);
+  }
+  memcpy(ptr + resp->buflen, buf, datasz);
+  resp->buflen += datasz;
+  ptr[resp->buflen] = '\0';
+  resp->buf = ptr;
+
+  return datasz;
+}
+
+/* Reads the "client_id:client_secret" client credentials. */
+static int token_read_credentials(pool *p, const char *path,
+    const char **client_id, const char **client_secret) {
+  FILE *fh;
+  char line[1024], *ptr;
+  size_t linelen;
+
+  fh = fopen(path, "r");
+  if (fh == NULL) {
+    int xerrno = errno;
+
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": unable to read token credentials '%s': %s", path, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  memset(line, '\0', sizeof(line));
+  if (fgets(line, sizeof(line), fh) == NULL) {
+    fclose(fh);
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  fclose(fh);
+
+  linelen = strlen(line);
+  while (linelen > 0 &&
+         (line[linelen-1] == '\n' || line[linelen-1] == '\r')) {
+    line[--linelen] = '\0';
+  }
+
+  ptr = strchr(line, ':');
+  if (ptr == NULL ||
+      ptr == line) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": token credentials '%s' are not 'client_id:client_secret'", path);
+    pr_memscrub(line, sizeof(line));
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  *client_id = pstrndup(p, line, ptr - line);
+  *client_secret = pstrdup(p, ptr + 1);
+  pr_memscrub(line, sizeof(line));
+
+  return 0;
+}
+
+static int token_fetch(pool *p) {
+  int res, xerrno;
+  void *http;
+  long resp_code = 0L;
+  const char *client_id = NULL, *client_secret = NULL, *form;
+  char *access_token = NULL, *token_type = NULL;
+  double expires_in = TOKEN_DEFAULT_LIFETIME;
+  pr_table_t *headers;
+  pr_json_object_t *json;
+  struct token_resp *resp;
+
+  if (token_credentials_path != NULL &&
+      token_read_credentials(p, token_credentials_path, &client_id,
+        &client_secret) < 0) {
+    return -1;
+  }
+
+  http = urlconf_http_alloc(p, TOKEN_CONNECT_TIMEOUT, TOKEN_REQUEST_TIMEOUT,
+    token_flags);
+  if (http == NULL) {
+    return -1;
+  }
+
+  if (client_id != NULL) {
+    (void) urlconf_http_set_credentials(http, client_id, client_secret);
+  }
+
+  headers = pr_table_nalloc(p, 0, 2);
+  (void) pr_table_add(headers, pstrdup(p, URLCONF_HTTP_HEADER_ACCEPT),
+    "application/json", 0);
+  (void) pr_table_add(headers, pstrdup(p, URLCONF_HTTP_HEADER_CONTENT_TYPE),
+    URLCONF_HTTP_CONTENT_TYPE_FORM, 0);
+  (void) pr_table_add(headers, pstrdup(p, URLCONF_HTTP_HEADER_USER_AGENT),
+    "proftpd+" MOD_CONF_URL_VERSION, 0);
+
+  form = "grant_type=client_credentials";
+  if (token_scope != NULL) {
+    form = pstrcat(p, form, "&scope=", token_scope, NULL);
+  }
+
+  resp = pcalloc(p, sizeof(struct token_resp));
+  resp->pool = p;
+
+  pr_trace_msg(trace_channel, 9, "requesting token from '%s'", token_url);
+  res = urlconf_http_post(p, http, token_url, headers, form, strlen(form),
+    token_resp_cb, resp, &resp_code);
+  xerrno = errno;
+
+  (void) urlconf_http_set_credentials(http, NULL, NULL);
+  (void) urlconf_http_destroy(p, http);
+
+  if (res < 0) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": error requesting token from '%s': %s", token_url, strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  if (resp_code != URLCONF_HTTP_RESPONSE_CODE_OK) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": received %ld response code requesting token from '%s'", resp_code,
+      token_url);
+
+    errno = (resp_code == URLCONF_HTTP_RESPONSE_CODE_BAD_REQUEST ||
+             resp_code == URLCONF_HTTP_RESPONSE_CODE_UNAUTHORIZED) ?
+      EACCES : EPERM;
+    return -1;
+  }
+
+  json = pr_json_object_from_text(p, resp->buf != NULL ? resp->buf : "");
+  if (json == NULL) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": invalid token response from '%s'", token_url);
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  res = pr_json_object_get_string(p, json, "access_token", &access_token);
+  if (res < 0 ||
+      *access_token == '\0') {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": token response from '%s' lacks access_token", token_url);
+    (void) pr_json_object_free(json);
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (pr_json_object_get_string(p, json, "token_type", &token_type) == 0 &&
+      strcasecmp(token_type, "bearer") != 0) {
+    pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+      ": unsupported token type '%s' from '%s'", token_type, token_url);
+    (void) pr_json_object_free(json);
+
+    errno = EINVAL;
+    return -1;
+  }
+
+  (void) pr_json_object_get_number(p, json, "expires_in", &expires_in);
+  (void) pr_json_object_free(json);
+
+  if (expires_in > TOKEN_EXPIRY_MARGIN * 2) {
+    expires_in -= TOKEN_EXPIRY_MARGIN;
+
+  } else {
+    expires_in /= 2;
+  }
+
+  token = pstrdup(token_pool, access_token);
+  token_expires = time(NULL) + (time_t) expires_in;
+
+  pr_trace_msg(trace_channel, 9, "obtained token from '%s', for %lu secs",
+    token_url, (unsigned long) expires_in);
+  return 0;
+}
+
+int urlconf_token_set_endpoint(const char *url, const char *credentials_path,
+    const char *scope, unsigned long flags) {
+  pool *tmp_pool;
+  const char *key;
+
+  if (token_parent_pool == NULL) {
+    errno = EPERM;
+    return -1;
+  }
+
+  if (url == NULL) {
+    /* Keep the token, should the next parse use the same endpoint. */
+    token_url = NULL;
+    return 0;
+  }
+
+  tmp_pool = make_sub_pool(token_parent_pool);
+  key = pstrcat(tmp_pool, url, "|", credentials_path ? credentials_path : "",
+    "|", scope ? scope : "", NULL);
+
+  /* A different endpoint, or client, needs a different token. */
+  if (token_key == NULL ||
+      strcmp(key, token_key) != 0) {
+    destroy_pool(token_pool);
+    token_pool = make_sub_pool(token_parent_pool);
+    pr_pool_tag(token_pool, "URL Configuration Token Pool");
+
+    token_key = pstrdup(token_pool, key);
+    token = NULL;
+    token_expires = 0;
+  }
+
+  destroy_pool(tmp_pool);
+
+  token_url = pstrdup(token_pool, url);
+  token_credentials_path = credentials_path != NULL ?
+    pstrdup(token_pool, credentials_path) : NULL;
+  token_scope = scope != NULL ? pstrdup(token_pool, scope) : NULL;
+  token_flags = flags;
+
+  return 0;
+}
+
+const char *urlconf_token_get(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if (token_url == NULL) {
+    errno = ENOENT;
+    return NULL;
+  }
+
+  if (token != NULL &&
+      time(NULL) < token_expires) {
+    return token;
+  }
+
+  token = NULL;
+  if (token_fetch(p) < 0) {
+    return NULL;
+  }
+
+  return token;
+}
+
+int urlconf_token_add_header(pool *p, pr_table_t *headers) {
+  const char *bearer_token;
+
+  if (p == NULL ||
+      headers == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  bearer_token = urlconf_token_get(p);
+  if (bearer_token == NULL) {
+    int xerrno = errno;
+
+    pr_trace_msg(trace_channel, 3, "unable to obtain token: %s",
+      strerror(xerrno));
+
+    errno = xerrno;
+    return -1;
+  }
+
+  return pr_table_add(headers, pstrdup(p, URLCONF_HTTP_HEADER_AUTHORIZATION),
+    pstrcat(p, "Bearer ", bearer_token, NULL), 0);
+}
+
+int urlconf_token_expire(void) {
+  if (token != NULL) {
+    pr_trace_msg(trace_channel, 9, "discarding token from '%s'",
+      token_url != NULL ? token_url : "(none)");
+  }
+
+  token = NULL;
+  token_expires = 0;
+  return 0;
+}
+
+int urlconf_token_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  token_parent_pool = p;
+  token_pool = make_sub_pool(p);
+  pr_pool_tag(token_pool, "URL Configuration Token Pool");
+
+  token_key = token_url = NULL;
+  token = NULL;
+  token_expires = 0;
+  return 0;
+}
+
+int urlconf_token_free(void) {
+  if (token_pool != NULL) {
+    destroy_pool(token_pool);
+    token_pool = NULL;
+  }
+
+  token_parent_pool = NULL;
+  token_key = token_url = token_credentials_path = token_scope = NULL;
+  token = NULL;
+  token_expires = 0;
+  return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * ProFTPD - mod_conf_url bearer tokens
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_TOKEN_H
+#define MOD_CONF_URL_TOKEN_H
+
+/* Sets the OAuth 2.0 token endpoint from which to obtain bearer tokens,
+ * using the client credentials grant, for the configuration parse and the
+ * watcher of its URLs; NULL to stop using tokens.  The credentials file, if
+ * any, holds "client_id:client_secret", which are sent using HTTP Basic
+ * authentication.  The scope, if any, is sent as is.  The flags are the
+ * libcurl handle flags to use.
+ */
+int urlconf_token_set_endpoint(const char *url, const char *credentials_path,
+  const char *scope, unsigned long flags);
+
+/* Returns the current bearer token, obtaining a new token if there is none,
+ * or it has expired.  Tokens are kept across configuration parses, for as
+ * long as the same endpoint is used.
+ */
+const char *urlconf_token_get(pool *p);
+
+/* Adds the current bearer token, as an Authorization header, to the given
+ * request headers.
+ */
+int urlconf_token_add_header(pool *p, pr_table_t *headers);
+
+/* Discards the current token, e.g. once the server has rejected it. */
+int urlconf_token_expire(void);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_token_init(pool *p);
+int urlconf_token_free(void);
+
+#endif /* MOD_CONF_URL_TOKEN_H */
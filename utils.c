@@ -58,3 +58,37 @@ array_header *urlconf_utils_table2array(pool *p, pr_table_t *tab) {
 
   return list;
 }
+
+const char *urlconf_utils_hash_key(pool *p, const char *text) {
+  if (p == NULL ||
+      text == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  return urlconf_utils_hash_data(p, text, strlen(text));
+}
+
+const char *urlconf_utils_hash_data(pool *p, const char *text,
+    size_t text_len) {
+  register unsigned int i;
+  unsigned long long hash = 0xcbf29ce484222325ULL;
+  char *key;
+
+  if (p == NULL ||
+      (text == NULL && text_len > 0)) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  /* FNV-1a, 64-bit. */
+  for (i = 0; i < text_len; i++) {
+    hash ^= (unsigned char) text[i];
+    hash *= 0x100000001b3ULL;
+  }
+
+  key = pcalloc(p, 17);
+  snprintf(key, 17, "%016llx", hash);
+
+  return key;
+}
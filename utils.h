@@ -32,4 +32,16 @@
  */
 array_header *urlconf_utils_table2array(pool *p, pr_table_t *tab);
 
+/* Returns a hex-encoded, fixed-length (16 characters) hash of the given
+ * text, suitable for use as e.g. a cache file name.  Note that this is NOT a
+ * cryptographic hash.
+ */
+const char *urlconf_utils_hash_key(pool *p, const char *text);
+
+/* As urlconf_utils_hash_key(), for data which may contain NULs, e.g. for
+ * detecting changes in response bodies.
+ */
+const char *urlconf_utils_hash_data(pool *p, const char *text,
+  size_t text_len);
+
 #endif /* MOD_CONF_URL_UTILS_H */
@@ -0,0 +1,715 @@
+/*
+ * ProFTPD - mod_conf_url change watching
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+#include "watch.h"
+#include "http.h"
+#include "token.h"
+#include "utils.h"
+
+struct watch_url {
+  const char *url;
+  int type;
+  unsigned long flags;
+  int use_token;
+
+  /* The TLS settings for the URL, if any. */
+  const char *ssl_ca_file;
+  const char *ssl_ca_path;
+  const char *ssl_cert;
+  const char *ssl_key;
+
+  /* The index from the most recent response, the validators (for polled
+   * URLs), and the hash of the body used by the current configuration.
+   */
+  unsigned long long index;
+  const char *etag;
+  const char *last_modified;
+  const char *hash;
+};
+
+/* Collects a response body, for comparison with the current one. */
+struct watch_body {
+  pool *pool;
+  char *buf;
+  size_t buflen, bufsz;
+};
+
+static pool *watch_parent_pool = NULL;
+static pool *watch_pool = NULL;
+static array_header *watch_urls = NULL;
+
+/* Number of seconds between polls of the polled URLs; zero to not poll. */
+static unsigned long watch_interval = 0;
+
+/* The watcher process, and the daemon process which started it. */
+static pid_t watch_pid = 0;
+static pid_t watch_master_pid = 0;
+
+static const char *trace_channel = "conf_url";
+
+int urlconf_watch_get_type(const char *name) {
+  if (name == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (strcasecmp(name, "consul") == 0) {
+    return URLCONF_WATCH_TYPE_CONSUL;
+  }
+
+  if (strcasecmp(name, "etcd") == 0) {
+    return URLCONF_WATCH_TYPE_ETCD;
+  }
+
+  errno = ENOENT;
+  return -1;
+}
+
+const char *urlconf_watch_get_index_header(int type) {
+  switch (type) {
+    case URLCONF_WATCH_TYPE_CONSUL:
+      return "x-consul-index";
+
+    case URLCONF_WATCH_TYPE_ETCD:
+      return "x-etcd-index";
+
+    default:
+      break;
+  }
+
+  errno = EINVAL;
+  return NULL;
+}
+
+int urlconf_watch_set_interval(unsigned long interval) {
+  watch_interval = interval;
+  return 0;
+}
+
+int urlconf_watch_add(const char *url, int type, unsigned long flags,
+    const char *ssl_ca_file, const char *ssl_ca_path, const char *ssl_cert,
+    const char *ssl_key, int use_token, pr_table_t *resp_headers,
+    const char *hash) {
+  struct watch_url *watch;
+
+  if (url == NULL ||
+      hash == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (watch_pool == NULL) {
+    watch_pool = make_sub_pool(watch_parent_pool);
+    pr_pool_tag(watch_pool, MOD_CONF_URL_VERSION ": Watch Pool");
+
+    watch_urls = make_array(watch_pool, 0, sizeof(struct watch_url *));
+  }
+
+  watch = pcalloc(watch_pool, sizeof(struct watch_url));
+  watch->url = pstrdup(watch_pool, url);
+  watch->type = type;
+  watch->flags = flags;
+  watch->ssl_ca_file = ssl_ca_file ? pstrdup(watch_pool, ssl_ca_file) : NULL;
+  watch->ssl_ca_path = ssl_ca_path ? pstrdup(watch_pool, ssl_ca_path) : NULL;
+  watch->ssl_cert = ssl_cert ? pstrdup(watch_pool, ssl_cert) : NULL;
+  watch->ssl_key = ssl_key ? pstrdup(watch_pool, ssl_key) : NULL;
+  watch->use_token = use_token;
+  watch->hash = pstrdup(watch_pool, hash);
+
+  if (resp_headers != NULL) {
+    const char *v;
+
+    if (type == URLCONF_WATCH_TYPE_POLL) {
+      v = pr_table_get(resp_headers, "etag", NULL);
+      if (v != NULL) {
+        watch->etag = pstrdup(watch_pool, v);
+      }
+
+      v = pr_table_get(resp_headers, "last-modified", NULL);
+      if (v != NULL) {
+        watch->last_modified = pstrdup(watch_pool, v);
+      }
+
+    } else {
+      v = pr_table_get(resp_headers, urlconf_watch_get_index_header(type),
+        NULL);
+      if (v != NULL) {
+        watch->index = strtoull(v, NULL, 10);
+      }
+    }
+  }
+
+  *((struct watch_url **) push_array(watch_urls)) = watch;
+
+  pr_trace_msg(trace_channel, 9, "watching '%s' for changes (index %llu, "
+    "ETag %s, Last-Modified %s)", url, watch->index,
+    watch->etag ? watch->etag : "none",
+    watch->last_modified ? watch->last_modified : "none");
+  return 0;
+}
+
+static size_t watch_body_cb(char *buf, size_t itemsz, size_t item_count,
+    void *user_data) {
+  struct watch_body *body;
+  size_t buflen;
+
+  body = user_data;
+  buflen = itemsz * item_count;
+
+  if (body == NULL) {
+    /* Discard the body. */
+    return buflen;
+  }
+
+  if (body->buflen + buflen > body->bufsz) {
+    char *ptr;
+    size_t bufsz;
+
+    bufsz = body->bufsz > 0 ? body->bufsz : 8192;
+    while (bufsz < body->buflen + buflen) {
+      bufsz *= 2;
+    }
+
+    ptr = palloc(body->pool, bufsz);
+    if (body->buflen > 0) {
+      memcpy(ptr, body->buf, body->buflen);
+    }
+
+    body->buf = ptr;
+    body->bufsz = bufsz;
+  }
+
+  memcpy(body->buf + body->buflen, buf, buflen);
+  body->buflen += buflen;
+
+  return buflen;
+}
+
+/* Returns a request for the given watched URL, using its settings. */
+static struct urlconf_http_req *watch_req(pool *p, struct watch_url *watch) {
+  struct urlconf_http_req *req;
+
+  req = pcalloc(p, sizeof(struct urlconf_http_req));
+  req->url = watch->url;
+  req->resp_body = watch_body_cb;
+  req->flags = watch->flags;
+  req->ssl_ca_file = watch->ssl_ca_file;
+  req->ssl_ca_path = watch->ssl_ca_path;
+  req->ssl_cert = watch->ssl_cert;
+  req->ssl_key = watch->ssl_key;
+
+  return req;
+}
+
+/* Returns the number of seconds for which blocking queries wait. */
+static unsigned long watch_get_wait(void) {
+  if (watch_interval > 0 &&
+      watch_interval < URLCONF_WATCH_DEFAULT_WAIT) {
+    return watch_interval;
+  }
+
+  return URLCONF_WATCH_DEFAULT_WAIT;
+}
+
+/* Returns the URL for a blocking query, which returns once the content
+ * changes from that of the given index (or the wait time elapses).
+ */
+static const char *watch_query_url(pool *p, struct watch_url *watch) {
+  char index_text[32], wait_text[32];
+  const char *sep;
+
+  sep = strchr(watch->url, '?') != NULL ? "&" : "?";
+
+  memset(index_text, '\0', sizeof(index_text));
+  memset(wait_text, '\0', sizeof(wait_text));
+
+  switch (watch->type) {
+    case URLCONF_WATCH_TYPE_CONSUL:
+      snprintf(index_text, sizeof(index_text)-1, "%llu", watch->index);
+      snprintf(wait_text, sizeof(wait_text)-1, "%lus", watch_get_wait());
+      return pstrcat(p, watch->url, sep, "index=", index_text, "&wait=",
+        wait_text, NULL);
+
+    case URLCONF_WATCH_TYPE_ETCD:
+      if (watch->index == 0) {
+        return pstrcat(p, watch->url, sep, "wait=true", NULL);
+      }
+
+      /* Wait for the first change after the index we have seen. */
+      snprintf(index_text, sizeof(index_text)-1, "%llu", watch->index + 1);
+      return pstrcat(p, watch->url, sep, "wait=true&waitIndex=", index_text,
+        NULL);
+
+    default:
+      break;
+  }
+
+  return watch->url;
+}
+
+static int watch_resp_ok(long resp_code) {
+  switch (resp_code) {
+    case URLCONF_FILE_RESPONSE_CODE_OK:
+    case URLCONF_FTP_RESPONSE_CODE_OK:
+    case URLCONF_HTTP_RESPONSE_CODE_OK:
+      return TRUE;
+
+    default:
+      break;
+  }
+
+  return FALSE;
+}
+
+/* Adds the bearer token, if used, to the headers of the request for the
+ * given watched URL.
+ */
+static void watch_add_token(pool *p, struct watch_url *watch,
+    struct urlconf_http_req *req) {
+  if (watch->use_token == FALSE) {
+    return;
+  }
+
+  if (req->headers == NULL) {
+    req->headers = pr_table_alloc(p, 0);
+  }
+
+  /* Without a token, the request fails as unauthorized, and is retried. */
+  (void) urlconf_token_add_header(p, req->headers);
+}
+
+/* Checks whether the server rejected the token of the request for the given
+ * watched URL; if so, a new token is obtained for the next attempt.
+ */
+static void watch_check_token(struct watch_url *watch,
+    struct urlconf_http_req *req) {
+  if (watch->use_token == TRUE &&
+      req->xerrno == 0 &&
+      req->resp_code == URLCONF_HTTP_RESPONSE_CODE_UNAUTHORIZED) {
+    pr_trace_msg(trace_channel, 9,
+      "token rejected for '%s', obtaining a new token", watch->url);
+    (void) urlconf_token_expire();
+  }
+}
+
+/* Fetches the given URLs, and compares their content with that used by the
+ * current configuration.  If conditional is TRUE, the requests are
+ * conditional on the validators of the current content, if known.  Returns
+ * TRUE if any content changed, FALSE if not, or -1 if any requests failed.
+ */
+static int watch_compare(pool *p, array_header *watches, int conditional) {
+  register unsigned int i;
+  array_header *reqs;
+  struct watch_url **elts;
+  int failed = FALSE;
+
+  reqs = make_array(p, 0, sizeof(struct urlconf_http_req *));
+  elts = watches->elts;
+
+  for (i = 0; i < watches->nelts; i++) {
+    struct urlconf_http_req *req;
+    struct watch_body *body;
+
+    body = pcalloc(p, sizeof(struct watch_body));
+    body->pool = p;
+
+    req = watch_req(p, elts[i]);
+    req->user_data = body;
+
+    if (conditional == TRUE &&
+        (elts[i]->etag != NULL || elts[i]->last_modified != NULL)) {
+      req->headers = pr_table_alloc(p, 0);
+
+      if (elts[i]->etag != NULL) {
+        (void) pr_table_add(req->headers, URLCONF_HTTP_HEADER_IF_NONE_MATCH,
+          elts[i]->etag, 0);
+      }
+
+      if (elts[i]->last_modified != NULL) {
+        (void) pr_table_add(req->headers,
+          URLCONF_HTTP_HEADER_IF_MODIFIED_SINCE, elts[i]->last_modified, 0);
+      }
+    }
+
+    watch_add_token(p, elts[i], req);
+    *((struct urlconf_http_req **) push_array(reqs)) = req;
+  }
+
+  if (urlconf_http_get_many(p, reqs, urlconf_http_default_headers(p),
+      URLCONF_WATCH_RETRY_INTERVAL, URLCONF_WATCH_DEFAULT_WAIT, 0) < 0) {
+    return -1;
+  }
+
+  for (i = 0; i < reqs->nelts; i++) {
+    struct urlconf_http_req *req;
+    struct watch_body *body;
+    const char *hash;
+
+    req = ((struct urlconf_http_req **) reqs->elts)[i];
+    watch_check_token(elts[i], req);
+
+    if (req->xerrno == 0 &&
+        req->resp_code == URLCONF_HTTP_RESPONSE_CODE_NOT_MODIFIED) {
+      pr_trace_msg(trace_channel, 15, "'%s' not modified", elts[i]->url);
+      continue;
+    }
+
+    if (req->xerrno != 0 ||
+        watch_resp_ok(req->resp_code) == FALSE) {
+      pr_trace_msg(trace_channel, 3,
+        "error checking '%s' for changes: %s (response code %ld)",
+        elts[i]->url, strerror(req->xerrno), req->resp_code);
+      failed = TRUE;
+      continue;
+    }
+
+    body = req->user_data;
+    hash = urlconf_utils_hash_data(p, body->buf, body->buflen);
+    if (hash != NULL &&
+        strcmp(hash, elts[i]->hash) != 0) {
+      pr_log_pri(PR_LOG_NOTICE, MOD_CONF_URL_VERSION
+        ": watched URL '%s' changed, restarting", elts[i]->url);
+      return TRUE;
+    }
+
+    pr_trace_msg(trace_channel, 12, "'%s' content unchanged", elts[i]->url);
+  }
+
+  return failed ? -1 : FALSE;
+}
+
+/* Waits for any of the URLs watched using blocking queries to report a
+ * change, then checks whether their content really changed.  Returns TRUE
+ * if so, FALSE if not, or -1 if any of the queries failed.
+ */
+static int watch_wait(pool *p) {
+  register unsigned int i;
+  array_header *reqs, *waited, *changed;
+  struct watch_url **elts;
+  unsigned long max_request_secs;
+  int failed = FALSE, res;
+
+  reqs = make_array(p, 0, sizeof(struct urlconf_http_req *));
+  waited = make_array(p, 0, sizeof(struct watch_url *));
+  elts = watch_urls->elts;
+
+  for (i = 0; i < watch_urls->nelts; i++) {
+    struct urlconf_http_req *req;
+
+    if (elts[i]->type == URLCONF_WATCH_TYPE_POLL) {
+      continue;
+    }
+
+    req = watch_req(p, elts[i]);
+    req->url = watch_query_url(p, elts[i]);
+    req->resp_headers = pr_table_alloc(p, 0);
+    watch_add_token(p, elts[i], req);
+
+    *((struct urlconf_http_req **) push_array(reqs)) = req;
+    *((struct watch_url **) push_array(waited)) = elts[i];
+  }
+
+  /* When also polling, do not wait longer than the poll interval.  Note
+   * that etcd waits have no time limit of their own; they time out.
+   */
+  max_request_secs = URLCONF_WATCH_DEFAULT_WAIT + 30;
+  if (watch_interval > 0) {
+    max_request_secs = watch_get_wait() + 5;
+  }
+
+  if (urlconf_http_get_many(p, reqs, urlconf_http_default_headers(p),
+      URLCONF_WATCH_RETRY_INTERVAL, max_request_secs, 0) < 0) {
+    return -1;
+  }
+
+  /* Which URLs reported a change, and thus need their content checked? */
+  changed = make_array(p, 0, sizeof(struct watch_url *));
+
+  for (i = 0; i < reqs->nelts; i++) {
+    struct urlconf_http_req *req;
+    struct watch_url *watch;
+    const char *index_text;
+    unsigned long long index = 0;
+
+    req = ((struct urlconf_http_req **) reqs->elts)[i];
+    watch = ((struct watch_url **) waited->elts)[i];
+    watch_check_token(watch, req);
+
+    if (watch->type == URLCONF_WATCH_TYPE_ETCD &&
+        watch_interval > 0 &&
+        req->xerrno == ETIMEDOUT) {
+      /* The wait time elapsed, with no changes. */
+      continue;
+    }
+
+    if (req->xerrno != 0 ||
+        req->resp_code != URLCONF_HTTP_RESPONSE_CODE_OK) {
+      pr_trace_msg(trace_channel, 3,
+        "error waiting for changes to '%s': %s (response code %ld)",
+        watch->url, strerror(req->xerrno), req->resp_code);
+      failed = TRUE;
+      continue;
+    }
+
+    index_text = pr_table_get(req->resp_headers,
+      urlconf_watch_get_index_header(watch->type), NULL);
+    if (index_text != NULL) {
+      index = strtoull(index_text, NULL, 10);
+    }
+
+    if (watch->type == URLCONF_WATCH_TYPE_CONSUL &&
+        index == watch->index) {
+      /* The wait time elapsed, with no changes. */
+      continue;
+    }
+
+    pr_trace_msg(trace_channel, 12, "'%s' index changed from %llu to %llu",
+      watch->url, watch->index, index);
+
+    /* Per Consul, an index which goes backwards means that the index should
+     * be reset.
+     */
+    if (watch->type == URLCONF_WATCH_TYPE_CONSUL &&
+        index < watch->index) {
+      index = 0;
+    }
+
+    watch->index = index;
+
+    /* An index change does not necessarily mean that the content changed,
+     * e.g. for writes of the same value; fetch the content, to be sure.
+     */
+    *((struct watch_url **) push_array(changed)) = watch;
+  }
+
+  if (changed->nelts == 0) {
+    return failed ? -1 : FALSE;
+  }
+
+  res = watch_compare(p, changed, FALSE);
+  if (res == TRUE) {
+    return TRUE;
+  }
+
+  return failed ? -1 : res;
+}
+
+/* Polls the URLs watched by polling, using conditional requests. */
+static int watch_poll(pool *p) {
+  register unsigned int i;
+  array_header *polled;
+  struct watch_url **elts;
+
+  polled = make_array(p, 0, sizeof(struct watch_url *));
+  elts = watch_urls->elts;
+
+  for (i = 0; i < watch_urls->nelts; i++) {
+    if (elts[i]->type == URLCONF_WATCH_TYPE_POLL) {
+      *((struct watch_url **) push_array(polled)) = elts[i];
+    }
+  }
+
+  if (polled->nelts == 0) {
+    return FALSE;
+  }
+
+  pr_trace_msg(trace_channel, 15, "polling %d %s for changes", polled->nelts,
+    polled->nelts != 1 ? "URLs" : "URL");
+  return watch_compare(p, polled, TRUE);
+}
+
+static void watch_run(pid_t master_pid) {
+  register unsigned int i;
+  struct watch_url **elts;
+  int nwaited = 0, npolled = 0;
+
+  elts = watch_urls->elts;
+  for (i = 0; i < watch_urls->nelts; i++) {
+    if (elts[i]->type == URLCONF_WATCH_TYPE_POLL) {
+      npolled++;
+
+    } else {
+      nwaited++;
+    }
+  }
+
+  /* The daemon's signal handlers would have us act as the daemon, e.g.
+   * restarting on SIGHUP; use the default dispositions instead.
+   */
+  signal(SIGHUP, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGUSR2, SIG_DFL);
+
+  pr_proctitle_set("conf_url: watching %d %s", watch_urls->nelts,
+    watch_urls->nelts != 1 ? "URLs" : "URL");
+
+  while (TRUE) {
+    pool *tmp_pool;
+    int res;
+
+    /* If the daemon has gone, so do we. */
+    if (getppid() != master_pid) {
+      break;
+    }
+
+    tmp_pool = make_sub_pool(watch_pool);
+
+    if (nwaited > 0) {
+      /* This waits for up to the poll interval, if any. */
+      res = watch_wait(tmp_pool);
+
+    } else {
+      sleep(watch_interval);
+      res = FALSE;
+    }
+
+    if (res == FALSE &&
+        npolled > 0) {
+      res = watch_poll(tmp_pool);
+    }
+
+    destroy_pool(tmp_pool);
+
+    if (res == TRUE) {
+      if (getppid() == master_pid) {
+        kill(master_pid, SIGHUP);
+      }
+
+      break;
+    }
+
+    if (res < 0) {
+      sleep(URLCONF_WATCH_RETRY_INTERVAL);
+    }
+  }
+}
+
+int urlconf_watch_start(void) {
+  pid_t pid, master_pid;
+
+  if (watch_urls == NULL ||
+      watch_urls->nelts == 0) {
+    return 0;
+  }
+
+  if (watch_pid != 0) {
+    errno = EEXIST;
+    return -1;
+  }
+
+  master_pid = getpid();
+
+  pid = fork();
+  switch (pid) {
+    case -1: {
+      int xerrno = errno;
+
+      pr_log_pri(PR_LOG_WARNING, MOD_CONF_URL_VERSION
+        ": unable to fork watcher process: %s", strerror(xerrno));
+
+      errno = xerrno;
+      return -1;
+    }
+
+    case 0:
+      /* Child process */
+      watch_run(master_pid);
+      _exit(0);
+
+    default:
+      break;
+  }
+
+  watch_pid = pid;
+  watch_master_pid = master_pid;
+
+  pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+    ": started watcher process (PID %lu) for %d %s", (unsigned long) pid,
+    watch_urls->nelts, watch_urls->nelts != 1 ? "URLs" : "URL");
+  return 0;
+}
+
+int urlconf_watch_stop(void) {
+  if (watch_pid == 0) {
+    return 0;
+  }
+
+  /* Only the daemon process stops the watcher, not e.g. session processes
+   * forked from the daemon.
+   */
+  if (getpid() != watch_master_pid) {
+    return 0;
+  }
+
+  pr_log_debug(DEBUG3, MOD_CONF_URL_VERSION
+    ": stopping watcher process (PID %lu)", (unsigned long) watch_pid);
+
+  if (kill(watch_pid, SIGTERM) == 0) {
+    while (waitpid(watch_pid, NULL, 0) < 0) {
+      if (errno != EINTR) {
+        /* Already reaped, e.g. by the daemon's SIGCHLD handling. */
+        break;
+      }
+
+      pr_signals_handle();
+    }
+  }
+
+  watch_pid = 0;
+  watch_master_pid = 0;
+  return 0;
+}
+
+int urlconf_watch_clear(void) {
+  if (watch_pool != NULL) {
+    destroy_pool(watch_pool);
+    watch_pool = NULL;
+  }
+
+  watch_urls = NULL;
+  watch_interval = 0;
+  return 0;
+}
+
+int urlconf_watch_init(pool *p) {
+  if (p == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  watch_parent_pool = p;
+  return 0;
+}
+
+int urlconf_watch_free(void) {
+  (void) urlconf_watch_stop();
+  (void) urlconf_watch_clear();
+
+  watch_parent_pool = NULL;
+  return 0;
+}
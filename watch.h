@@ -0,0 +1,91 @@
+/*
+ * ProFTPD - mod_conf_url change watching
+ * Copyright (c) 2020 TJ Saunders
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA 02110-1335, USA.
+ *
+ * As a special exemption, TJ Saunders and other respective copyright holders
+ * give permission to link this program with OpenSSL, and distribute the
+ * resulting executable, without including the source code for OpenSSL in the
+ * source distribution.
+ */
+
+
+#include "mod_conf_url.h"
+
+#ifndef MOD_CONF_URL_WATCH_H
+#define MOD_CONF_URL_WATCH_H
+
+/* Kinds of watched URLs, i.e. how to wait for changes to them. */
+#define URLCONF_WATCH_TYPE_CONSUL	1
+#define URLCONF_WATCH_TYPE_ETCD		2
+#define URLCONF_WATCH_TYPE_POLL		3
+
+/* Default number of seconds for which a blocking query waits for a change,
+ * before returning.
+ */
+#define URLCONF_WATCH_DEFAULT_WAIT	300UL
+
+/* Number of seconds to wait before retrying, after failed queries. */
+#define URLCONF_WATCH_RETRY_INTERVAL	5U
+
+/* Returns the watch type for the given name (e.g. "consul"), or -1 with
+ * errno set to ENOENT for unknown names.
+ */
+int urlconf_watch_get_type(const char *name);
+
+/* Adds the given URL to those watched for changes.  The response headers,
+ * if any, provide the index (e.g. X-Consul-Index) or the validators (ETag,
+ * Last-Modified) of the content; the hash is that of the response body, as
+ * from urlconf_utils_hash_data().  The flags are the libcurl handle flags to
+ * use, and the TLS settings (any of which may be NULL) are applied to each
+ * request as by urlconf_http_set_ssl().  If use_token is TRUE, requests
+ * carry the bearer token from the token endpoint, obtaining a new token once
+ * the server rejects it.
+ */
+int urlconf_watch_add(const char *url, int type, unsigned long flags,
+  const char *ssl_ca_file, const char *ssl_ca_path, const char *ssl_cert,
+  const char *ssl_key, int use_token, pr_table_t *resp_headers,
+  const char *hash);
+
+/* Sets the number of seconds between polls of URLs watched by polling,
+ * i.e. of type URLCONF_WATCH_TYPE_POLL.
+ */
+int urlconf_watch_set_interval(unsigned long interval);
+
+/* Returns the name of the index response header for the given type. */
+const char *urlconf_watch_get_index_header(int type);
+
+/* Starts the watcher process, which waits for changes to the watched URLs.
+ * Once any of them change, the watcher sends SIGHUP to the daemon, i.e. to
+ * restart, and exits.  Does nothing if there are no watched URLs.  This
+ * must be called by the daemon process itself, i.e. after daemonizing, as
+ * the watcher exits once the calling process does.
+ */
+int urlconf_watch_start(void);
+
+/* Stops the watcher process, if any. */
+int urlconf_watch_stop(void);
+
+/* Discards all watched URLs, and the poll interval, e.g. before the configuration is parsed
+ * again.
+ */
+int urlconf_watch_clear(void);
+
+/* API lifetime functions, for mod_conf_url use only. */
+int urlconf_watch_init(pool *p);
+int urlconf_watch_free(void);
+
+#endif /* MOD_CONF_URL_WATCH_H */